@@ -0,0 +1,330 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef DRR_QUEUE_H
+#define DRR_QUEUE_H
+
+#include "OpQueue.h"
+#include "common/Formatter.h"
+#include "include/assert.h"
+
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <boost/intrusive/list.hpp>
+
+/**
+ * Deficit round robin op queue
+ *
+ * Normal ops are scheduled in two levels of deficit round robin.  Every
+ * priority with queued ops is a band on a ring; each turn a band earns
+ * priority * min_cost worth of credit and serves ops until it has spent
+ * it, so over time bandwidth is shared in proportion to priority.  Inside
+ * a band every class (client) with queued ops sits on its own ring and
+ * earns max_cost per turn, which shares the band's bandwidth equally
+ * between clients however deep their individual queues are.  Costs are
+ * clamped to [min_cost, max_cost], the same as PrioritizedQueue.
+ *
+ * Bands and clients are found through hash tables and linked on
+ * intrusive rings, so enqueue is O(1) and dequeue is O(1) amortized: a
+ * band that overspent on a large op may be passed over for a few turns
+ * while it pays back its debt.  Strict ops always go first, highest
+ * priority first and round robin between classes, as in the other
+ * queues.
+ */
+template <typename T, typename K>
+class DeficitRoundRobinQueue : public OpQueue <T, K>
+{
+  typedef boost::intrusive::list_member_hook<> ring_hook;
+
+  struct Client {
+    K key;
+    std::deque<std::pair<unsigned, T> > items; // (cost, item)
+    int64_t deficit = 0;
+    bool fresh = true; // at the start of its turn
+    ring_hook ring_item;
+    explicit Client(K k) : key(k) {}
+  };
+
+  /// All the ops queued at one priority
+  class Band {
+    typedef boost::intrusive::list<
+      Client,
+      boost::intrusive::member_hook<Client, ring_hook, &Client::ring_item> >
+      ClientRing;
+
+    std::unordered_map<K, Client> clients;
+    ClientRing ring;
+    int64_t client_quantum;
+
+    void end_turn(Client &c) {
+      c.fresh = true;
+      ring.erase(ring.iterator_to(c));
+      ring.push_back(c);
+    }
+
+  public:
+    unsigned priority;
+    unsigned size = 0;
+    int64_t deficit = 0;
+    bool fresh = true;
+    ring_hook ring_item;
+
+    Band(unsigned p, int64_t q) : client_quantum(q), priority(p) {}
+    Band(const Band&) = delete;
+    ~Band() {
+      ring.clear();
+    }
+
+    bool empty() const {
+      return size == 0;
+    }
+
+    unsigned get_cost() const {
+      assert(!empty());
+      return ring.front().items.front().first;
+    }
+
+    void insert(K cl, unsigned cost, T&& item, bool front) {
+      auto p = clients.emplace(cl, cl);
+      Client &c = p.first->second;
+      if (p.second)
+	ring.push_back(c);
+      if (front)
+	c.items.emplace_front(cost, std::move(item));
+      else
+	c.items.emplace_back(cost, std::move(item));
+      ++size;
+    }
+
+    /// Take the next op and return its cost through cost.
+    T pop(unsigned *cost) {
+      assert(!empty());
+      for (;;) {
+	Client &c = ring.front();
+	if (c.fresh) {
+	  c.deficit += client_quantum;
+	  c.fresh = false;
+	}
+	if (c.deficit <= 0) {
+	  end_turn(c);
+	  continue;
+	}
+	*cost = c.items.front().first;
+	T ret = std::move(c.items.front().second);
+	c.items.pop_front();
+	c.deficit -= *cost;
+	--size;
+	if (c.items.empty()) {
+	  K key = c.key;
+	  ring.pop_front();
+	  clients.erase(key);
+	} else if (c.deficit <= 0) {
+	  end_turn(c);
+	}
+	return ret;
+      }
+    }
+
+    unsigned filter_class(K cl, std::list<T> *out) {
+      auto i = clients.find(cl);
+      if (i == clients.end())
+	return 0;
+      Client &c = i->second;
+      unsigned count = c.items.size();
+      if (out) {
+	for (auto j = c.items.rbegin(); j != c.items.rend(); ++j)
+	  out->push_front(std::move(j->second));
+      }
+      ring.erase(ring.iterator_to(c));
+      clients.erase(i);
+      size -= count;
+      return count;
+    }
+
+    void dump(ceph::Formatter *f) const {
+      f->dump_int("priority", priority);
+      f->dump_int("size", size);
+      f->dump_int("num_clients", clients.size());
+      f->dump_int("deficit", deficit);
+      if (!empty())
+	f->dump_int("first_item_cost", get_cost());
+    }
+  };
+
+  typedef boost::intrusive::list<
+    Band,
+    boost::intrusive::member_hook<Band, ring_hook, &Band::ring_item> >
+    BandRing;
+
+  const unsigned max_cost;
+  const unsigned min_cost;
+
+  /// strict bands, highest priority first
+  std::map<unsigned, Band, std::greater<unsigned> > strict;
+  unsigned strict_size = 0;
+
+  std::unordered_map<unsigned, Band> normal;
+  BandRing ring;
+  unsigned normal_size = 0;
+
+  unsigned clamp_cost(unsigned cost) const {
+    if (cost < min_cost)
+      return min_cost;
+    if (cost > max_cost)
+      return max_cost;
+    return cost;
+  }
+
+  void insert_strict(K cl, unsigned p, T&& item, bool front) {
+    auto i = strict.find(p);
+    if (i == strict.end()) {
+      i = strict.emplace(std::piecewise_construct,
+			 std::forward_as_tuple(p),
+			 std::forward_as_tuple(p, max_cost)).first;
+    }
+    // a full quantum per op makes this plain round robin between classes
+    i->second.insert(cl, max_cost, std::move(item), front);
+    ++strict_size;
+  }
+
+  void insert_normal(K cl, unsigned p, unsigned cost, T&& item, bool front) {
+    auto i = normal.find(p);
+    if (i == normal.end()) {
+      i = normal.emplace(std::piecewise_construct,
+			 std::forward_as_tuple(p),
+			 std::forward_as_tuple(p, max_cost)).first;
+      ring.push_back(i->second);
+    }
+    i->second.insert(cl, clamp_cost(cost), std::move(item), front);
+    ++normal_size;
+  }
+
+  T pop_normal() {
+    for (;;) {
+      Band &b = ring.front();
+      if (b.fresh) {
+	// priority 0 still gets to run, just rarely
+	b.deficit += (int64_t)std::max(b.priority, 1u) * min_cost;
+	b.fresh = false;
+      }
+      if (b.deficit <= 0) {
+	b.fresh = true;
+	ring.pop_front();
+	ring.push_back(b);
+	continue;
+      }
+      unsigned cost;
+      T ret = b.pop(&cost);
+      b.deficit -= cost;
+      --normal_size;
+      if (b.empty()) {
+	unsigned p = b.priority;
+	ring.pop_front();
+	normal.erase(p);
+      } else if (b.deficit <= 0) {
+	b.fresh = true;
+	ring.pop_front();
+	ring.push_back(b);
+      }
+      return ret;
+    }
+  }
+
+public:
+  DeficitRoundRobinQueue(unsigned max_per, unsigned min_c)
+    : max_cost(std::max(max_per, 1u)),
+      min_cost(std::max(std::min(min_c, max_cost), 1u))
+  {}
+
+  ~DeficitRoundRobinQueue() override {
+    ring.clear();
+  }
+
+  unsigned length() const final {
+    return strict_size + normal_size;
+  }
+
+  void remove_by_class(K cl, std::list<T> *removed = 0) final {
+    for (auto i = strict.begin(); i != strict.end(); ) {
+      strict_size -= i->second.filter_class(cl, removed);
+      if (i->second.empty())
+	i = strict.erase(i);
+      else
+	++i;
+    }
+    for (auto i = normal.begin(); i != normal.end(); ) {
+      normal_size -= i->second.filter_class(cl, removed);
+      if (i->second.empty()) {
+	ring.erase(ring.iterator_to(i->second));
+	i = normal.erase(i);
+      } else {
+	++i;
+      }
+    }
+  }
+
+  bool empty() const final {
+    return !(strict_size + normal_size);
+  }
+
+  void enqueue_strict(K cl, unsigned p, T&& item) final {
+    insert_strict(cl, p, std::move(item), false);
+  }
+
+  void enqueue_strict_front(K cl, unsigned p, T&& item) final {
+    insert_strict(cl, p, std::move(item), true);
+  }
+
+  void enqueue(K cl, unsigned p, unsigned cost, T&& item) final {
+    insert_normal(cl, p, cost, std::move(item), false);
+  }
+
+  void enqueue_front(K cl, unsigned p, unsigned cost, T&& item) final {
+    insert_normal(cl, p, cost, std::move(item), true);
+  }
+
+  T dequeue() final {
+    assert(!empty());
+    if (strict_size) {
+      auto i = strict.begin();
+      unsigned cost;
+      T ret = i->second.pop(&cost);
+      --strict_size;
+      if (i->second.empty())
+	strict.erase(i);
+      return ret;
+    }
+    return pop_normal();
+  }
+
+  void dump(ceph::Formatter *f) const final {
+    f->dump_int("max_cost", max_cost);
+    f->dump_int("min_cost", min_cost);
+    f->open_array_section("high_queues");
+    for (auto& i : strict) {
+      f->open_object_section("subqueue");
+      i.second.dump(f);
+      f->close_section();
+    }
+    f->close_section();
+    f->open_array_section("queues");
+    for (auto& b : ring) {
+      f->open_object_section("subqueue");
+      b.dump(f);
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
+#endif
@@ -10,6 +10,16 @@
 void Finisher::start()
 {
   ldout(cct, 10) << __func__ << dendl;
+  FinisherPool *p = use_pool ? FinisherPool::get(cct) : NULL;
+  if (p) {
+    finisher_lock.Lock();
+    pool = p;
+    pool_home = pool->assign_home();
+    if (!finisher_queue.empty())
+      _wake();
+    finisher_lock.Unlock();
+    return;
+  }
   finisher_thread.create(thread_name.c_str());
 }
 
@@ -18,6 +28,17 @@ void Finisher::stop()
   ldout(cct, 10) << __func__ << dendl;
   finisher_lock.Lock();
   finisher_stop = true;
+  if (pool) {
+    // like the dedicated thread, the pool finishes what is already queued;
+    // after that it must not touch us again
+    while (pool_scheduled)
+      finisher_empty_cond.Wait(finisher_lock);
+    pool = NULL;
+    finisher_stop = false;
+    finisher_lock.Unlock();
+    ldout(cct, 10) << __func__ << " finish" << dendl;
+    return;
+  }
   // we don't have any new work to do, but we want the worker to wake up anyway
   // to process the stop condition.
   finisher_cond.Signal();
@@ -39,6 +60,50 @@ void Finisher::wait_for_empty()
   finisher_lock.Unlock();
 }
 
+void Finisher::_wake()
+{
+  assert(finisher_lock.is_locked());
+  if (!pool) {
+    finisher_cond.Signal();
+  } else if (!pool_scheduled) {
+    pool_scheduled = true;
+    pool->schedule(this, pool_home);
+  }
+}
+
+bool Finisher::run_pooled_batch()
+{
+  finisher_lock.Lock();
+  vector<pair<Context*,int>> ls;
+  ls.swap(finisher_queue);
+  finisher_running = true;
+  finisher_lock.Unlock();
+  ldout(cct, 10) << "finisher pooled doing " << ls << dendl;
+
+  utime_t start;
+  if (logger)
+    start = ceph_clock_now();
+  for (auto p : ls) {
+    p.first->complete(p.second);
+  }
+  ldout(cct, 10) << "finisher pooled done with " << ls << dendl;
+  if (logger) {
+    logger->dec(l_finisher_queue_len, ls.size());
+    logger->tinc(l_finisher_complete_lat, ceph_clock_now() - start);
+  }
+
+  finisher_lock.Lock();
+  finisher_running = false;
+  bool more = !finisher_queue.empty();
+  if (!more) {
+    pool_scheduled = false;
+    if (unlikely(finisher_empty_wait || finisher_stop))
+      finisher_empty_cond.Signal();
+  }
+  finisher_lock.Unlock();
+  return more;
+}
+
 void *Finisher::finisher_thread_entry()
 {
   finisher_lock.Lock();
@@ -96,3 +161,113 @@ void *Finisher::finisher_thread_entry()
   return 0;
 }
 
+
+#undef dout_prefix
+#define dout_prefix *_dout << "finisher_pool(" << this << ") "
+
+void *FinisherPool::Worker::entry()
+{
+  pool->worker_entry(this);
+  return 0;
+}
+
+FinisherPool::FinisherPool(CephContext *cct_, unsigned num_threads)
+  : cct(cct_), pool_lock("FinisherPool::pool_lock"), pool_stop(false),
+    num_ready(0), num_sleeping(0), next_home(0)
+{
+  assert(num_threads > 0);
+  ldout(cct, 10) << __func__ << " " << num_threads << " threads" << dendl;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    workers.push_back(new Worker(this, i));
+    workers.back()->create("fn_pool");
+  }
+}
+
+FinisherPool::~FinisherPool()
+{
+  ldout(cct, 10) << __func__ << dendl;
+  pool_lock.Lock();
+  pool_stop = true;
+  pool_cond.Signal();
+  pool_lock.Unlock();
+  for (auto w : workers) {
+    w->join();
+    assert(w->ready.empty());
+    delete w;
+  }
+}
+
+FinisherPool *FinisherPool::get(CephContext *cct)
+{
+  int64_t n = cct->_conf->get_val<int64_t>("finisher_pool_threads");
+  if (n <= 0)
+    return NULL;
+  return &cct->lookup_or_create_singleton_object<FinisherPool>(
+    "finisher_pool", false, cct, (unsigned)n);
+}
+
+void FinisherPool::schedule(Finisher *f, unsigned home)
+{
+  Worker *w = workers[home];
+  // count it first so that a thief never takes num_ready below zero
+  ++num_ready;
+  w->lock.Lock();
+  w->ready.push_back(f);
+  w->lock.Unlock();
+  if (num_sleeping > 0) {
+    pool_lock.Lock();
+    pool_cond.SignalOne();
+    pool_lock.Unlock();
+  }
+}
+
+Finisher *FinisherPool::_pop(Worker *w)
+{
+  Finisher *f = NULL;
+  w->lock.Lock();
+  if (!w->ready.empty()) {
+    f = w->ready.front();
+    w->ready.pop_front();
+  }
+  w->lock.Unlock();
+
+  // steal from the cold end of the other workers' queues
+  for (unsigned i = 1; !f && i < workers.size(); ++i) {
+    Worker *victim = workers[(w->id + i) % workers.size()];
+    victim->lock.Lock();
+    if (!victim->ready.empty()) {
+      f = victim->ready.back();
+      victim->ready.pop_back();
+    }
+    victim->lock.Unlock();
+  }
+  if (f)
+    --num_ready;
+  return f;
+}
+
+void FinisherPool::worker_entry(Worker *w)
+{
+  ldout(cct, 10) << "worker " << w->id << " start" << dendl;
+  while (true) {
+    Finisher *f = _pop(w);
+    if (f) {
+      // a Finisher with more work goes to the back of our queue so the
+      // others sharing this worker get their turn in between batches
+      if (f->run_pooled_batch())
+	schedule(f, w->id);
+      continue;
+    }
+
+    pool_lock.Lock();
+    ++num_sleeping;
+    while (num_ready == 0 && !pool_stop)
+      pool_cond.Wait(pool_lock);
+    --num_sleeping;
+    bool stop = pool_stop && num_ready == 0;
+    pool_lock.Unlock();
+    if (stop)
+      break;
+  }
+  ldout(cct, 10) << "worker " << w->id << " stop" << dendl;
+}
@@ -15,11 +15,15 @@
 #ifndef CEPH_FINISHER_H
 #define CEPH_FINISHER_H
 
+#include <atomic>
+#include <deque>
+
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/perf_counters.h"
 
 class CephContext;
+class FinisherPool;
 
 /// Finisher queue length performance counter ID.
 enum {
@@ -33,8 +37,14 @@ enum {
  * Finisher asynchronously completes Contexts, which are simple classes
  * representing callbacks, in a dedicated worker thread. Enqueuing
  * contexts to complete is thread-safe.
+ *
+ * A pooled Finisher has no thread of its own when finisher_pool_threads
+ * is set; its contexts are run by the shared FinisherPool instead, still
+ * in queue order and never concurrently with each other.
  */
 class Finisher {
+  friend class FinisherPool;
+
   CephContext *cct;
   Mutex        finisher_lock; ///< Protects access to queues and finisher_running.
   Cond         finisher_cond; ///< Signaled when there is something to process.
@@ -43,6 +53,11 @@ class Finisher {
   bool         finisher_running; ///< True when the finisher is currently executing contexts.
   bool	       finisher_empty_wait; ///< True mean someone wait finisher empty.
 
+  bool         use_pool; ///< Run on the shared pool if one is configured.
+  FinisherPool *pool; ///< Pool we are started on, or NULL for our own thread.
+  unsigned     pool_home; ///< Pool worker we are normally queued on.
+  bool         pool_scheduled; ///< Queued on, or being run by, a pool worker.
+
   /// Queue for contexts for which complete(0) will be called.
   vector<pair<Context*,int>> finisher_queue;
 
@@ -54,6 +69,12 @@ class Finisher {
   
   void *finisher_thread_entry();
 
+  /// Tell whoever runs us that finisher_queue is no longer empty.
+  void _wake();
+
+  /// Run one batch on a pool worker; returns true if more work is queued.
+  bool run_pooled_batch();
+
   struct FinisherThread : public Thread {
     Finisher *fin;    
     explicit FinisherThread(Finisher *f) : fin(f) {}
@@ -65,7 +86,7 @@ class Finisher {
   void queue(Context *c, int r = 0) {
     finisher_lock.Lock();
     if (finisher_queue.empty()) {
-      finisher_cond.Signal();
+      _wake();
     }
     finisher_queue.push_back(make_pair(c, r));
     if (logger)
@@ -76,7 +97,7 @@ class Finisher {
   void queue(list<Context*>& ls) {
     finisher_lock.Lock();
     if (finisher_queue.empty()) {
-      finisher_cond.Signal();
+      _wake();
     }
     for (auto i : ls) {
       finisher_queue.push_back(make_pair(i, 0));
@@ -89,7 +110,7 @@ class Finisher {
   void queue(deque<Context*>& ls) {
     finisher_lock.Lock();
     if (finisher_queue.empty()) {
-      finisher_cond.Signal();
+      _wake();
     }
     for (auto i : ls) {
       finisher_queue.push_back(make_pair(i, 0));
@@ -102,7 +123,7 @@ class Finisher {
   void queue(vector<Context*>& ls) {
     finisher_lock.Lock();
     if (finisher_queue.empty()) {
-      finisher_cond.Signal();
+      _wake();
     }
     for (auto i : ls) {
       finisher_queue.push_back(make_pair(i, 0));
@@ -134,13 +155,17 @@ class Finisher {
   explicit Finisher(CephContext *cct_) :
     cct(cct_), finisher_lock("Finisher::finisher_lock"),
     finisher_stop(false), finisher_running(false), finisher_empty_wait(false),
+    use_pool(false), pool(NULL), pool_home(0), pool_scheduled(false),
     thread_name("fn_anonymous"), logger(0),
     finisher_thread(this) {}
 
   /// Construct a named Finisher that logs its queue length.
-  Finisher(CephContext *cct_, string name, string tn) :
+  /// With pooled set it runs on the shared FinisherPool when
+  /// finisher_pool_threads is non-zero.
+  Finisher(CephContext *cct_, string name, string tn, bool pooled = false) :
     cct(cct_), finisher_lock("Finisher::" + name),
     finisher_stop(false), finisher_running(false), finisher_empty_wait(false),
+    use_pool(pooled), pool(NULL), pool_home(0), pool_scheduled(false),
     thread_name(tn), logger(0),
     finisher_thread(this) {
     PerfCountersBuilder b(cct, string("finisher-") + name,
@@ -161,6 +186,52 @@ class Finisher {
   }
 };
 
+/** @brief Threads shared by pooled Finishers.
+ * Each pooled Finisher is an ordering domain: while it has work it sits on
+ * exactly one worker's ready queue or is being run by exactly one worker,
+ * which completes everything queued so far as one batch.  Workers take
+ * Finishers from the front of their own ready queue and, when that is
+ * empty, steal from the back of their peers', so a few busy Finishers do
+ * not leave the other threads idle.  One pool exists per CephContext.
+ */
+class FinisherPool {
+  struct Worker : public Thread {
+    FinisherPool *pool;
+    unsigned id;
+    Mutex lock; ///< Protects ready.
+    std::deque<Finisher*> ready;
+    Worker(FinisherPool *p, unsigned i)
+      : pool(p), id(i), lock("FinisherPool::Worker::lock") {}
+    void *entry() override;
+  };
+
+  CephContext *cct;
+  vector<Worker*> workers;
+  Mutex pool_lock; ///< Protects pool_stop; sleeping workers wait on it.
+  Cond pool_cond;
+  bool pool_stop;
+  std::atomic<unsigned> num_ready; ///< Finishers on some ready queue.
+  std::atomic<unsigned> num_sleeping;
+  std::atomic<unsigned> next_home;
+
+  Finisher *_pop(Worker *w);
+  void worker_entry(Worker *w);
+
+public:
+  FinisherPool(CephContext *cct_, unsigned num_threads);
+  ~FinisherPool();
+
+  /// The pool for this context, or NULL if finisher_pool_threads is 0.
+  static FinisherPool *get(CephContext *cct);
+
+  unsigned assign_home() {
+    return next_home++ % workers.size();
+  }
+
+  /// Put a Finisher that just became runnable on worker home's queue.
+  void schedule(Finisher *f, unsigned home);
+};
+
 /// Context that is completed asynchronously on the supplied finisher.
 class C_OnFinisher : public Context {
   Context *con;
@@ -34,13 +34,11 @@ public:
 
 
 
-typedef std::multimap < utime_t, Context *> scheduled_map_t;
-typedef std::map < Context*, scheduled_map_t::iterator > event_lookup_map_t;
-
 SafeTimer::SafeTimer(CephContext *cct_, Mutex &l, bool safe_callbacks)
   : cct(cct_), lock(l),
     safe_callbacks(safe_callbacks),
     thread(NULL),
+    schedule(to_tick(ceph_clock_now(), false)),
     stopping(false)
 {
 }
@@ -50,6 +48,17 @@ SafeTimer::~SafeTimer()
   assert(thread == NULL);
 }
 
+uint64_t SafeTimer::to_tick(utime_t t, bool round_up)
+{
+  uint64_t ns = t.to_nsec();
+  return round_up ? (ns + 999999) / 1000000 : ns / 1000000;
+}
+
+utime_t SafeTimer::from_tick(uint64_t tick)
+{
+  return utime_t(tick / 1000, (tick % 1000) * 1000000);
+}
+
 void SafeTimer::init()
 {
   ldout(cct,10) << "init" << dendl;
@@ -79,17 +88,22 @@ void SafeTimer::timer_thread()
   ldout(cct,10) << "timer_thread starting" << dendl;
   while (!stopping) {
     utime_t now = ceph_clock_now();
+    uint64_t now_tick = to_tick(now, false);
+    if (now_tick < schedule.get_cur()) {
+      // the wall clock was stepped back; events stay due at their 'when'
+      ldout(cct,10) << "timer_thread clock went backwards, rebasing" << dendl;
+      schedule.rebase(now_tick);
+    }
 
-    while (!schedule.empty()) {
-      scheduled_map_t::iterator p = schedule.begin();
-
-      // is the future now?
-      if (p->first > now)
-	break;
+    // pull everything that is due in one go; events in the batch stay in
+    // 'events' until they run, so they can still be cancelled while the
+    // lock is dropped for unsafe callbacks
+    schedule_t::list_type expired;
+    schedule.advance(now_tick, expired);
 
-      Context *callback = p->second;
+    while (!expired.empty()) {
+      Context *callback = expired.front().callback;
       events.erase(callback);
-      schedule.erase(p);
       ldout(cct,10) << "timer_thread executing " << callback << dendl;
       
       if (!safe_callbacks)
@@ -104,10 +118,11 @@ void SafeTimer::timer_thread()
       break;
 
     ldout(cct,20) << "timer_thread going to sleep" << dendl;
-    if (schedule.empty())
+    uint64_t next = schedule.next_tick();
+    if (next == schedule_t::NONE)
       cond.Wait(lock);
     else
-      cond.WaitUntil(lock, schedule.begin()->first);
+      cond.WaitUntil(lock, from_tick(next));
     ldout(cct,20) << "timer_thread awake" << dendl;
   }
   ldout(cct,10) << "timer_thread exiting" << dendl;
@@ -132,18 +147,19 @@ Context* SafeTimer::add_event_at(utime_t when, Context *callback)
     delete callback;
     return nullptr;
   }
-  scheduled_map_t::value_type s_val(when, callback);
-  scheduled_map_t::iterator i = schedule.insert(s_val);
-
-  event_lookup_map_t::value_type e_val(callback, i);
-  pair < event_lookup_map_t::iterator, bool > rval(events.insert(e_val));
+  uint64_t tick = to_tick(when, true);
+  auto rval = events.emplace(std::piecewise_construct,
+			     std::forward_as_tuple(callback),
+			     std::forward_as_tuple(callback, when, tick));
 
   /* If you hit this, you tried to insert the same Context* twice. */
   assert(rval.second);
 
   /* If the event we have just inserted comes before everything else, we need to
    * adjust our timeout. */
-  if (i == schedule.begin())
+  uint64_t next = schedule.next_tick();
+  schedule.insert(rval.first->second);
+  if (tick < next)
     cond.Signal();
   return callback;
 }
@@ -158,10 +174,10 @@ bool SafeTimer::cancel_event(Context *callback)
     return false;
   }
 
-  ldout(cct,10) << "cancel_event " << p->second->first << " -> " << callback << dendl;
+  ldout(cct,10) << "cancel_event " << p->second.when << " -> " << callback << dendl;
   delete p->first;
 
-  schedule.erase(p->second);
+  schedule_t::erase(p->second);
   events.erase(p);
   return true;
 }
@@ -173,9 +189,9 @@ void SafeTimer::cancel_all_events()
   
   while (!events.empty()) {
     auto p = events.begin();
-    ldout(cct,10) << " cancelled " << p->second->first << " -> " << p->first << dendl;
+    ldout(cct,10) << " cancelled " << p->second.when << " -> " << p->first << dendl;
     delete p->first;
-    schedule.erase(p->second);
+    schedule_t::erase(p->second);
     events.erase(p);
   }
 }
@@ -186,8 +202,6 @@ void SafeTimer::dump(const char *caller) const
     caller = "";
   ldout(cct,10) << "dump " << caller << dendl;
 
-  for (scheduled_map_t::const_iterator s = schedule.begin();
-       s != schedule.end();
-       ++s)
-    ldout(cct,10) << " " << s->first << "->" << s->second << dendl;
+  for (auto& p : events)
+    ldout(cct,10) << " " << p.second.when << "->" << p.first << dendl;
 }
@@ -15,8 +15,11 @@
 #ifndef CEPH_TIMER_H
 #define CEPH_TIMER_H
 
+#include <unordered_map>
+
 #include "Cond.h"
 #include "Mutex.h"
+#include "timing_wheel.h"
 
 class CephContext;
 class Context;
@@ -35,10 +38,26 @@ class SafeTimer
   void timer_thread();
   void _shutdown();
 
-  std::multimap<utime_t, Context*> schedule;
-  std::map<Context*, std::multimap<utime_t, Context*>::iterator> events;
+  struct event_t {
+    Context *callback;
+    utime_t when;
+    uint64_t tick;
+    ceph::timing_wheel_hook schedule_item;
+    event_t(Context *c, utime_t w, uint64_t t)
+      : callback(c), when(w), tick(t) {}
+  };
+  typedef ceph::timing_wheel<event_t, &event_t::schedule_item,
+			     &event_t::tick> schedule_t;
+
+  /// pending events, bucketed by millisecond tick
+  schedule_t schedule;
+  /// owns the event nodes; erasing one also unlinks it from the schedule
+  std::unordered_map<Context*, event_t> events;
   bool stopping;
 
+  static uint64_t to_tick(utime_t t, bool round_up);
+  static utime_t from_tick(uint64_t tick);
+
   void dump(const char *caller = 0) const;
 
 public:
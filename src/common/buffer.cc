@@ -85,6 +85,23 @@ using namespace ceph;
     return buffer_history_alloc_num;
   }
 
+  namespace {
+  /// spare list nodes, each holding an empty ptr, kept by the thread
+  /// that freed them.  they are plain std::list nodes, so they splice in
+  /// and out of any buffer::list without allocating
+  const size_t max_spare_list_nodes = 1024;
+  /// plain thread_local, still usable while other thread_locals (which
+  /// may own bufferlists) are being destroyed at thread exit
+  thread_local bool spare_list_nodes_gone = false;
+  struct spare_list_nodes_t {
+    std::list<buffer::ptr> nodes;
+    ~spare_list_nodes_t() {
+      spare_list_nodes_gone = true;
+    }
+  };
+  thread_local spare_list_nodes_t spare_list_nodes;
+  } // namespace
+
   static std::atomic<unsigned> buffer_cached_crc { 0 };
   static std::atomic<unsigned> buffer_cached_crc_adjusted { 0 };
   static std::atomic<unsigned> buffer_missed_crc { 0 };
@@ -1515,6 +1532,40 @@ public:
     other.clear();
   }
 
+  void buffer::list::_push_back_buffer(const ptr& bp)
+  {
+    if (!spare_list_nodes_gone && !spare_list_nodes.nodes.empty()) {
+      auto& spare = spare_list_nodes.nodes;
+      _buffers.splice(_buffers.end(), spare, spare.begin());
+      _buffers.back() = bp;
+    } else {
+      _buffers.push_back(bp);
+    }
+  }
+
+  void buffer::list::_push_back_buffer(ptr&& bp)
+  {
+    if (!spare_list_nodes_gone && !spare_list_nodes.nodes.empty()) {
+      auto& spare = spare_list_nodes.nodes;
+      _buffers.splice(_buffers.end(), spare, spare.begin());
+      _buffers.back() = std::move(bp);
+    } else {
+      _buffers.push_back(std::move(bp));
+    }
+  }
+
+  void buffer::list::_release_buffers()
+  {
+    if (!spare_list_nodes_gone) {
+      auto& spare = spare_list_nodes.nodes;
+      while (!_buffers.empty() && spare.size() < max_spare_list_nodes) {
+	_buffers.front() = ptr();
+	spare.splice(spare.begin(), _buffers, _buffers.begin());
+      }
+    }
+    _buffers.clear();
+  }
+
   void buffer::list::swap(list& other)
   {
     std::swap(_len, other._len);
@@ -1970,7 +2021,7 @@ public:
     for (std::list<ptr>::const_iterator p = bl._buffers.begin();
 	 p != bl._buffers.end();
 	 ++p) 
-      _buffers.push_back(*p);
+      _push_back_buffer(*p);
   }
 
   void buffer::list::append(std::istream& in)
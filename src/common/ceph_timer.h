@@ -19,6 +19,8 @@
 #include <thread>
 #include <boost/intrusive/set.hpp>
 
+#include "common/timing_wheel.h"
+
 namespace ceph {
 
   /// Newly constructed timer should be suspended at point of
@@ -55,41 +57,55 @@ namespace ceph {
     class timer {
       using sh = set_member_hook<link_mode<normal_link> >;
 
+      // Events are bucketed on a timing wheel at millisecond
+      // granularity, rounding up so nothing fires before its time.
+      static constexpr uint64_t tick_ns = 1000000;
+
+      static uint64_t to_tick(typename TC::time_point t, bool round_up) {
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+	  t.time_since_epoch()).count();
+	if (ns <= 0)
+	  return 0;
+	return round_up ? (ns + tick_ns - 1) / tick_ns : ns / tick_ns;
+      }
+
+      static typename TC::time_point from_tick(uint64_t tick) {
+	return typename TC::time_point(
+	  std::chrono::duration_cast<typename TC::duration>(
+	    std::chrono::nanoseconds(tick * tick_ns)));
+      }
+
       struct event {
 	typename TC::time_point t;
 	uint64_t id;
+	uint64_t tick;
 	std::function<void()> f;
 
-	sh schedule_link;
+	timing_wheel_hook schedule_link;
 	sh event_link;
 
-	event() : t(TC::time_point::min()), id(0) {}
-	event(uint64_t _id) : t(TC::time_point::min()), id(_id) {}
+	event() : t(TC::time_point::min()), id(0), tick(0) {}
+	event(uint64_t _id) : t(TC::time_point::min()), id(_id), tick(0) {}
 	event(typename TC::time_point _t, uint64_t _id,
-	      std::function<void()>&& _f) : t(_t), id(_id), f(_f) {}
+	      std::function<void()>&& _f)
+	  : t(_t), id(_id), tick(to_tick(_t, true)), f(_f) {}
 	event(typename TC::time_point _t, uint64_t _id,
-	      const std::function<void()>& _f) : t(_t), id(_id), f(_f) {}
+	      const std::function<void()>& _f)
+	  : t(_t), id(_id), tick(to_tick(_t, true)), f(_f) {}
 	bool operator <(const event& e) {
 	  return t == e.t ? id < e.id : t < e.t;
 	}
       };
-      struct SchedCompare {
-	bool operator()(const event& e1, const event& e2) const {
-	  return e1.t == e2.t ? e1.id < e2.id : e1.t < e2.t;
-	}
-      };
       struct EventCompare {
 	bool operator()(const event& e1, const event& e2) const {
 	  return e1.id < e2.id;
 	}
       };
 
-      using schedule_type = set<event,
-				member_hook<event, sh, &event::schedule_link>,
-				constant_time_size<false>,
-				compare<SchedCompare> >;
+      using schedule_type = timing_wheel<event, &event::schedule_link,
+					 &event::tick>;
 
-      schedule_type schedule;
+      schedule_type schedule{ to_tick(TC::now(), false) };
 
       using event_set_type = set<event,
 				 member_hook<event, sh, &event::event_link>,
@@ -113,15 +129,21 @@ namespace ceph {
 	unique_lock l(lock);
 	while (!suspended) {
 	  typename TC::time_point now = TC::now();
+	  uint64_t now_tick = to_tick(now, false);
+	  if (now_tick < schedule.get_cur()) {
+	    // only a clock that can be stepped (real_clock) gets here
+	    schedule.rebase(now_tick);
+	  }
 
-	  while (!schedule.empty()) {
-	    auto p = schedule.begin();
-	    // Should we wait for the future?
-	    if (p->t > now)
-	      break;
+	  // Everything due is expired as one batch. Events stay in
+	  // 'events' until they run, so cancel_event can still pull
+	  // them out of the batch while the lock is dropped.
+	  typename schedule_type::list_type expired;
+	  schedule.advance(now_tick, expired);
 
-	    event& e = *p;
-	    schedule.erase(e);
+	  while (!expired.empty()) {
+	    event& e = expired.front();
+	    expired.pop_front();
 	    events.erase(e);
 
 	    // Since we have only one thread it is impossible to have more
@@ -138,10 +160,11 @@ namespace ceph {
 	    } // Otherwise the event requeued itself
 	  }
 
-	  if (schedule.empty())
+	  uint64_t next = schedule.next_tick();
+	  if (next == schedule_type::NONE)
 	    cond.wait(l);
 	  else
-	    cond.wait_until(l, schedule.begin()->t);
+	    cond.wait_until(l, from_tick(next));
 	}
       }
 
@@ -213,12 +236,13 @@ namespace ceph {
 		       std::forward<std::function<void()> >(
 			 std::bind(std::forward<Callable>(f),
 				   std::forward<Args>(args)...))));
-	auto i = schedule.insert(e);
+	uint64_t next = schedule.next_tick();
+	schedule.insert(e);
 	events.insert(e);
 
 	/* If the event we have just inserted comes before everything
 	 * else, we need to adjust our timeout. */
-	if (i.first == schedule.begin())
+	if (e.tick < next)
 	  cond.notify_one();
 
 	// Previously each event was a context, identified by a
@@ -247,8 +271,9 @@ namespace ceph {
 
 	event& e = *it;
 
-	schedule.erase(e);
+	schedule_type::erase(e);
 	e.t = when;
+	e.tick = to_tick(when, true);
 	schedule.insert(e);
 
 	return true;
@@ -267,7 +292,7 @@ namespace ceph {
 
 	event& e = *p;
 	events.erase(e);
-	schedule.erase(e);
+	schedule_type::erase(e);
 	delete &e;
 
 	return true;
@@ -300,6 +325,7 @@ namespace ceph {
 	  throw std::make_error_condition(std::errc::operation_not_permitted);
 	std::lock_guard<std::mutex> l(lock);
 	running->t = when;
+	running->tick = to_tick(when, true);
 	uint64_t id = ++next_id;
 	running->id = id;
 	schedule.insert(*running);
@@ -318,7 +344,7 @@ namespace ceph {
 	while (!events.empty()) {
 	  auto p = events.begin();
 	  event& e = *p;
-	  schedule.erase(e);
+	  schedule_type::erase(e);
 	  events.erase(e);
 	  delete &e;
 	}
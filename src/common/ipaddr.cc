@@ -117,6 +117,32 @@ const struct ifaddrs *find_ip_in_subnet(const struct ifaddrs *addrs,
 }
 
 
+bool network_contains(const struct sockaddr *net,
+		      unsigned int prefix_len,
+		      const struct sockaddr *addr) {
+  if (net->sa_family != addr->sa_family)
+    return false;
+
+  switch (net->sa_family) {
+    case AF_INET: {
+      struct in_addr want, temp;
+      netmask_ipv4(&((struct sockaddr_in*)net)->sin_addr, prefix_len, &want);
+      netmask_ipv4(&((struct sockaddr_in*)addr)->sin_addr, prefix_len, &temp);
+      return temp.s_addr == want.s_addr;
+    }
+
+    case AF_INET6: {
+      struct in6_addr want, temp;
+      netmask_ipv6(&((struct sockaddr_in6*)net)->sin6_addr, prefix_len, &want);
+      netmask_ipv6(&((struct sockaddr_in6*)addr)->sin6_addr, prefix_len, &temp);
+      return IN6_ARE_ADDR_EQUAL(&temp, &want);
+    }
+  }
+
+  return false;
+}
+
+
 bool parse_network(const char *s, struct sockaddr_storage *network, unsigned int *prefix_len) {
   char *slash = strchr((char*)s, '/');
   if (!slash) {
@@ -832,6 +832,13 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description(""),
 
+    Option("finisher_pool_threads", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_min(0)
+    .set_description("Number of threads shared by finishers that support pooling")
+    .set_long_description("When non-zero, finishers that opt in (such as the BlueStore and FileStore completion finishers) do not get a thread each but are run by a single work-stealing pool of this many threads per process. Every finisher still completes its contexts in order and one at a time. 0 keeps one thread per finisher.")
+    .add_see_also("bluestore_shard_finishers"),
+
     Option("perf", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
     .set_description(""),
@@ -896,6 +903,16 @@ std::vector<Option> get_global_options() {
     .set_default(100_M)
     .set_description(""),
 
+    Option("ms_direct_dispatch_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_description("Number of threads dispatching messages that are not fast dispatched by the direct messenger")
+    .set_long_description("The direct messenger (ms_type direct, experimental: enable with 'ms-type-direct' in enable_experimental_unrecoverable_data_corrupting_features) hands Message objects to messengers in the same process without encoding them. Fast dispatchable messages are always delivered on the sending thread; other messages are queued for this many dispatch threads. With 0, every message is dispatched on the sending thread, which is only safe when senders hold no locks the receiving dispatcher needs."),
+
+    Option("ms_dispatch_shards", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_description("Number of threads dispatching messages that are not fast dispatched")
+    .set_long_description("Messages and connection events are hashed by connection onto one of this many dispatch queues, each drained by its own thread. Ordering is preserved per connection, but messages from different connections may be delivered concurrently, so values above 1 require the daemon's dispatchers to handle concurrent ms_dispatch calls. The MDS, monitor and manager dispatchers still take one daemon-wide lock for every message, so raising this does not help them yet."),
+
     Option("ms_bind_ipv6", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -998,7 +1015,71 @@ std::vector<Option> get_global_options() {
 
     Option("ms_async_affinity_cores", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
-    .set_description(""),
+    .set_description("Comma separated list of cpus to pin posix messenger workers to"),
+
+    Option("ms_async_send_batch_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Gather queued outgoing messages into a single send of up to this many bytes")
+    .set_long_description("When several messages are waiting on a connection, the async messenger appends them to one buffer and sends it with a single sendmsg call once it reaches this size or the queue is drained, instead of making one call per message. Setting this to 0 sends each message as soon as it is written."),
+
+    Option("ms_async_busy_poll_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Keep polling this many microseconds after the last event before sleeping (0 to disable)")
+    .set_long_description("A messenger worker that has just handled an event keeps polling its sockets and internal queue without blocking for this long, instead of sleeping in the kernel and being woken up for the next request. This trades cpu for lower latency. Combine with ms_async_affinity_cores so spinning workers keep their own cores.")
+    .add_see_also("ms_async_busy_poll_budget")
+    .add_see_also("ms_async_affinity_cores"),
+
+    Option("ms_async_busy_poll_budget", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(50)
+    .set_description("Maximum percentage of each second a worker may spend busy polling without finding work")
+    .add_see_also("ms_async_busy_poll_us"),
+
+    Option("ms_compress_peer_types", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_description("Peer entity types (mon, mds, osd, client, mgr) to send compressed message segments to")
+    .set_long_description("The async messenger compresses the middle and data segments of messages sent to peers of these types, provided the peer advertised support during the connection handshake. Empty disables compression.")
+    .add_see_also("ms_compress_networks")
+    .add_see_also("ms_compression_algorithm"),
+
+    Option("ms_compress_networks", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_description("Only compress traffic to peers in these networks (empty for all)")
+    .set_long_description("Comma separated list of networks, e.g. the subnets of a remote site, in CIDR notation.")
+    .add_see_also("ms_compress_peer_types"),
+
+    Option("ms_compression_algorithm", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("snappy")
+    .set_enum_allowed({"snappy", "zlib", "zstd", "lz4"})
+    .set_description("Compressor plugin used for messenger compression")
+    .add_see_also("ms_compress_peer_types"),
+
+    Option("ms_compress_min_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(8_K)
+    .set_description("Smallest message segment to compress"),
+
+    Option("ms_compress_required_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.875)
+    .set_description("Send a segment uncompressed unless compression shrinks it to this fraction of its size"),
+
+    Option("ms_async_rx_buffer_pool_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64_M)
+    .set_description("Bytes of freed message data buffers to keep for reuse (0 to disable)")
+    .set_long_description("Incoming message data segments are read directly into page aligned buffers. Buffers of at least ms_async_rx_buffer_pool_min_size are recycled through a pool shared by the messenger workers, so large writes don't pay for a fresh aligned allocation and page faults on every message.")
+    .add_see_also("ms_async_rx_buffer_pool_min_size"),
+
+    Option("ms_async_rx_buffer_pool_min_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Smallest message data segment served from the receive buffer pool"),
+
+    Option("ms_async_zerocopy_threshold", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Send buffers at least this large with MSG_ZEROCOPY (0 to disable)")
+    .set_long_description("With the posix stack on Linux, a sendmsg batch that includes a buffer of at least this many bytes is sent with MSG_ZEROCOPY, so the kernel transmits from the message's pages rather than copying them. The buffers stay referenced until the kernel's completion is read from the socket error queue. If the kernel reports that it had to copy anyway, as on loopback, the connection stops using zerocopy. Useful values are 64K and larger."),
+
+    Option("ms_async_zerocopy_linger_ms", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(5000)
+    .set_description("How long the socket of a closed connection stays open for outstanding MSG_ZEROCOPY sends to complete")
+    .set_long_description("A closed socket's error queue can no longer be read, so when a connection closes with zerocopy sends in flight the messenger stops sending on its socket and keeps it open in the background, without blocking the worker, until the kernel reports them complete or this much time has passed. Buffers of sends still outstanding after that are leaked rather than freed, so that their memory is never reused while the kernel may still be transmitting from it."),
 
     Option("ms_async_rdma_device_name", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
@@ -2314,9 +2395,9 @@ std::vector<Option> get_global_options() {
 
     Option("osd_op_queue", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("wpq")
-    .set_enum_allowed( { "wpq", "prioritized", "mclock_opclass", "mclock_client", "debug_random" } )
+    .set_enum_allowed( { "wpq", "prioritized", "drr", "mclock_opclass", "mclock_client", "debug_random" } )
     .set_description("which operation queue algorithm to use")
-    .set_long_description("which operation queue algorithm to use; mclock_opclass and mclock_client are currently experimental")
+    .set_long_description("which operation queue algorithm to use; drr is a deficit round robin queue that shares bandwidth between priorities in proportion to priority and equally between clients at each priority; mclock_opclass and mclock_client are currently experimental")
     .set_flag(Option::FLAG_STARTUP)
     .add_see_also("osd_op_queue_cut_off"),
 
@@ -3402,6 +3483,11 @@ std::vector<Option> get_global_options() {
     .set_default(1)
     .set_description(""),
 
+    Option("memdb_persist", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(true)
+    .set_description("Save memdb contents to disk on close and load them on open")
+    .set_long_description("When false, memdb is purely in-memory: nothing is written on close and an existing store opens empty.  Useful for benchmarking the layers above KeyValueDB."),
+
     Option("kinetic_hmac_key", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("asdfasdf")
     .set_description(""),
@@ -3452,7 +3538,8 @@ std::vector<Option> get_global_options() {
 
     Option("rocksdb_enable_rmrange", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
-    .set_description(""),
+    .set_description("Use DeleteRange for range and prefix removal")
+    .set_long_description("With this disabled, rm_range_keys and rmkeys_by_prefix iterate the range and write a tombstone for every key they find.  Range tombstones make later reads of the range slower, so this is off by default; BlueStore omap removal uses them regardless."),
 
     Option("rocksdb_bloom_bits_per_key", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(20)
@@ -3633,6 +3720,18 @@ std::vector<Option> get_global_options() {
     .set_default(64_K)
     .set_description(""),
 
+    Option("memstore_page_arena", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Allocate memstore_page_set pages from a shared arena")
+    .set_long_description("Pages are carved out of large anonymous mappings instead of being allocated one by one from the heap.  Freed pages are reused, but the mappings are only released at umount.")
+    .add_see_also("memstore_page_arena_hugepages"),
+
+    Option("memstore_page_arena_hugepages", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Back the memstore page arena with 2MB huge pages")
+    .set_long_description("Uses reserved hugetlb pages when available and falls back to transparent huge pages otherwise.")
+    .add_see_also("memstore_page_arena"),
+
     Option("objectstore_blackhole", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -4085,12 +4184,23 @@ std::vector<Option> get_global_options() {
     .set_description("Rocksdb options"),
 
     Option("bluestore_rocksdb_cf", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
-    .set_default(false)
+    .set_default(true)
     .set_description("Enable use of rocksdb column families for bluestore metadata"),
 
     Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_DEV)
-    .set_default("M= P= L=")
-    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options"),
+    .set_default("O=cache_ratio=0.25 M=cache_ratio=0.25 P= L=bloom_bits_per_key=0;write_buffer_size=67108864 b= X=")
+    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options")
+    .set_long_description("CF options are ';'-separated rocksdb column family options.  In addition, cache_ratio=<float> gives the CF a private block cache carved out of the rocksdb block cache budget, and bloom_bits_per_key=<int> overrides rocksdb_bloom_bits_per_key for the CF (0 disables the bloom filter)."),
+
+    Option("bluestore_rocksdb_cf_migrate", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Move keys of an existing db into the column families listed in bluestore_rocksdb_cfs at mount")
+    .set_long_description("Column families are normally only created with a new db.  With this option set, mount creates any missing column family from bluestore_rocksdb_cfs and moves the matching prefix out of the default column family.  The move is done in atomic batches and resumes on the next mount if interrupted."),
+
+    Option("bluestore_compact_on_collection_remove", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Compact the onode key range of a removed collection in the background")
+    .set_long_description("Removing a PG leaves a tombstone for every onode and extent shard it held.  Queueing an async compaction of the collection's key range once the removal commits drops them instead of letting reads skip over them until a regular compaction gets there."),
 
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
@@ -4290,6 +4400,12 @@ std::vector<Option> get_global_options() {
     .set_default(65536)
     .set_description(""),
 
+    Option("kstore_onode_stripe_cache_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(256_K)
+    .set_description("Bytes of committed object data stripes to keep cached per onode")
+    .set_long_description("Stripes written by in-flight transactions are always cached until they commit; after that the onode keeps up to this many bytes of stripes so partial overwrites and reads avoid a kv lookup. Memory use is bounded by this times kstore_onode_map_size per collection.")
+    .add_see_also("kstore_onode_map_size"),
+
     // ---------------------
     // filestore
 
@@ -4378,8 +4494,18 @@ std::vector<Option> get_global_options() {
     .set_description(""),
 
     Option("filestore_omap_header_cache_size", Option::TYPE_INT, Option::LEVEL_DEV)
+    .set_default(8192)
+    .set_description("Number of omap object headers cached, across all shards")
+    .add_see_also("filestore_omap_header_cache_shards"),
+
+    Option("filestore_omap_header_cache_shards", Option::TYPE_INT, Option::LEVEL_DEV)
+    .set_default(8)
+    .set_description("Number of shards for the omap header cache and header locks"),
+
+    Option("filestore_omap_seq_batch", Option::TYPE_UINT, Option::LEVEL_DEV)
     .set_default(1024)
-    .set_description(""),
+    .set_description("Number of omap header seqs reserved per DBObjectMap state write")
+    .set_long_description("New omap headers take their seq from a reservation persisted in the DBObjectMap state, so the state is only rewritten once every this many new headers. Seqs left unused by a restart are skipped."),
 
     Option("filestore_max_inline_xattr_size", Option::TYPE_UINT, Option::LEVEL_DEV)
     .set_default(0)
@@ -4589,6 +4715,12 @@ std::vector<Option> get_global_options() {
     .set_default(20)
     .set_description(""),
 
+    Option("filestore_split_async", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Split collection directories in a background thread")
+    .set_long_description("When a directory crosses the split threshold it is queued for a background thread that moves objects into subdirectories one hash bucket at a time, instead of blocking the write that crossed the threshold for the whole split. A directory that reaches twice the threshold before the background split catches up is split inline.")
+    .add_see_also("filestore_split_multiple"),
+
     Option("filestore_update_to", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(1000)
     .set_description(""),
@@ -4669,6 +4801,11 @@ std::vector<Option> get_global_options() {
     .set_default(100)
     .set_description("Max IOs in flight to journal"),
 
+    Option("journal_aio_adaptive_batch", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Size aio journal writes from the measured device latency")
+    .set_long_description("Keep at least two aios in flight, and beyond that let queued entries accumulate into a single larger write while the bytes already in flight cover the device's bandwidth-delay product.  When disabled, a new aio needs a pending byte count that grows exponentially with the number in flight."),
+
     Option("journal_throttle_low_threshhold", Option::TYPE_FLOAT, Option::LEVEL_DEV)
     .set_default(0.6)
     .set_description(""),
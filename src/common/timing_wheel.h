@@ -0,0 +1,219 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_TIMING_WHEEL_H
+#define CEPH_COMMON_TIMING_WHEEL_H
+
+#include <cstdint>
+#include <limits>
+#include <boost/intrusive/list.hpp>
+
+#include "include/intarith.h"
+
+namespace ceph {
+
+  /// Hook embedded in every event kept by a timing_wheel.  Events unlink
+  /// themselves from whatever slot (or expired batch) they are on when the
+  /// hook is unlinked or destroyed, which is what makes cancellation O(1).
+  typedef boost::intrusive::list_member_hook<
+    boost::intrusive::link_mode<boost::intrusive::auto_unlink> >
+    timing_wheel_hook;
+
+  /**
+   * Hierarchical timing wheel
+   *
+   * Events are bucketed by an integral expiry tick into LEVELS wheels of
+   * SLOTS slots each; level l covers SLOTS^(l+1) ticks.  Anything further
+   * away than the whole wheel sits on an overflow list that is re-bucketed
+   * every time the top level wraps.  Insertion and removal are O(1); advancing
+   * the cursor hands back every due event as one batch, in tick order and
+   * FIFO within a tick.
+   *
+   * The wheel does no locking and knows nothing about clocks: callers map
+   * their time points to ticks (rounding up, so that nothing fires early) and
+   * protect it with their own lock.
+   *
+   * @tparam T event type
+   * @tparam Hook pointer to T's timing_wheel_hook
+   * @tparam Tick pointer to T's expiry tick
+   */
+  template <class T, timing_wheel_hook T::*Hook, uint64_t T::*Tick>
+  class timing_wheel {
+  public:
+    typedef boost::intrusive::list<
+      T,
+      boost::intrusive::member_hook<T, timing_wheel_hook, Hook>,
+      boost::intrusive::constant_time_size<false> > list_type;
+
+    static constexpr uint64_t NONE = std::numeric_limits<uint64_t>::max();
+
+  private:
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+    static constexpr unsigned LEVELS = 5;
+    static constexpr unsigned WHEEL_BITS = SLOT_BITS * LEVELS;
+
+    list_type slots[LEVELS][SLOTS];
+    /// bit s is set if slots[l][s] may be non-empty.  Bits are cleared
+    /// eagerly when a slot is drained and lazily (by next_tick) when the
+    /// last event in a slot was erased.
+    uint64_t occupied[LEVELS];
+    list_type overflow;
+    /// everything before cur has been expired; events that come in late
+    /// are queued at cur.  On every level above 0 the slot holding cur
+    /// has already been cascaded down.
+    uint64_t cur;
+
+    void place(T& e) {
+      uint64_t t = e.*Tick < cur ? cur : e.*Tick;
+      for (unsigned l = 0; l < LEVELS; ++l) {
+	unsigned shift = SLOT_BITS * (l + 1);
+	if ((t >> shift) == (cur >> shift)) {
+	  unsigned s = (t >> (SLOT_BITS * l)) & (SLOTS - 1);
+	  slots[l][s].push_back(e);
+	  occupied[l] |= 1ull << s;
+	  return;
+	}
+      }
+      overflow.push_back(e);
+    }
+
+    void cascade(list_type& from) {
+      list_type batch;
+      batch.splice(batch.end(), from);
+      while (!batch.empty()) {
+	T& e = batch.front();
+	batch.pop_front();
+	place(e);
+      }
+    }
+
+    /// move the cursor forward, cascading every slot it enters
+    void move_to(uint64_t to) {
+      uint64_t old = cur;
+      cur = to;
+      if ((old >> WHEEL_BITS) != (cur >> WHEEL_BITS))
+	cascade(overflow);
+      for (unsigned l = LEVELS - 1; l > 0; --l) {
+	unsigned shift = SLOT_BITS * l;
+	if ((old >> shift) == (cur >> shift))
+	  continue;
+	unsigned s = (cur >> shift) & (SLOTS - 1);
+	occupied[l] &= ~(1ull << s);
+	cascade(slots[l][s]);
+      }
+    }
+
+  public:
+    explicit timing_wheel(uint64_t now) : cur(now) {
+      for (unsigned l = 0; l < LEVELS; ++l)
+	occupied[l] = 0;
+    }
+
+    timing_wheel(const timing_wheel&) = delete;
+    timing_wheel& operator=(const timing_wheel&) = delete;
+
+    /// current cursor; events due before it are queued at it
+    uint64_t get_cur() const {
+      return cur;
+    }
+
+    /// queue e to expire at e.*Tick.  e must not be linked anywhere.
+    void insert(T& e) {
+      place(e);
+    }
+
+    /// remove e from the wheel (or from an expired batch)
+    static void erase(T& e) {
+      (e.*Hook).unlink();
+    }
+
+    /**
+     * Earliest tick at which advance() has work to do
+     *
+     * This is exact when the nearest event is on level 0 and otherwise a
+     * lower bound (the tick at which its slot cascades), so sleeping until
+     * it costs at most one extra wakeup per level.
+     *
+     * @return the tick, or NONE if the wheel is empty
+     */
+    uint64_t next_tick() {
+      for (unsigned l = 0; l < LEVELS; ++l) {
+	unsigned shift = SLOT_BITS * l;
+	unsigned idx = (cur >> shift) & (SLOTS - 1);
+	// higher levels only ever hold slots strictly ahead of the cursor
+	unsigned first = l == 0 ? idx : idx + 1;
+	while (first < SLOTS) {
+	  uint64_t pending = occupied[l] & (~0ull << first);
+	  if (!pending)
+	    break;
+	  unsigned s = ctz(pending);
+	  if (slots[l][s].empty()) {
+	    occupied[l] &= ~(1ull << s);
+	    continue;
+	  }
+	  uint64_t base = (cur >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+	  return base | ((uint64_t)s << shift);
+	}
+      }
+      if (!overflow.empty())
+	return ((cur >> WHEEL_BITS) + 1) << WHEEL_BITS;
+      return NONE;
+    }
+
+    /**
+     * Move the cursor to now even if that is behind it, re-bucketing
+     * every event
+     *
+     * advance() never moves the cursor back, so a caller whose clock can
+     * be stepped backwards uses this when now < get_cur(); otherwise late
+     * events would queue at a cursor the clock won't reach for a while.
+     * O(number of events).
+     */
+    void rebase(uint64_t now) {
+      list_type all;
+      for (unsigned l = 0; l < LEVELS; ++l) {
+	for (unsigned s = 0; s < SLOTS; ++s)
+	  all.splice(all.end(), slots[l][s]);
+	occupied[l] = 0;
+      }
+      all.splice(all.end(), overflow);
+      cur = now;
+      cascade(all);
+    }
+
+    /// move every event due at or before tick to into expired
+    void advance(uint64_t to, list_type& expired) {
+      for (;;) {
+	uint64_t n = next_tick();
+	if (n == NONE || n > to)
+	  break;
+	// n is the nearest slot with anything in it, so the jump can not
+	// skip over pending events
+	move_to(n);
+	unsigned s = cur & (SLOTS - 1);
+	if (slots[0][s].empty())
+	  continue;  // n was a cascade point
+	occupied[0] &= ~(1ull << s);
+	expired.splice(expired.end(), slots[0][s]);
+      }
+      if (to > cur)
+	move_to(to);
+    }
+  };
+
+  template <class T, timing_wheel_hook T::*Hook, uint64_t T::*Tick>
+  constexpr uint64_t timing_wheel<T, Hook, Tick>::NONE;
+
+} // namespace ceph
+
+#endif
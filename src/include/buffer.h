@@ -668,6 +668,12 @@ namespace buffer CEPH_BUFFER_API {
     mutable iterator last_p;
     int zero_copy_to_fd(int fd) const;
 
+    // segment nodes are taken from and given back to a small per-thread
+    // cache of spare nodes, so short-lived lists rarely reach malloc
+    void _push_back_buffer(const ptr& bp);
+    void _push_back_buffer(ptr&& bp);
+    void _release_buffers();
+
   public:
     // cons/des
     list() : _len(0), _memcopy_count(0), last_p(this) {}
@@ -681,6 +687,10 @@ namespace buffer CEPH_BUFFER_API {
       make_shareable();
     }
     list(list&& other);
+    ~list() {
+      if (!_buffers.empty())
+	_release_buffers();
+    }
     list& operator= (const list& other) {
       if (this != &other) {
         _buffers = other._buffers;
@@ -691,7 +701,9 @@ namespace buffer CEPH_BUFFER_API {
     }
 
     list& operator= (list&& other) {
-      _buffers = std::move(other._buffers);
+      if (!_buffers.empty())
+	_release_buffers();
+      _buffers.swap(other._buffers);
       _len = other._len;
       _memcopy_count = other._memcopy_count;
       last_p = begin();
@@ -745,7 +757,8 @@ namespace buffer CEPH_BUFFER_API {
 
     // modifiers
     void clear() {
-      _buffers.clear();
+      if (!_buffers.empty())
+	_release_buffers();
       _len = 0;
       _memcopy_count = 0;
       last_p = begin();
@@ -754,14 +767,14 @@ namespace buffer CEPH_BUFFER_API {
     void push_back(const ptr& bp) {
       if (bp.length() == 0)
 	return;
-      _buffers.push_back(bp);
+      _push_back_buffer(bp);
       _len += bp.length();
     }
     void push_back(ptr&& bp) {
       if (bp.length() == 0)
 	return;
       _len += bp.length();
-      _buffers.push_back(std::move(bp));
+      _push_back_buffer(std::move(bp));
     }
     void push_back(raw *r) {
       push_back(ptr(r));
@@ -11,6 +11,13 @@ const struct ifaddrs *find_ip_in_subnet(const struct ifaddrs *addrs,
 					 const struct sockaddr *net,
 					 unsigned int prefix_len);
 
+/*
+ * Check whether addr is in the network net/prefix_len.
+ */
+bool network_contains(const struct sockaddr *net,
+		      unsigned int prefix_len,
+		      const struct sockaddr *addr);
+
 /*
  * Validate and parse IPv4 or IPv6 network
  *
@@ -120,6 +120,7 @@ struct ceph_msg_connect_reply {
 } __attribute__ ((packed));
 
 #define CEPH_MSG_CONNECT_LOSSY  1  /* messages i send may be safely dropped */
+#define CEPH_MSG_CONNECT_COMPRESS 2  /* i can take compressed message segments */
 
 
 /*
@@ -169,6 +170,12 @@ struct ceph_msg_header {
 #define CEPH_MSG_PRIO_HIGH    196
 #define CEPH_MSG_PRIO_HIGHEST 255
 
+/* header.reserved flags, only sent to peers that set
+ * CEPH_MSG_CONNECT_COMPRESS.  a compressed segment starts with the
+ * compressor type (u8) and the uncompressed length (le32). */
+#define CEPH_MSG_HEADER_MIDDLE_COMPRESSED 1
+#define CEPH_MSG_HEADER_DATA_COMPRESSED   2
+
 /*
  * follows data payload
  * ceph_msg_footer_old does not support digital signatures on messages PLR
@@ -137,6 +137,14 @@ public:
       const string &end        ///< [in] The start bound of remove keys
       ) = 0;
 
+    /// Like rm_range_keys, but always writes one range tombstone where the
+    /// backend supports them.  For large ranges that are rarely read again.
+    virtual void rm_range_keys_bulk(
+      const string &prefix,    ///< [in] Prefix by which to remove keys
+      const string &start,     ///< [in] The start bound of remove keys
+      const string &end        ///< [in] The end bound of remove keys
+      ) { rm_range_keys(prefix, start, end); }
+
     /// Merge value into key
     virtual void merge(
       const std::string &prefix,   ///< [in] Prefix/CF ==> MUST match some established merge operator
@@ -173,6 +181,10 @@ public:
   }
 
   /// Retrieve Keys
+  ///
+  /// Missing keys are simply left out of *out.  Backends that can batch
+  /// lookups (rocksdb MultiGet) do so here, so callers needing several
+  /// keys under one prefix should prefer this over repeated single gets.
   virtual int get(
     const std::string &prefix,               ///< [in] Prefix/CF for key
     const std::set<std::string> &key,        ///< [in] Key to retrieve
@@ -402,6 +414,16 @@ public:
     return;
   }
 
+  /**
+   * Read a single integer-valued backend statistic, e.g. the RocksDB
+   * property "rocksdb.estimate-num-keys" or the ticker
+   * "rocksdb.compact.write.bytes".  Backends without such a statistic
+   * return -EOPNOTSUPP (or -ENOENT for an unknown name).
+   */
+  virtual int get_property(const std::string &property, uint64_t *out) {
+    return -EOPNOTSUPP;
+  }
+
   /**
    * Return your perf counters if you have any.  Subclasses are not
    * required to implement this, and callers must respect a null return
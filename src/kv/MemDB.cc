@@ -51,10 +51,261 @@ static string make_key(const string &prefix, const string &value)
   return out;
 }
 
-void MemDB::_encode(mdb_iter_t iter, bufferlist &bl)
+MemDB::Node *MemDB::Node::create(const std::string &k, int h)
 {
-  encode(iter->first, bl);
-  encode(iter->second, bl);
+  void *mem = ::operator new(sizeof(Node) +
+			     sizeof(std::atomic<Node*>) * (h - 1));
+  Node *n = new (mem) Node(k, h);
+  for (int i = 0; i < h; ++i) {
+    new (&n->next[i]) std::atomic<Node*>(nullptr);
+  }
+  return n;
+}
+
+void MemDB::Node::destroy(Node *n)
+{
+  Version *v = n->versions.load(std::memory_order_relaxed);
+  while (v) {
+    Version *older = v->older.load(std::memory_order_relaxed);
+    delete v;
+    v = older;
+  }
+  n->~Node();
+  ::operator delete(n);
+}
+
+MemDB::MemDB(CephContext *c, const string &path, void *p) :
+  m_head(Node::create(string(), MAX_HEIGHT)),
+  m_max_height(1), m_seq(0), m_epoch(0), m_active{{0}, {0}},
+  m_rnd(0xdeadbeef),
+  m_total_bytes(0), m_allocated_bytes(0),
+  m_cct(c), m_priv(p), m_db_path(path)
+{
+}
+
+int MemDB::random_height()
+{
+  // xorshift32; branching factor of 4 like leveldb's memtable
+  int h = 1;
+  while (h < MAX_HEIGHT) {
+    m_rnd ^= m_rnd << 13;
+    m_rnd ^= m_rnd >> 17;
+    m_rnd ^= m_rnd << 5;
+    if (m_rnd % 4)
+      break;
+    ++h;
+  }
+  return h;
+}
+
+/*
+ * First node with key >= given key, or nullptr.  If prev is given it is
+ * filled with the last node < key at each level (writer only).
+ */
+MemDB::Node *MemDB::find_greater_or_equal(const std::string &key,
+					  Node **prev) const
+{
+  Node *x = m_head;
+  int level = m_max_height.load(std::memory_order_acquire) - 1;
+  while (true) {
+    Node *next = x->next[level].load(std::memory_order_acquire);
+    if (next && next->key < key) {
+      x = next;
+    } else {
+      if (prev)
+	prev[level] = x;
+      if (level == 0)
+	return next;
+      --level;
+    }
+  }
+}
+
+/*
+ * Last node with key < given key, or m_head.
+ */
+MemDB::Node *MemDB::find_less_than(const std::string &key) const
+{
+  Node *x = m_head;
+  int level = m_max_height.load(std::memory_order_acquire) - 1;
+  while (true) {
+    Node *next = x->next[level].load(std::memory_order_acquire);
+    if (next && next->key < key) {
+      x = next;
+    } else {
+      if (level == 0)
+	return x;
+      --level;
+    }
+  }
+}
+
+MemDB::Node *MemDB::find_last() const
+{
+  Node *x = m_head;
+  int level = m_max_height.load(std::memory_order_acquire) - 1;
+  while (true) {
+    Node *next = x->next[level].load(std::memory_order_acquire);
+    if (next) {
+      x = next;
+    } else {
+      if (level == 0)
+	return x;
+      --level;
+    }
+  }
+}
+
+/*
+ * Newest version of n written at or before seq, or nullptr.
+ */
+MemDB::Version *MemDB::visible(Node *n, uint64_t seq)
+{
+  Version *v = n->versions.load(std::memory_order_acquire);
+  while (v && v->seq > seq) {
+    v = v->older.load(std::memory_order_acquire);
+  }
+  return v;
+}
+
+/*
+ * Writer only.  The new version is tagged with the sequence of the
+ * transaction being applied and stays invisible until it is committed.
+ */
+void MemDB::_put(const std::string &key, bool deleted, const bufferptr &value)
+{
+  uint64_t seq = m_seq.load(std::memory_order_relaxed) + 1;
+  Node *prev[MAX_HEIGHT];
+  Node *n = find_greater_or_equal(key, prev);
+  if (n && n->key == key) {
+    Version *old = n->versions.load(std::memory_order_relaxed);
+    n->versions.store(new Version(seq, deleted, value, old),
+		      std::memory_order_release);
+    if (!n->dirty) {
+      n->dirty = true;
+      m_dirty.push_back(n);
+    }
+    return;
+  }
+  if (deleted) {
+    return;
+  }
+
+  int h = random_height();
+  int max_height = m_max_height.load(std::memory_order_relaxed);
+  if (h > max_height) {
+    for (int i = max_height; i < h; ++i) {
+      prev[i] = m_head;
+    }
+    // readers seeing the new height before the node is linked just find
+    // nullptr at the new levels of m_head, which is fine
+    m_max_height.store(h, std::memory_order_relaxed);
+  }
+  n = Node::create(key, h);
+  n->versions.store(new Version(seq, false, value, nullptr),
+		    std::memory_order_relaxed);
+  for (int i = 0; i < h; ++i) {
+    n->next[i].store(prev[i]->next[i].load(std::memory_order_relaxed),
+		     std::memory_order_relaxed);
+    prev[i]->next[i].store(n, std::memory_order_release);
+  }
+}
+
+/*
+ * Writer only.  Drop the versions of n that nobody reading at seq or
+ * later can see; if what is left is a lone delete, unlink the node.
+ */
+void MemDB::_trim(Node *n, uint64_t seq)
+{
+  Version *head = n->versions.load(std::memory_order_relaxed);
+  Version *v = head;
+  while (v->seq > seq) {
+    v = v->older.load(std::memory_order_relaxed);
+  }
+  Version *old = v->older.exchange(nullptr);
+  while (old) {
+    Version *older = old->older.load(std::memory_order_relaxed);
+    delete old;
+    old = older;
+  }
+  if (v != head) {
+    // written again since; look at it once more next epoch
+    m_dirty.push_back(n);
+    return;
+  }
+  if (v->deleted) {
+    Node *prev[MAX_HEIGHT];
+    Node *found = find_greater_or_equal(n->key, prev);
+    assert(found == n);
+    for (int i = n->height - 1; i >= 0; --i) {
+      assert(prev[i]->next[i].load(std::memory_order_relaxed) == n);
+      prev[i]->next[i].store(n->next[i].load(std::memory_order_relaxed),
+			     std::memory_order_release);
+    }
+    m_retired.push_back(n);
+    return;
+  }
+  n->dirty = false;
+}
+
+/*
+ * Writer only, after a commit.
+ *
+ * Closing an epoch moves what was retired during it to m_prev_* and
+ * flips m_epoch.  Anyone registering after the flip also sees the
+ * commits (and unlinks) made before it, so once the closed epoch's
+ * slot drains, every reader left has pinned at least m_prev_seq: nodes
+ * unlinked in that epoch are unreachable and only the newest version
+ * at or below m_prev_seq is still needed.  The slot has to drain before
+ * the next flip, since it is reused by the epoch after that.
+ */
+void MemDB::_reclaim()
+{
+  uint64_t e = m_epoch.load(std::memory_order_relaxed);
+  if (!m_prev_dirty.empty() || !m_prev_retired.empty()) {
+    if (m_active[(e - 1) & 1].load() != 0) {
+      return;
+    }
+    for (auto n : m_prev_retired) {
+      Node::destroy(n);
+    }
+    m_prev_retired.clear();
+    for (auto n : m_prev_dirty) {
+      _trim(n, m_prev_seq);
+    }
+    m_prev_dirty.clear();
+  }
+  if (m_dirty.empty() && m_retired.empty()) {
+    return;
+  }
+  m_prev_dirty.swap(m_dirty);
+  m_prev_retired.swap(m_retired);
+  m_prev_seq = m_seq.load(std::memory_order_relaxed);
+  m_epoch.store(e + 1);
+}
+
+void MemDB::_clear()
+{
+  Node *n = m_head->next[0].load(std::memory_order_relaxed);
+  while (n) {
+    Node *next = n->next[0].load(std::memory_order_relaxed);
+    Node::destroy(n);
+    n = next;
+  }
+  for (auto n : m_retired) {
+    Node::destroy(n);
+  }
+  for (auto n : m_prev_retired) {
+    Node::destroy(n);
+  }
+  m_retired.clear();
+  m_prev_retired.clear();
+  m_dirty.clear();
+  m_prev_dirty.clear();
+  for (int i = 0; i < MAX_HEIGHT; ++i) {
+    m_head->next[i].store(nullptr, std::memory_order_relaxed);
+  }
+  m_max_height = 1;
 }
 
 std::string MemDB::_get_data_fn()
@@ -65,7 +316,7 @@ std::string MemDB::_get_data_fn()
 
 void MemDB::_save()
 {
-  std::lock_guard<std::mutex> l(m_lock);
+  std::lock_guard<std::mutex> l(m_write_lock);
   dout(10) << __func__ << " Saving MemDB to file: "<< _get_data_fn().c_str() << dendl;
   int mode = 0644;
   int fd = TEMP_FAILURE_RETRY(::open(_get_data_fn().c_str(),
@@ -77,11 +328,15 @@ void MemDB::_save()
     return;
   }
   bufferlist bl;
-  mdb_iter_t iter = m_map.begin();
-  while (iter != m_map.end()) {
-    dout(10) << __func__ << " Key:"<< iter->first << dendl;
-    _encode(iter, bl);
-    ++iter;
+  for (Node *n = m_head->next[0].load(std::memory_order_relaxed);
+       n;
+       n = n->next[0].load(std::memory_order_relaxed)) {
+    Version *v = n->versions.load(std::memory_order_relaxed);
+    if (v->deleted)
+      continue;
+    dout(10) << __func__ << " Key:"<< n->key << dendl;
+    encode(n->key, bl);
+    encode(v->value, bl);
   }
   bl.write_fd(fd);
 
@@ -90,7 +345,7 @@ void MemDB::_save()
 
 int MemDB::_load()
 {
-  std::lock_guard<std::mutex> l(m_lock);
+  std::lock_guard<std::mutex> l(m_write_lock);
   dout(10) << __func__ << " Reading MemDB from file: "<< _get_data_fn().c_str() << dendl;
   /*
    * Open file and read it in single shot.
@@ -123,9 +378,11 @@ int MemDB::_load()
     bytes_done += ::decode_file(fd, datap);
 
     dout(10) << __func__ << " Key:"<< key << dendl;
-    m_map[key] = datap;
+    _put(key, false, datap);
     m_total_bytes += datap.length();
   }
+  m_seq++;
+  _reclaim();
   VOID_TEMP_FAILURE_RETRY(::close(fd));
   return 0;
 }
@@ -144,8 +401,10 @@ int MemDB::_init(bool create)
       }
       return 0; // ignore EEXIST
     }
-  } else {
+  } else if (m_cct->_conf->get_val<bool>("memdb_persist")) {
     r = _load();
+  } else {
+    r = 0;
   }
 
   return r;
@@ -185,14 +444,19 @@ MemDB::~MemDB()
 {
   close();
   dout(10) << __func__ << " Destroying MemDB instance: "<< dendl;
+  assert(m_active[0] == 0 && m_active[1] == 0);
+  _clear();
+  Node::destroy(m_head);
 }
 
 void MemDB::close()
 {
   /*
-   * Save whatever in memory btree.
+   * Save whatever is in memory.
    */
-  _save();
+  if (m_cct->_conf->get_val<bool>("memdb_persist")) {
+    _save();
+  }
 }
 
 int MemDB::submit_transaction(KeyValueDB::Transaction t)
@@ -200,6 +464,7 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
   MDBTransactionImpl* mt =  static_cast<MDBTransactionImpl*>(t.get());
 
   dtrace << __func__ << " " << mt->get_ops().size() << dendl;
+  std::lock_guard<std::mutex> l(m_write_lock);
   for(auto& op : mt->get_ops()) {
     if(op.first == MDBTransactionImpl::WRITE) {
       ms_op_t set_op = op.second;
@@ -213,6 +478,10 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
       _rmkey(rm_op);
     }
   }
+  // make the whole transaction visible at once
+  m_seq.store(m_seq.load(std::memory_order_relaxed) + 1,
+	      std::memory_order_release);
+  _reclaim();
 
   return 0;
 }
@@ -280,42 +549,33 @@ void MemDB::MDBTransactionImpl::merge(
 
 int MemDB::_setkey(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
 
   m_total_bytes += bl.length();
 
   bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    /*
-     * delete and free existing key.
-     */
+  if (_get_latest(key, &bl_old)) {
     assert(m_total_bytes >= bl_old.length());
     m_total_bytes -= bl_old.length();
-    m_map.erase(key);
   }
 
-  m_map[key] = bufferptr((char *) bl.c_str(), bl.length());
-  iterator_seq_no++;
+  _put(key, false, bufferptr((char *) bl.c_str(), bl.length()));
   return 0;
 }
 
 int MemDB::_rmkey(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
 
   bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
+  if (!_get_latest(key, &bl_old)) {
+    return 0;
   }
-  iterator_seq_no++;
-  /*
-   * Erase will call the destructor for bufferptr.
-   */
-  return m_map.erase(key);
+  assert(m_total_bytes >= bl_old.length());
+  m_total_bytes -= bl_old.length();
+  _put(key, true, bufferptr());
+  return 1;
 }
 
 std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::string &prefix)
@@ -333,7 +593,6 @@ std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::stri
 
 int MemDB::_merge(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string prefix = op.first.first;
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
@@ -349,57 +608,68 @@ int MemDB::_merge(ms_op_t &op)
    * call the merge operator with value and non value
    */
   bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old) == false) {
-    std::string new_val;
+  std::string new_val;
+  if (_get_latest(key, &bl_old) == false) {
     /*
      * Merge non existent.
      */
     mop->merge_nonexistent(bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
   } else {
     /*
      * Merge existing.
      */
-    std::string new_val;
     mop->merge(bl_old.c_str(), bl_old.length(), bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
     bytes_adjusted -= bl_old.length();
     bl_old.clear();
   }
+  _put(key, false, bufferptr(new_val.c_str(), new_val.length()));
 
   assert((int64_t)m_total_bytes + bytes_adjusted >= 0);
   m_total_bytes += bytes_adjusted;
-  iterator_seq_no++;
   return 0;
 }
 
 /*
- * Caller take btree lock.
+ * Writer only: newest value, including ones from the transaction being
+ * applied.
  */
-bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
+bool MemDB::_get_latest(const string &key, bufferlist *out)
 {
-  string key = make_key(prefix, k);
-
-  mdb_iter_t iter = m_map.find(key);
-  if (iter == m_map.end()) {
+  Node *n = find_greater_or_equal(key, nullptr);
+  if (!n || n->key != key) {
     return false;
   }
-
-  out->push_back((m_map[key].clone()));
+  Version *v = n->versions.load(std::memory_order_relaxed);
+  if (v->deleted) {
+    return false;
+  }
+  out->push_back(v->value);
   return true;
 }
 
-bool MemDB::_get_locked(const string &prefix, const string &k, bufferlist *out)
+/*
+ * Caller holds a ReadGuard.
+ */
+bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
 {
-  std::lock_guard<std::mutex> l(m_lock);
-  return _get(prefix, k, out);
+  string key = make_key(prefix, k);
+  Node *n = find_greater_or_equal(key, nullptr);
+  if (!n || n->key != key) {
+    return false;
+  }
+  Version *v = visible(n, m_seq.load(std::memory_order_acquire));
+  if (!v || v->deleted) {
+    return false;
+  }
+  out->push_back(v->value.clone());
+  return true;
 }
 
-
 int MemDB::get(const string &prefix, const std::string& key,
                  bufferlist *out)
 {
-  if (_get_locked(prefix, key, out)) {
+  ReadGuard g(this);
+  if (_get(prefix, key, out)) {
     return 0;
   }
   return -ENOENT;
@@ -408,202 +678,159 @@ int MemDB::get(const string &prefix, const std::string& key,
 int MemDB::get(const string &prefix, const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
+  ReadGuard g(this);
   for (const auto& i : keys) {
     bufferlist bl;
-    if (_get_locked(prefix, i, &bl))
+    if (_get(prefix, i, &bl))
       out->insert(make_pair(i, bl));
   }
 
   return 0;
 }
 
-void MemDB::MDBWholeSpaceIteratorImpl::fill_current()
-{
-  bufferlist bl;
-  bl.append(m_iter->second.clone());
-  m_key_value = std::make_pair(m_iter->first, bl);
-}
-
-bool MemDB::MDBWholeSpaceIteratorImpl::valid()
+void MemDB::MDBWholeSpaceIteratorImpl::skip_forward()
 {
-  if (m_key_value.first.empty()) {
-    return false;
+  for (; m_node; m_node = m_node->next[0].load(std::memory_order_acquire)) {
+    m_version = visible(m_node, m_snap);
+    if (m_version && !m_version->deleted) {
+      return;
+    }
   }
-  return true;
+  m_version = nullptr;
 }
 
-bool MemDB::MDBWholeSpaceIteratorImpl::iterator_validate() {
-
-  if (this_seq_no != *global_seq_no) {
-    auto key = m_key_value.first;
-    assert(!key.empty());
-
-    bool restart_iter = false;
-    if (!m_using_btree) {
-      /*
-       * Map is modified and marker key does not exists, 
-       * restart the iterator from next key.
-       */
-      if (m_map_p->find(key) == m_map_p->end()) {
-        restart_iter = true;
-      }
-    } else {
-      restart_iter = true;
-    }
-
-    if (restart_iter) {
-      m_iter = m_map_p->lower_bound(key);
-      if (m_iter == m_map_p->end()) {
-        return false;
-      }
+void MemDB::MDBWholeSpaceIteratorImpl::skip_backward()
+{
+  while (m_node && m_node != m_db->m_head) {
+    m_version = visible(m_node, m_snap);
+    if (m_version && !m_version->deleted) {
+      return;
     }
-
-    /*
-     * This iter is valid now.
-     */
-    this_seq_no = *global_seq_no;
+    m_node = m_db->find_less_than(m_node->key);
   }
-
-  return true;
+  m_node = nullptr;
+  m_version = nullptr;
 }
 
-void
-MemDB::MDBWholeSpaceIteratorImpl::free_last()
+bool MemDB::MDBWholeSpaceIteratorImpl::valid()
 {
-  m_key_value.first.clear();
-  m_key_value.second.clear();
+  return m_node != nullptr;
 }
 
 string MemDB::MDBWholeSpaceIteratorImpl::key()
 {
-  dtrace << __func__ << " " << m_key_value.first << dendl;
+  dtrace << __func__ << " " << m_node->key << dendl;
   string prefix, key;
-  split_key(m_key_value.first, &prefix, &key);
+  split_key(m_node->key, &prefix, &key);
   return key;
 }
 
 pair<string,string> MemDB::MDBWholeSpaceIteratorImpl::raw_key()
 {
   string prefix, key;
-  split_key(m_key_value.first, &prefix, &key);
+  split_key(m_node->key, &prefix, &key);
   return make_pair(prefix, key);
 }
 
 bool MemDB::MDBWholeSpaceIteratorImpl::raw_key_is_prefixed(
     const string &prefix)
 {
-  string p, k;
-  split_key(m_key_value.first, &p, &k);
-  return (p == prefix);
+  const string &k = m_node->key;
+  return k.length() > prefix.length() &&
+    k[prefix.length()] == KEY_DELIM &&
+    k.compare(0, prefix.length(), prefix) == 0;
 }
 
 bufferlist MemDB::MDBWholeSpaceIteratorImpl::value()
 {
-  dtrace << __func__ << " " << m_key_value << dendl;
-  return m_key_value.second;
+  bufferlist bl;
+  bl.append(m_version->value.clone());
+  return bl;
+}
+
+bufferptr MemDB::MDBWholeSpaceIteratorImpl::value_as_ptr()
+{
+  return m_version->value.clone();
+}
+
+size_t MemDB::MDBWholeSpaceIteratorImpl::key_size()
+{
+  return m_node->key.length();
+}
+
+size_t MemDB::MDBWholeSpaceIteratorImpl::value_size()
+{
+  return m_version->value.length();
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::next()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
-    return -1;
-  }
-  free_last();
-  ++m_iter;
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  } else {
+  if (!m_node) {
     return -1;
   }
+  m_node = m_node->next[0].load(std::memory_order_acquire);
+  skip_forward();
+  return m_node ? 0 : -1;
 }
 
-int MemDB::MDBWholeSpaceIteratorImpl:: prev()
+int MemDB::MDBWholeSpaceIteratorImpl::prev()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
-    return -1;
-  }
-  free_last();
-  if (m_iter != m_map_p->begin()) {
-    --m_iter;
-    fill_current();
-    return 0;
-  } else {
+  if (!m_node) {
     return -1;
   }
+  m_node = m_db->find_less_than(m_node->key);
+  skip_backward();
+  return m_node ? 0 : -1;
 }
 
 /*
- * First key >= to given key, if key is null then first key in btree.
+ * First key >= to given key, if key is null then first key in the list.
  */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_first(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  free_last();
   if (k.empty()) {
-    m_iter = m_map_p->begin();
+    m_node = m_db->m_head->next[0].load(std::memory_order_acquire);
   } else {
-    m_iter = m_map_p->lower_bound(k);
-  }
-  
-  if (m_iter == m_map_p->end()) {
-    return -1;
+    m_node = m_db->find_greater_or_equal(k, nullptr);
   }
-  fill_current();
-  return 0;
+  skip_forward();
+  return m_node ? 0 : -1;
 }
 
+/*
+ * Last key with the given prefix, if prefix is null then last key in
+ * the list.
+ */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_last(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  free_last();
   if (k.empty()) {
-    m_iter = m_map_p->end();
-    --m_iter;
+    m_node = m_db->find_last();
   } else {
-    m_iter = m_map_p->lower_bound(k);
-  }
-
-  if (m_iter == m_map_p->end()) {
-    return -1;
+    string limit = k;
+    limit.push_back(KEY_DELIM + 1);
+    m_node = m_db->find_less_than(limit);
   }
-  fill_current();
-  return 0;
-}
-
-MemDB::MDBWholeSpaceIteratorImpl::~MDBWholeSpaceIteratorImpl()
-{
-  free_last();
+  skip_backward();
+  return m_node ? 0 : -1;
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::upper_bound(const std::string &prefix,
     const std::string &after) {
-
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-
   dtrace << "upper_bound " << prefix.c_str() << after.c_str() << dendl;
   string k = make_key(prefix, after);
-  m_iter = m_map_p->upper_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
+  m_node = m_db->find_greater_or_equal(k, nullptr);
+  if (m_node && m_node->key == k) {
+    m_node = m_node->next[0].load(std::memory_order_acquire);
   }
-  return -1;
+  skip_forward();
+  return m_node ? 0 : -1;
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::lower_bound(const std::string &prefix,
     const std::string &to) {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
   dtrace << "lower_bound " << prefix.c_str() << to.c_str() << dendl;
   string k = make_key(prefix, to);
-  m_iter = m_map_p->lower_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  }
-  return -1;
+  m_node = m_db->find_greater_or_equal(k, nullptr);
+  skip_forward();
+  return m_node ? 0 : -1;
 }
@@ -14,10 +14,12 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include "include/memory.h"
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
-#include "include/btree_map.h"
 #include "KeyValueDB.h"
 #include "osd/osd_types.h"
 
@@ -27,40 +29,112 @@ using std::string;
 class MemDB : public KeyValueDB
 {
   typedef std::pair<std::pair<std::string, std::string>, bufferlist> ms_op_t;
-  std::mutex m_lock;
-  uint64_t m_total_bytes;
-  uint64_t m_allocated_bytes;
 
-  typedef std::map<std::string, bufferptr> mdb_map_t;
-  typedef mdb_map_t::iterator mdb_iter_t;
-  bool m_using_btree;
+  /*
+   * The store is a concurrent skiplist.  Readers never take a lock:
+   * nodes are published with release stores and every value is kept as
+   * a chain of versions tagged with the sequence number of the
+   * transaction that wrote it.  A reader pins the committed sequence
+   * when it starts and only looks at versions at or below it, which
+   * also gives iterators a stable snapshot.
+   *
+   * A single writer (m_write_lock) applies a whole transaction and then
+   * publishes it by bumping m_seq.  Superseded versions and deleted
+   * nodes are reclaimed by the writer with a two-slot epoch scheme: each
+   * reader registers in the slot of the current epoch, and whatever the
+   * writer retired during an epoch is freed once the epoch has been
+   * closed and its readers have drained (see _reclaim()).
+   */
+  static const int MAX_HEIGHT = 12;
+
+  struct Version {
+    uint64_t seq;
+    bool deleted;
+    bufferptr value;
+    std::atomic<Version*> older;
+    Version(uint64_t s, bool d, const bufferptr &v, Version *o)
+      : seq(s), deleted(d), value(v), older(o) {}
+  };
 
-  mdb_map_t m_map;
+  struct Node {
+    const std::string key;
+    std::atomic<Version*> versions;
+    bool dirty = false;         ///< writer only: queued for _reclaim()
+    const int height;
+    std::atomic<Node*> next[1]; ///< really next[height]
+
+    Node(const std::string &k, int h)
+      : key(k), versions(nullptr), height(h) {}
+    static Node *create(const std::string &k, int h);
+    static void destroy(Node *n);
+  };
+
+  /// registers a reader in the current epoch for its lifetime
+  class ReadGuard {
+    MemDB *db;
+    unsigned slot;
+  public:
+    explicit ReadGuard(MemDB *d) : db(d) {
+      while (true) {
+	uint64_t e = db->m_epoch.load();
+	slot = e & 1;
+	db->m_active[slot]++;
+	if (db->m_epoch.load() == e)
+	  break;
+	// raced with the writer closing the epoch; try again
+	db->m_active[slot]--;
+      }
+    }
+    ~ReadGuard() {
+      db->m_active[slot]--;
+    }
+  };
+
+  Node *m_head;
+  std::atomic<int> m_max_height;
+  std::atomic<uint64_t> m_seq;      ///< last committed transaction
+  std::atomic<uint64_t> m_epoch;
+  std::atomic<int64_t> m_active[2]; ///< readers registered per epoch slot
+  std::mutex m_write_lock;          ///< single writer
+
+  // writer only
+  uint32_t m_rnd;                   ///< for node heights
+  std::vector<Node*> m_dirty;       ///< nodes with old versions, this epoch
+  std::vector<Node*> m_retired;     ///< nodes unlinked this epoch
+  std::vector<Node*> m_prev_dirty;  ///< same, for the closed epoch
+  std::vector<Node*> m_prev_retired;
+  uint64_t m_prev_seq = 0;          ///< m_seq when the last epoch closed
+
+  std::atomic<uint64_t> m_total_bytes;
+  uint64_t m_allocated_bytes;
 
   CephContext *m_cct;
   void* m_priv;
   string m_options;
   string m_db_path;
 
+  int random_height();
+  Node *find_greater_or_equal(const std::string &key, Node **prev) const;
+  Node *find_less_than(const std::string &key) const;
+  Node *find_last() const;
+  static Version *visible(Node *n, uint64_t seq);
+
+  void _put(const std::string &key, bool deleted, const bufferptr &value);
+  void _trim(Node *n, uint64_t seq);
+  void _reclaim();
+  void _clear();
+
   int transaction_rollback(KeyValueDB::Transaction t);
   int _open(ostream &out);
   void close() override;
   bool _get(const string &prefix, const string &k, bufferlist *out);
-  bool _get_locked(const string &prefix, const string &k, bufferlist *out);
+  bool _get_latest(const string &key, bufferlist *out);
   std::string _get_data_fn();
-  void _encode(mdb_iter_t iter, bufferlist &bl);
   void _save();
   int _load();
-  uint64_t iterator_seq_no;
 
 public:
-  MemDB(CephContext *c, const string &path, void *p) :
-    m_total_bytes(0), m_allocated_bytes(0), m_using_btree(false),
-    m_cct(c), m_priv(p), m_db_path(path), iterator_seq_no(1)
-  {
-    //Nothing as of now
-  }
-
+  MemDB(CephContext *c, const string &path, void *p);
   ~MemDB() override;
   int set_merge_operator(const std::string& prefix,
          std::shared_ptr<MergeOperator> mop) override;
@@ -108,9 +182,8 @@ public:
 private:
 
   /*
-   * Transaction states.
+   * Transaction states.  Called by the writer only.
    */
-  int _merge(const std::string &k, bufferptr &bl);
   int _merge(ms_op_t &op);
   int _setkey(ms_op_t &op);
   int _rmkey(ms_op_t &op);
@@ -140,30 +213,25 @@ public:
 
   using KeyValueDB::get;
 
+  /*
+   * Iterates over the snapshot taken at creation time.  The iterator
+   * stays registered as a reader for its whole lifetime, so nothing it
+   * may still be positioned on is reclaimed; long-lived iterators hold
+   * back reclaim much like a rocksdb snapshot does.
+   */
   class MDBWholeSpaceIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
+    MemDB *m_db;
+    ReadGuard m_guard;
+    uint64_t m_snap;
+    Node *m_node = nullptr;
+    Version *m_version = nullptr;
 
-      mdb_iter_t m_iter;
-      std::pair<string, bufferlist> m_key_value;
-      mdb_map_t *m_map_p;
-      std::mutex *m_map_lock_p;
-      uint64_t *global_seq_no;
-      uint64_t this_seq_no;
-      bool m_using_btree;
+    void skip_forward();
+    void skip_backward();
 
   public:
-    MDBWholeSpaceIteratorImpl(mdb_map_t *btree_p, std::mutex *btree_lock_p,
-                              uint64_t *iterator_seq_no, bool using_btree) {
-      m_map_p = btree_p;
-      m_map_lock_p = btree_lock_p;
-      std::lock_guard<std::mutex> l(*m_map_lock_p);
-      global_seq_no = iterator_seq_no;
-      this_seq_no = *iterator_seq_no;
-      m_using_btree = using_btree;
-    }
-
-    void fill_current();
-    void free_last();
-
+    explicit MDBWholeSpaceIteratorImpl(MemDB *db)
+      : m_db(db), m_guard(db), m_snap(db->m_seq.load()) {}
 
     int seek_to_first(const std::string &k) override;
     int seek_to_last(const std::string &k) override;
@@ -174,7 +242,6 @@ public:
     int upper_bound(const std::string &prefix, const std::string &after) override;
     int lower_bound(const std::string &prefix, const std::string &to) override;
     bool valid() override;
-    bool iterator_validate();
 
     int next() override;
     int prev() override;
@@ -184,16 +251,17 @@ public:
     std::pair<std::string,std::string> raw_key() override;
     bool raw_key_is_prefixed(const std::string &prefix) override;
     bufferlist value() override;
-    ~MDBWholeSpaceIteratorImpl() override;
+    bufferptr value_as_ptr() override;
+    size_t key_size() override;
+    size_t value_size() override;
+    ~MDBWholeSpaceIteratorImpl() override {}
   };
 
   uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) override {
-      std::lock_guard<std::mutex> l(m_lock);
       return m_allocated_bytes;
   };
 
   int get_statfs(struct store_statfs_t *buf) override {
-    std::lock_guard<std::mutex> l(m_lock);
     buf->reset();
     buf->total = m_total_bytes;
     buf->allocated = m_allocated_bytes;
@@ -203,7 +271,7 @@ public:
 
   WholeSpaceIterator get_wholespace_iterator() override {
     return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
-      new MDBWholeSpaceIteratorImpl(&m_map, &m_lock, &iterator_seq_no, m_using_btree));
+      new MDBWholeSpaceIteratorImpl(this));
   }
 };
 
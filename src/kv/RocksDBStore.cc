@@ -24,6 +24,7 @@ using std::string;
 #include "include/str_list.h"
 #include "include/stringify.h"
 #include "include/str_map.h"
+#include "common/strtol.h"
 #include "KeyValueDB.h"
 #include "RocksDBStore.h"
 
@@ -309,6 +310,177 @@ int RocksDBStore::install_cf_mergeop(
   return 0;
 }
 
+// Column family option strings are ';'-separated.  Most items are handed
+// straight to rocksdb, but a few are interpreted here because they need
+// to share state with the rest of the store:
+//
+//   cache_ratio=<f>         give this CF a private block cache of f times
+//                           the block cache budget (carved out of the
+//                           shared cache, not added to it)
+//   bloom_bits_per_key=<n>  per-CF bloom filter; 0 disables it
+//
+int RocksDBStore::apply_cf_options(
+  const string &cf_name,
+  const string &option_str,
+  rocksdb::ColumnFamilyOptions *cf_opt,
+  uint64_t *cf_cache_size)
+{
+  assert(cf_opt != nullptr);
+  // split on ';', but leave nested "{...}" option groups alone
+  vector<string> items;
+  string item;
+  int depth = 0;
+  for (char c : option_str) {
+    if (c == '{') {
+      depth++;
+    } else if (c == '}') {
+      depth--;
+    } else if (c == ';' && depth == 0) {
+      items.push_back(item);
+      item.clear();
+      continue;
+    }
+    item.push_back(c);
+  }
+  if (!item.empty()) {
+    items.push_back(item);
+  }
+
+  rocksdb::BlockBasedTableOptions cf_bbt_opts = bbt_opts;
+  bool own_table = false;
+  string rocks_opts;
+  for (auto& i : items) {
+    size_t pos = i.find('=');
+    string key = i.substr(0, pos);
+    string val = pos == string::npos ? string() : i.substr(pos + 1);
+    string err;
+    if (key == "cache_ratio") {
+      double ratio = strict_strtod(val.c_str(), &err);
+      if (!err.empty() || ratio < 0 || ratio >= 1.0) {
+	derr << __func__ << " invalid cache_ratio '" << val << "' for CF '"
+	     << cf_name << "'" << dendl;
+	return -EINVAL;
+      }
+      if (bbt_opts.no_block_cache || ratio == 0) {
+	continue;
+      }
+      uint64_t size = block_cache_size * ratio;
+      cf_bbt_opts.block_cache = rocksdb::NewLRUCache(
+	size, g_conf->rocksdb_cache_shard_bits);
+      *cf_cache_size += size;
+      own_table = true;
+      dout(10) << __func__ << " CF '" << cf_name << "' block_cache size "
+	       << byte_u_t(size) << dendl;
+    } else if (key == "bloom_bits_per_key") {
+      long long bits = strict_strtoll(val.c_str(), 10, &err);
+      if (!err.empty() || bits < 0) {
+	derr << __func__ << " invalid bloom_bits_per_key '" << val
+	     << "' for CF '" << cf_name << "'" << dendl;
+	return -EINVAL;
+      }
+      if (bits > 0) {
+	cf_bbt_opts.filter_policy.reset(rocksdb::NewBloomFilterPolicy(bits));
+      } else {
+	cf_bbt_opts.filter_policy.reset();
+      }
+      own_table = true;
+    } else {
+      if (!rocks_opts.empty()) {
+	rocks_opts += ';';
+      }
+      rocks_opts += i;
+    }
+  }
+  if (own_table) {
+    cf_opt->table_factory.reset(rocksdb::NewBlockBasedTableFactory(cf_bbt_opts));
+  }
+  rocksdb::Status status = rocksdb::GetColumnFamilyOptionsFromString(
+    *cf_opt, rocks_opts, cf_opt);
+  if (!status.ok()) {
+    derr << __func__ << " invalid db column family options for CF '"
+	 << cf_name << "': " << option_str << dendl;
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int RocksDBStore::create_cf(
+  const rocksdb::Options &opt,
+  const ColumnFamily &p,
+  uint64_t *cf_cache_size)
+{
+  // copy default CF settings, block cache, merge operators as
+  // the base for new CF
+  rocksdb::ColumnFamilyOptions cf_opt(opt);
+  // user input options will override the base options
+  int r = apply_cf_options(p.name, p.option, &cf_opt, cf_cache_size);
+  if (r < 0) {
+    return r;
+  }
+  install_cf_mergeop(p.name, &cf_opt);
+  rocksdb::ColumnFamilyHandle *cf;
+  rocksdb::Status status = db->CreateColumnFamily(cf_opt, p.name, &cf);
+  if (!status.ok()) {
+    derr << __func__ << " Failed to create rocksdb column family: "
+	 << p.name << dendl;
+    return -EINVAL;
+  }
+  // store the new CF handle
+  add_column_family(p.name, static_cast<void*>(cf));
+  return 0;
+}
+
+// Move any keys still stored as "prefix\0key" in the default CF into the
+// dedicated CF for that prefix.  Each batch copies and deletes atomically,
+// so an interrupted migration is simply picked up again on the next open.
+int RocksDBStore::migrate_to_cf(
+  const string &prefix,
+  rocksdb::ColumnFamilyHandle *cf)
+{
+  const unsigned max_batch_keys = 4096;
+  string start = combine_strings(prefix, string());
+  string end = past_prefix(prefix);
+  rocksdb::Slice upper(end);
+  rocksdb::ReadOptions ropts;
+  ropts.iterate_upper_bound = &upper;
+  std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(ropts, default_cf));
+  it->Seek(start);
+  if (!it->Valid()) {
+    return it->status().ok() ? 0 : -EIO;
+  }
+
+  dout(1) << __func__ << " moving keys with prefix '" << prefix
+	  << "' into column family" << dendl;
+  uint64_t moved = 0;
+  while (it->Valid()) {
+    rocksdb::WriteBatch bat;
+    for (unsigned n = 0; it->Valid() && n < max_batch_keys; ++n, it->Next()) {
+      rocksdb::Slice k = it->key();
+      bat.Delete(default_cf, k);
+      k.remove_prefix(prefix.length() + 1);
+      bat.Put(cf, k, it->value());
+    }
+    rocksdb::Status status = db->Write(rocksdb::WriteOptions(), &bat);
+    if (!status.ok()) {
+      derr << __func__ << " failed to migrate prefix '" << prefix << "': "
+	   << status.ToString() << dendl;
+      return -EIO;
+    }
+    moved += bat.Count() / 2;
+  }
+  if (!it->status().ok()) {
+    derr << __func__ << " error iterating prefix '" << prefix << "': "
+	 << it->status().ToString() << dendl;
+    return -EIO;
+  }
+  it.reset();
+  dout(1) << __func__ << " moved " << moved << " keys with prefix '"
+	  << prefix << "'" << dendl;
+  // drop the tombstones we just left behind
+  compact_range(start, end);
+  return 0;
+}
+
 int RocksDBStore::create_and_open(ostream &out,
 				  const vector<ColumnFamily>& cfs)
 {
@@ -333,7 +505,7 @@ int RocksDBStore::load_rocksdb_options(bool create_if_missing, rocksdb::Options&
     }
   }
 
-  if (g_conf->rocksdb_perf)  {
+  if (g_conf->rocksdb_perf || kv_options.count("statistics"))  {
     dbstats = rocksdb::CreateDBStatistics();
     opt.statistics = dbstats;
   }
@@ -386,7 +558,7 @@ int RocksDBStore::load_rocksdb_options(bool create_if_missing, rocksdb::Options&
     cache_size = g_conf->rocksdb_cache_size;
   }
   uint64_t row_cache_size = cache_size * g_conf->rocksdb_cache_row_ratio;
-  uint64_t block_cache_size = cache_size - row_cache_size;
+  block_cache_size = cache_size - row_cache_size;
 
   if (block_cache_size == 0) {
     // disable block cache
@@ -468,6 +640,7 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
     return r;
   }
   rocksdb::Status status;
+  uint64_t cf_cache_size = 0;
   if (create_if_missing) {
     status = rocksdb::DB::Open(opt, path, &db);
     if (!status.ok()) {
@@ -477,27 +650,10 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
     // create and open column families
     if (cfs) {
       for (auto& p : *cfs) {
-	// copy default CF settings, block cache, merge operators as
-	// the base for new CF
-	rocksdb::ColumnFamilyOptions cf_opt(opt);
-	// user input options will override the base options
-	status = rocksdb::GetColumnFamilyOptionsFromString(
-	  cf_opt, p.option, &cf_opt);
-	if (!status.ok()) {
-	  derr << __func__ << " invalid db column family option string for CF: "
-	       << p.name << dendl;
-	  return -EINVAL;
-	}
-	install_cf_mergeop(p.name, &cf_opt);
-	rocksdb::ColumnFamilyHandle *cf;
-	status = db->CreateColumnFamily(cf_opt, p.name, &cf);
-	if (!status.ok()) {
-	  derr << __func__ << " Failed to create rocksdb column family: "
-	       << p.name << dendl;
-	  return -EINVAL;
+	r = create_cf(opt, p, &cf_cache_size);
+	if (r < 0) {
+	  return r;
 	}
-	// store the new CF handle
-	add_column_family(p.name, static_cast<void*>(cf));
       }
     }
     default_cf = db->DefaultColumnFamily();
@@ -529,12 +685,9 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
 	  for (auto& i : *cfs) {
 	    if (i.name == n) {
 	      found = true;
-	      status = rocksdb::GetColumnFamilyOptionsFromString(
-		cf_opt, i.option, &cf_opt);
-	      if (!status.ok()) {
-		derr << __func__ << " invalid db column family options for CF '"
-		     << i.name << "': " << i.option << dendl;
-		return -EINVAL;
+	      r = apply_cf_options(i.name, i.option, &cf_opt, &cf_cache_size);
+	      if (r < 0) {
+		return r;
 	      }
 	    }
 	  }
@@ -566,9 +719,48 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
     }
   }
   assert(default_cf != nullptr);
-  
+
+  if (!create_if_missing && cfs) {
+    // existing db: optionally give each requested prefix its own CF, and
+    // move over whatever is still sitting in the default CF for the CFs
+    // we have (also finishes a migration that was interrupted).
+    if (kv_options.count("cf_migrate")) {
+      for (auto& p : *cfs) {
+	if (get_cf_handle(p.name)) {
+	  continue;
+	}
+	dout(1) << __func__ << " creating column family '" << p.name
+		<< "' for existing db" << dendl;
+	r = create_cf(opt, p, &cf_cache_size);
+	if (r < 0) {
+	  return r;
+	}
+      }
+    }
+    for (auto& p : cf_handles) {
+      r = migrate_to_cf(p.first,
+			static_cast<rocksdb::ColumnFamilyHandle*>(p.second));
+      if (r < 0) {
+	return r;
+      }
+    }
+  }
+
+  if (cf_cache_size) {
+    // per-CF caches come out of the shared block cache budget
+    if (cf_cache_size < block_cache_size) {
+      bbt_opts.block_cache->SetCapacity(block_cache_size - cf_cache_size);
+    } else {
+      derr << __func__ << " column family cache_ratio total exceeds the block"
+	   << " cache budget; leaving shared block cache at "
+	   << byte_u_t(block_cache_size) << dendl;
+    }
+  }
+
   PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
   plb.add_u64_counter(l_rocksdb_gets, "get", "Gets");
+  plb.add_u64_counter(l_rocksdb_multiget_keys, "multiget_keys",
+		      "Keys looked up through batched gets");
   plb.add_u64_counter(l_rocksdb_txns, "submit_transaction", "Submit transactions");
   plb.add_u64_counter(l_rocksdb_txns_sync, "submit_transaction_sync", "Submit transactions sync");
   plb.add_time_avg(l_rocksdb_get_latency, "get_latency", "Get latency");
@@ -731,6 +923,28 @@ void RocksDBStore::get_statistics(Formatter *f)
   }
 }
 
+int RocksDBStore::get_property(const std::string &property, uint64_t *out)
+{
+  // byte tickers are only collected when dbstats was created, either by
+  // rocksdb_perf or by the "statistics" kv option
+  static const std::map<std::string, rocksdb::Tickers> tickers = {
+    { "rocksdb.bytes.written", rocksdb::BYTES_WRITTEN },
+    { "rocksdb.wal.bytes", rocksdb::WAL_FILE_BYTES },
+    { "rocksdb.flush.write.bytes", rocksdb::FLUSH_WRITE_BYTES },
+    { "rocksdb.compact.write.bytes", rocksdb::COMPACT_WRITE_BYTES },
+  };
+  auto t = tickers.find(property);
+  if (t != tickers.end()) {
+    if (!dbstats)
+      return -EOPNOTSUPP;
+    *out = dbstats->getTickerCount(t->second);
+    return 0;
+  }
+  if (!db->GetIntProperty(property, out))
+    return -ENOENT;
+  return 0;
+}
+
 int RocksDBStore::submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t) 
 {
   // enable rocksdb breakdown
@@ -905,8 +1119,15 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
   auto cf = db->get_cf_handle(prefix);
   if (cf) {
     if (db->enable_rmrange) {
-      string endprefix("\xff\xff\xff\xff");  // FIXME: this is cheating...
-      bat.DeleteRange(cf, string(), endprefix);
+      // the whole column family is the prefix; range delete up to its last
+      // key and drop that one on its own, as DeleteRange's end is exclusive
+      auto it = db->get_iterator(prefix);
+      it->seek_to_last();
+      if (it->valid()) {
+	string last = it->key();
+	bat.DeleteRange(cf, string(), last);
+	bat.Delete(cf, last);
+      }
     } else {
       auto it = db->get_iterator(prefix);
       for (it->seek_to_first();
@@ -936,10 +1157,26 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
 void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
+{
+  _rm_range_keys(prefix, start, end, db->enable_rmrange);
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rm_range_keys_bulk(
+  const string &prefix,
+  const string &start,
+  const string &end)
+{
+  _rm_range_keys(prefix, start, end, true);
+}
+
+void RocksDBStore::RocksDBTransactionImpl::_rm_range_keys(const string &prefix,
+							  const string &start,
+							  const string &end,
+							  bool use_rmrange)
 {
   auto cf = db->get_cf_handle(prefix);
   if (cf) {
-    if (db->enable_rmrange) {
+    if (use_rmrange) {
       bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
     } else {
       auto it = db->get_iterator(prefix);
@@ -953,7 +1190,7 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
       }
     }
   } else {
-    if (db->enable_rmrange) {
+    if (use_rmrange) {
       bat.DeleteRange(
 	db->default_cf,
 	rocksdb::Slice(combine_strings(prefix, start)),
@@ -1018,38 +1255,44 @@ int RocksDBStore::get(
     const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
+  if (keys.empty()) {
+    return 0;
+  }
   utime_t start = ceph_clock_now();
   auto cf = get_cf_handle(prefix);
+  // keys arrive sorted, so a single MultiGet lets rocksdb share block
+  // reads between neighbouring keys instead of doing one lookup each.
+  vector<string> combined;
+  vector<rocksdb::Slice> slices;
+  slices.reserve(keys.size());
   if (cf) {
     for (auto& key : keys) {
-      std::string value;
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf,
-			    rocksdb::Slice(key),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value);
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(cct, status.ToString());
-      }
+      slices.push_back(rocksdb::Slice(key));
     }
   } else {
+    cf = default_cf;
+    combined.reserve(keys.size());
     for (auto& key : keys) {
-      std::string value;
-      string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value);
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(cct, status.ToString());
-      }
+      combined.push_back(combine_strings(prefix, key));
+      slices.push_back(rocksdb::Slice(combined.back()));
     }
   }
+  vector<rocksdb::ColumnFamilyHandle*> cfs(keys.size(), cf);
+  vector<string> values;
+  vector<rocksdb::Status> status = db->MultiGet(rocksdb::ReadOptions(),
+						cfs, slices, &values);
+  unsigned i = 0;
+  for (auto& key : keys) {
+    if (status[i].ok()) {
+      (*out)[key].append(values[i]);
+    } else if (status[i].IsIOError()) {
+      ceph_abort_msg(cct, status[i].ToString());
+    }
+    ++i;
+  }
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
+  logger->inc(l_rocksdb_multiget_keys, keys.size());
   logger->tinc(l_rocksdb_get_latency, lat);
   return 0;
 }
@@ -1167,12 +1410,12 @@ void RocksDBStore::compact_thread_entry()
   compact_queue_lock.Lock();
   while (!compact_queue_stop) {
     while (!compact_queue.empty()) {
-      pair<string,string> range = compact_queue.front();
+      auto range = compact_queue.front();
       compact_queue.pop_front();
       logger->set(l_rocksdb_compact_queue_len, compact_queue.size());
       compact_queue_lock.Unlock();
       logger->inc(l_rocksdb_compact_range);
-      compact_range(range.first, range.second);
+      compact_cf_range(range.first, range.second.first, range.second.second);
       compact_queue_lock.Lock();
       continue;
     }
@@ -1182,37 +1425,49 @@ void RocksDBStore::compact_thread_entry()
 }
 
 void RocksDBStore::compact_range_async(const string& start, const string& end)
+{
+  compact_cf_range_async(string(), start, end);
+}
+
+void RocksDBStore::compact_cf_range_async(const string& cf_name,
+					  const string& start,
+					  const string& end)
 {
   Mutex::Locker l(compact_queue_lock);
 
-  // try to merge adjacent ranges.  this is O(n), but the queue should
-  // be short.  note that we do not cover all overlap cases and merge
-  // opportunities here, but we capture the ones we currently need.
-  list< pair<string,string> >::iterator p = compact_queue.begin();
-  while (p != compact_queue.end()) {
-    if (p->first == start && p->second == end) {
+  // an empty end means "to the end of the key space" (an empty start is
+  // already the lowest key), so it must not be compared as a plain string
+  auto key_le_end = [](const string& k, const string& e) {
+    return e.empty() || k <= e;
+  };
+  auto max_end = [](const string& a, const string& b) {
+    return (a.empty() || b.empty()) ? string() : std::max(a, b);
+  };
+
+  // try to merge overlapping or adjacent ranges.  this is O(n), but the
+  // queue should be short.
+  bool merged = false;
+  for (auto p = compact_queue.begin(); p != compact_queue.end(); ++p) {
+    if (p->first != cf_name)
+      continue;
+    const pair<string,string>& r = p->second;
+    if (r.first == start && r.second == end) {
       // dup; no-op
       return;
     }
-    if (p->first <= end && p->first > start) {
-      // merge with existing range to the right
-      compact_queue.push_back(make_pair(start, p->second));
-      compact_queue.erase(p);
-      logger->inc(l_rocksdb_compact_queue_merge);
-      break;
-    }
-    if (p->second >= start && p->second < end) {
-      // merge with existing range to the left
-      compact_queue.push_back(make_pair(p->first, end));
+    if (key_le_end(r.first, end) && key_le_end(start, r.second)) {
+      // merge with the overlapping range
+      compact_queue.push_back(make_pair(cf_name, make_pair(
+	std::min(start, r.first), max_end(end, r.second))));
       compact_queue.erase(p);
       logger->inc(l_rocksdb_compact_queue_merge);
+      merged = true;
       break;
     }
-    ++p;
   }
-  if (p == compact_queue.end()) {
+  if (!merged) {
     // no merge, new entry.
-    compact_queue.push_back(make_pair(start, end));
+    compact_queue.push_back(make_pair(cf_name, make_pair(start, end)));
     logger->set(l_rocksdb_compact_queue_len, compact_queue.size());
   }
   compact_queue_cond.Signal();
@@ -1238,6 +1493,25 @@ void RocksDBStore::compact_range(const string& start, const string& end)
   db->CompactRange(options, &cstart, &cend);
 }
 
+void RocksDBStore::compact_cf_range(const string& cf_name,
+				    const string& start, const string& end)
+{
+  rocksdb::ColumnFamilyHandle *cf = default_cf;
+  if (!cf_name.empty()) {
+    cf = get_cf_handle(cf_name);
+    if (!cf) {
+      derr << __func__ << " no column family '" << cf_name << "'" << dendl;
+      return;
+    }
+  }
+  rocksdb::CompactRangeOptions options;
+  rocksdb::Slice cstart(start);
+  rocksdb::Slice cend(end);
+  db->CompactRange(options, cf,
+		   start.empty() ? nullptr : &cstart,
+		   end.empty() ? nullptr : &cend);
+}
+
 RocksDBStore::RocksDBWholeSpaceIteratorImpl::~RocksDBWholeSpaceIteratorImpl()
 {
   delete dbiter;
@@ -1367,10 +1641,259 @@ string RocksDBStore::past_prefix(const string &prefix)
   return limit;
 }
 
+// Presents one column family as a slice of the whole key space: every key
+// comes back prefixed with the column family name, as it would if it lived
+// in the default column family.
+class CFWholeSpaceIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
+  const string prefix;
+  rocksdb::Iterator *dbiter;
+  // set when a seek lands entirely before or after this column family
+  bool exhausted = false;
+
+  int done() {
+    assert(!dbiter->status().IsIOError());
+    return dbiter->status().ok() ? 0 : -1;
+  }
+public:
+  CFWholeSpaceIteratorImpl(const string& p, rocksdb::Iterator *iter)
+    : prefix(p), dbiter(iter) { }
+  ~CFWholeSpaceIteratorImpl() override {
+    delete dbiter;
+  }
+
+  int seek_to_first() override {
+    exhausted = false;
+    dbiter->SeekToFirst();
+    return done();
+  }
+  int seek_to_first(const string &p) override {
+    return lower_bound(p, string());
+  }
+  int seek_to_last() override {
+    exhausted = false;
+    dbiter->SeekToLast();
+    return done();
+  }
+  int seek_to_last(const string &p) override {
+    exhausted = prefix > p;
+    if (!exhausted)
+      dbiter->SeekToLast();
+    return done();
+  }
+  int upper_bound(const string &p, const string &after) override {
+    lower_bound(p, after);
+    if (valid() && prefix == p && dbiter->key().compare(after) == 0)
+      next();
+    return done();
+  }
+  int lower_bound(const string &p, const string &to) override {
+    exhausted = prefix < p;
+    if (exhausted)
+      return done();
+    if (prefix == p)
+      dbiter->Seek(rocksdb::Slice(to));
+    else
+      dbiter->SeekToFirst();
+    return done();
+  }
+  bool valid() override {
+    return !exhausted && dbiter->Valid();
+  }
+  int next() override {
+    if (valid())
+      dbiter->Next();
+    return done();
+  }
+  int prev() override {
+    if (valid())
+      dbiter->Prev();
+    return done();
+  }
+  string key() override {
+    return dbiter->key().ToString();
+  }
+  pair<string,string> raw_key() override {
+    return make_pair(prefix, key());
+  }
+  bool raw_key_is_prefixed(const string &p) override {
+    return prefix == p;
+  }
+  bufferlist value() override {
+    return to_bufferlist(dbiter->value());
+  }
+  bufferptr value_as_ptr() override {
+    rocksdb::Slice val = dbiter->value();
+    return bufferptr(val.data(), val.size());
+  }
+  int status() override {
+    return dbiter->status().ok() ? 0 : -1;
+  }
+  size_t key_size() override {
+    // count the prefix like a key in the default column family would
+    return prefix.size() + 1 + dbiter->key().size();
+  }
+  size_t value_size() override {
+    return dbiter->value().size();
+  }
+};
+
+// Walks the default column family and every per-prefix column family as
+// one ordered key space.  Each prefix lives in exactly one of them, so the
+// children never hold the same key.
+class MergedWholeSpaceIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
+  vector<KeyValueDB::WholeSpaceIterator> iters;
+  KeyValueDB::WholeSpaceIteratorImpl *cur = nullptr;
+  bool forward = true;
+
+  void pick() {
+    cur = nullptr;
+    pair<string,string> best;
+    for (auto& i : iters) {
+      if (!i->valid())
+	continue;
+      pair<string,string> k = i->raw_key();
+      if (!cur || (forward ? k < best : k > best)) {
+	cur = i.get();
+	best = std::move(k);
+      }
+    }
+  }
+  int status_all() {
+    for (auto& i : iters) {
+      int r = i->status();
+      if (r < 0)
+	return r;
+    }
+    return 0;
+  }
+public:
+  explicit MergedWholeSpaceIteratorImpl(
+    vector<KeyValueDB::WholeSpaceIterator>&& i)
+    : iters(std::move(i)) { }
+
+  int seek_to_first() override {
+    for (auto& i : iters)
+      i->seek_to_first();
+    forward = true;
+    pick();
+    return status_all();
+  }
+  int seek_to_first(const string &prefix) override {
+    for (auto& i : iters)
+      i->seek_to_first(prefix);
+    forward = true;
+    pick();
+    return status_all();
+  }
+  int seek_to_last() override {
+    for (auto& i : iters)
+      i->seek_to_last();
+    forward = false;
+    pick();
+    return status_all();
+  }
+  int seek_to_last(const string &prefix) override {
+    for (auto& i : iters)
+      i->seek_to_last(prefix);
+    forward = false;
+    pick();
+    return status_all();
+  }
+  int upper_bound(const string &prefix, const string &after) override {
+    for (auto& i : iters)
+      i->upper_bound(prefix, after);
+    forward = true;
+    pick();
+    return status_all();
+  }
+  int lower_bound(const string &prefix, const string &to) override {
+    for (auto& i : iters)
+      i->lower_bound(prefix, to);
+    forward = true;
+    pick();
+    return status_all();
+  }
+  bool valid() override {
+    return cur != nullptr;
+  }
+  int next() override {
+    if (!cur)
+      return status_all();
+    if (!forward) {
+      // the other children sit before us; move them past the current key
+      pair<string,string> k = cur->raw_key();
+      for (auto& i : iters)
+	if (i.get() != cur)
+	  i->upper_bound(k.first, k.second);
+      forward = true;
+    }
+    cur->next();
+    pick();
+    return status_all();
+  }
+  int prev() override {
+    if (!cur)
+      return status_all();
+    if (forward) {
+      // the other children sit after us; move them before the current key
+      pair<string,string> k = cur->raw_key();
+      for (auto& i : iters) {
+	if (i.get() == cur)
+	  continue;
+	i->lower_bound(k.first, k.second);
+	if (i->valid())
+	  i->prev();
+	else
+	  i->seek_to_last();
+      }
+      forward = false;
+    }
+    cur->prev();
+    pick();
+    return status_all();
+  }
+  string key() override {
+    return cur->key();
+  }
+  pair<string,string> raw_key() override {
+    return cur->raw_key();
+  }
+  bool raw_key_is_prefixed(const string &prefix) override {
+    return cur->raw_key_is_prefixed(prefix);
+  }
+  bufferlist value() override {
+    return cur->value();
+  }
+  bufferptr value_as_ptr() override {
+    return cur->value_as_ptr();
+  }
+  int status() override {
+    return status_all();
+  }
+  size_t key_size() override {
+    return cur->key_size();
+  }
+  size_t value_size() override {
+    return cur->value_size();
+  }
+};
+
 RocksDBStore::WholeSpaceIterator RocksDBStore::get_wholespace_iterator()
 {
-  return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
-    db->NewIterator(rocksdb::ReadOptions(), default_cf));
+  if (cf_handles.empty()) {
+    return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+      db->NewIterator(rocksdb::ReadOptions(), default_cf));
+  }
+  vector<WholeSpaceIterator> iters;
+  iters.push_back(std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+    db->NewIterator(rocksdb::ReadOptions(), default_cf)));
+  for (auto& p : cf_handles) {
+    iters.push_back(std::make_shared<CFWholeSpaceIteratorImpl>(
+      p.first,
+      db->NewIterator(rocksdb::ReadOptions(),
+		      static_cast<rocksdb::ColumnFamilyHandle*>(p.second))));
+  }
+  return std::make_shared<MergedWholeSpaceIteratorImpl>(std::move(iters));
 }
 
 class CFIteratorImpl : public KeyValueDB::IteratorImpl {
@@ -29,6 +29,7 @@ class PerfCounters;
 enum {
   l_rocksdb_first = 34300,
   l_rocksdb_gets,
+  l_rocksdb_multiget_keys,
   l_rocksdb_txns,
   l_rocksdb_txns_sync,
   l_rocksdb_get_latency,
@@ -80,6 +81,7 @@ class RocksDBStore : public KeyValueDB {
   string options_str;
 
   uint64_t cache_size = 0;
+  uint64_t block_cache_size = 0;   ///< block cache budget shared by all CFs
   bool set_cache_flag = false;
 
   bool must_close_default_cf = false;
@@ -87,6 +89,12 @@ class RocksDBStore : public KeyValueDB {
 
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
+  int apply_cf_options(const string &cf_name, const string &option_str,
+		       rocksdb::ColumnFamilyOptions *cf_opt,
+		       uint64_t *cf_cache_size);
+  int create_cf(const rocksdb::Options &opt, const ColumnFamily &cf,
+		uint64_t *cf_cache_size);
+  int migrate_to_cf(const string &prefix, rocksdb::ColumnFamilyHandle *cf);
   int create_db_dir();
   int do_open(ostream &out, bool create_if_missing,
 	      const vector<ColumnFamily>* cfs = nullptr);
@@ -95,7 +103,8 @@ class RocksDBStore : public KeyValueDB {
   // manage async compactions
   Mutex compact_queue_lock;
   Cond compact_queue_cond;
-  list< pair<string,string> > compact_queue;
+  /// (column family, or empty for the default one; [start, end) range)
+  list< pair<string, pair<string,string> > > compact_queue;
   bool compact_queue_stop;
   class CompactThread : public Thread {
     RocksDBStore *db;
@@ -112,6 +121,11 @@ class RocksDBStore : public KeyValueDB {
 
   void compact_range(const string& start, const string& end);
   void compact_range_async(const string& start, const string& end);
+  /// an empty start or end leaves that side of the range open
+  void compact_cf_range(const string& cf_name,
+			const string& start, const string& end);
+  void compact_cf_range_async(const string& cf_name,
+			      const string& start, const string& end);
 
 public:
   /// compact the underlying rocksdb store
@@ -126,17 +140,29 @@ public:
   int init(string options_str) override;
   /// compact rocksdb for all keys with a given prefix
   void compact_prefix(const string& prefix) override {
-    compact_range(prefix, past_prefix(prefix));
+    if (get_cf_handle(prefix))
+      compact_cf_range(prefix, string(), string());
+    else
+      compact_range(prefix, past_prefix(prefix));
   }
   void compact_prefix_async(const string& prefix) override {
-    compact_range_async(prefix, past_prefix(prefix));
+    if (get_cf_handle(prefix))
+      compact_cf_range_async(prefix, string(), string());
+    else
+      compact_range_async(prefix, past_prefix(prefix));
   }
 
   void compact_range(const string& prefix, const string& start, const string& end) override {
-    compact_range(combine_strings(prefix, start), combine_strings(prefix, end));
+    if (get_cf_handle(prefix))
+      compact_cf_range(prefix, start, end);
+    else
+      compact_range(combine_strings(prefix, start), combine_strings(prefix, end));
   }
   void compact_range_async(const string& prefix, const string& start, const string& end) override {
-    compact_range_async(combine_strings(prefix, start), combine_strings(prefix, end));
+    if (get_cf_handle(prefix))
+      compact_cf_range_async(prefix, start, end);
+    else
+      compact_range_async(combine_strings(prefix, start), combine_strings(prefix, end));
   }
 
   RocksDBStore(CephContext *c, const string &path, map<string,string> opt, void *p) :
@@ -179,6 +205,7 @@ public:
   int repair(std::ostream &out) override;
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(Formatter *f) override;
+  int get_property(const std::string &property, uint64_t *out) override;
 
   PerfCounters *get_perf_counters() override
   {
@@ -288,6 +315,11 @@ public:
       rocksdb::ColumnFamilyHandle *cf,
       const string &k,
       const bufferlist &to_set_bl);
+    void _rm_range_keys(
+      const string &prefix,
+      const string &start,
+      const string &end,
+      bool use_rmrange);
   public:
     void set(
       const string &prefix,
@@ -315,6 +347,10 @@ public:
       const string &prefix,
       const string &start,
       const string &end) override;
+    void rm_range_keys_bulk(
+      const string &prefix,
+      const string &start,
+      const string &end) override;
     void merge(
       const string& prefix,
       const string& k,
@@ -23,6 +23,10 @@
 #define DEFAULT_MAX_NEW    100
 #define DEFAULT_MAX_RECENT 10000
 
+// entries are formatted into m_write_buf and written out in one go
+// once this much has accumulated, or when the batch ends
+#define MAX_WRITE_BUF      65536
+
 #define PREALLOC 1000000
 
 
@@ -44,7 +48,7 @@ Log::Log(SubsystemMap *s)
     m_subs(s),
     m_queue_mutex_holder(0),
     m_flush_mutex_holder(0),
-    m_new(), m_recent(),
+    m_new(nullptr), m_new_len(0), m_recent(),
     m_fd(-1),
     m_uid(0),
     m_gid(0),
@@ -84,6 +88,8 @@ Log::~Log()
   }
 
   assert(!is_started());
+  EntryQueue t;
+  _take_new(&t);
   if (m_fd >= 0)
     VOID_TEMP_FAILURE_RETRY(::close(m_fd));
 
@@ -219,20 +225,56 @@ void Log::submit_entry(Entry *e)
 {
   e->finish();
 
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
-
   if (m_inject_segv)
     *(volatile int *)(0) = 0xdead;
 
   // wait for flush to catch up
-  while (m_new.m_len > m_max_new)
-    pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+  if (m_new_len.load(std::memory_order_relaxed) > m_max_new) {
+    pthread_mutex_lock(&m_queue_mutex);
+    m_queue_mutex_holder = pthread_self();
+    while (m_new_len.load() > m_max_new && !m_stop)
+      pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+    m_queue_mutex_holder = 0;
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
 
-  m_new.enqueue(e);
-  pthread_cond_signal(&m_cond_flusher);
-  m_queue_mutex_holder = 0;
-  pthread_mutex_unlock(&m_queue_mutex);
+  Entry *head = m_new.load(std::memory_order_relaxed);
+  do {
+    e->m_next = head;
+  } while (!m_new.compare_exchange_weak(head, e,
+					std::memory_order_release,
+					std::memory_order_relaxed));
+  m_new_len++;
+
+  // the flusher only sleeps once it has found m_new empty under
+  // m_queue_mutex, so only the entry that ends that state needs to wake it
+  if (!head) {
+    pthread_mutex_lock(&m_queue_mutex);
+    pthread_cond_signal(&m_cond_flusher);
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+}
+
+void Log::_take_new(EntryQueue *q)
+{
+  Entry *e = m_new.exchange(nullptr, std::memory_order_acquire);
+  // the stack is newest first; put it back in submission order
+  Entry *fifo = nullptr;
+  int n = 0;
+  while (e) {
+    Entry *next = e->m_next;
+    e->m_next = fifo;
+    fifo = e;
+    e = next;
+    ++n;
+  }
+  m_new_len -= n;
+  while (fifo) {
+    e = fifo->m_next;
+    fifo->m_next = nullptr;
+    q->enqueue(fifo);
+    fifo = e;
+  }
 }
 
 
@@ -278,10 +320,10 @@ void Log::flush()
 {
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
+  EntryQueue t;
+  _take_new(&t);
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
-  EntryQueue t;
-  t.swap(m_new);
   pthread_cond_broadcast(&m_cond_loggers);
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
@@ -345,14 +387,9 @@ void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
       }
       if (do_fd) {
         buf[buflen] = '\n';
-        int r = safe_write(m_fd, buf, buflen+1);
-	if (r != m_fd_last_error) {
-	  if (r < 0)
-	    cerr << "problem writing to " << m_log_file
-		 << ": " << cpp_strerror(r)
-		 << std::endl;
-	  m_fd_last_error = r;
-	}
+        if (m_write_buf.size() + buflen + 1 > MAX_WRITE_BUF)
+          _write_fd();
+        m_write_buf.append(buf, buflen + 1);
       }
       if (need_dynamic)
         delete[] buf;
@@ -363,6 +400,29 @@ void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
 
     requeue->enqueue(e);
   }
+  _write_fd();
+}
+
+void Log::_write_fd()
+{
+  if (m_write_buf.empty())
+    return;
+  if (m_fd >= 0) {
+    int r = safe_write(m_fd, m_write_buf.data(), m_write_buf.size());
+    if (r != m_fd_last_error) {
+      if (r < 0)
+	cerr << "problem writing to " << m_log_file
+	     << ": " << cpp_strerror(r)
+	     << std::endl;
+      m_fd_last_error = r;
+    }
+  }
+  m_write_buf.clear();
+  if (m_write_buf.capacity() > MAX_WRITE_BUF) {
+    // don't hang on to the space a huge entry needed
+    std::string().swap(m_write_buf);
+    m_write_buf.reserve(MAX_WRITE_BUF);
+  }
 }
 
 void Log::_log_message(const char *s, bool crash)
@@ -391,14 +451,8 @@ void Log::dump_recent()
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
 
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
-
   EntryQueue t;
-  t.swap(m_new);
-
-  m_queue_mutex_holder = 0;
-  pthread_mutex_unlock(&m_queue_mutex);
+  _take_new(&t);
   _flush(&t, &m_recent, false);
 
   EntryQueue old;
@@ -455,7 +509,7 @@ void *Log::entry()
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
   while (!m_stop) {
-    if (!m_new.empty()) {
+    if (m_new.load()) {
       m_queue_mutex_holder = 0;
       pthread_mutex_unlock(&m_queue_mutex);
       flush();
@@ -4,7 +4,9 @@
 #ifndef __CEPH_LOG_LOG_H
 #define __CEPH_LOG_LOG_H
 
+#include <atomic>
 #include <memory>
+#include <string>
 
 #include "common/Thread.h"
 
@@ -32,7 +34,10 @@ class Log : private Thread
   pthread_t m_queue_mutex_holder;
   pthread_t m_flush_mutex_holder;
 
-  EntryQueue m_new;    ///< new entries
+  /// new entries, newest first.  submit_entry() pushes here without
+  /// taking m_queue_mutex; the flusher takes the whole stack at once
+  std::atomic<Entry*> m_new;
+  std::atomic<int> m_new_len;
   EntryQueue m_recent; ///< recent (less new) entries we've already written at low detail
 
   std::string m_log_file;
@@ -42,6 +47,8 @@ class Log : private Thread
 
   int m_fd_last_error;  ///< last error we say writing to fd (if any)
 
+  std::string m_write_buf; ///< formatted entries not yet written to m_fd
+
   int m_syslog_log, m_syslog_crash;
   int m_stderr_log, m_stderr_crash;
   int m_graylog_log, m_graylog_crash;
@@ -58,7 +65,9 @@ class Log : private Thread
 
   void *entry() override;
 
+  void _take_new(EntryQueue *q);
   void _flush(EntryQueue *q, EntryQueue *requeue, bool crash);
+  void _write_fd();
 
   void _log_message(const char *s, bool crash);
 
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <fstream>
+#include <thread>
 
 #include "log/Log.h"
 #include "common/Clock.h"
@@ -281,6 +283,53 @@ TEST(Log, LargeLog)
   log.stop();
 }
 
+TEST(Log, ManyThreadsInOrder)
+{
+  SubsystemMap subs;
+  subs.set_log_level(1, 20);
+  subs.set_gather_level(1, 10);
+  Log log(&subs);
+  log.set_max_new(10);  // make submitters wait for the flusher too
+  log.start();
+  std::string fn = "/tmp/ceph_test_log_threads." + std::to_string(getpid());
+  ::unlink(fn.c_str());
+  log.set_log_file(fn);
+  log.reopen_log_file();
+  log.set_stderr_level(-1, -1);
+
+  const int num_threads = 8, num_entries = 2000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&log, t] {
+      for (int i = 0; i < num_entries; ++i) {
+	Entry *e = log.create_entry(10, 1);
+	e->get_ostream() << "thread " << t << " entry " << i;
+	log.submit_entry(e);
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  log.flush();
+  log.stop();
+
+  // every entry is written once, each thread's in the order submitted
+  std::ifstream in(fn);
+  std::string line;
+  std::vector<int> next(num_threads, 0);
+  while (std::getline(in, line)) {
+    int t, i;
+    auto p = line.find(" thread ");
+    ASSERT_NE(std::string::npos, p);
+    ASSERT_EQ(2, sscanf(line.c_str() + p, " thread %d entry %d", &t, &i));
+    ASSERT_EQ(next[t], i);
+    ++next[t];
+  }
+  for (int t = 0; t < num_threads; ++t)
+    ASSERT_EQ(num_entries, next[t]);
+  ::unlink(fn.c_str());
+}
+
 // Make sure nothing bad happens when we switch
 
 TEST(Log, TimeSwitch)
@@ -19,6 +19,8 @@
 #include <map>
 #include <boost/intrusive_ptr.hpp>
 #include "include/assert.h"
+#include "include/hash.h"
+#include "include/stringify.h"
 #include "include/xlist.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
@@ -63,45 +65,82 @@ class DispatchQueue {
     
   CephContext *cct;
   Messenger *msgr;
-  mutable Mutex lock;
-  Cond cond;
-
-  PrioritizedQueue<QueueItem, uint64_t> mqueue;
-
-  set<pair<double, Message*> > marrival;
-  map<Message *, set<pair<double, Message*> >::iterator> marrival_map;
-  void add_arrival(Message *m) {
-    marrival_map.insert(
-      make_pair(
-	m,
-	marrival.insert(make_pair(m->get_recv_stamp(), m)).first
-	)
-      );
-  }
-  void remove_arrival(Message *m) {
-    map<Message *, set<pair<double, Message*> >::iterator>::iterator i =
-      marrival_map.find(m);
-    assert(i != marrival_map.end());
-    marrival.erase(i->second);
-    marrival_map.erase(i);
-  }
 
   std::atomic<uint64_t> next_id;
     
   enum { D_CONNECT = 1, D_ACCEPT, D_BAD_REMOTE_RESET, D_BAD_RESET, D_CONN_REFUSED, D_NUM_CODES };
 
   /**
-   * The DispatchThread runs dispatch_entry to empty out the dispatch_queue.
+   * A Shard is one priority queue plus the DispatchThread draining it.
+   * Everything queued on behalf of a Connection (its messages and its
+   * connect/accept/reset events) lands on the same shard, so per-connection
+   * ordering is preserved while different connections may be dispatched
+   * concurrently when ms_dispatch_shards > 1.
    */
-  class DispatchThread : public Thread {
+  struct Shard {
     DispatchQueue *dq;
-  public:
-    explicit DispatchThread(DispatchQueue *dq) : dq(dq) {}
-    void *entry() override {
-      dq->entry();
-      return 0;
+    mutable Mutex lock;
+    Cond cond;
+
+    PrioritizedQueue<QueueItem, uint64_t> mqueue;
+
+    set<pair<double, Message*> > marrival;
+    map<Message *, set<pair<double, Message*> >::iterator> marrival_map;
+    void add_arrival(Message *m) {
+      marrival_map.insert(
+	make_pair(
+	  m,
+	  marrival.insert(make_pair(m->get_recv_stamp(), m)).first
+	  )
+	);
     }
-  } dispatch_thread;
+    void remove_arrival(Message *m) {
+      map<Message *, set<pair<double, Message*> >::iterator>::iterator i =
+	marrival_map.find(m);
+      assert(i != marrival_map.end());
+      marrival.erase(i->second);
+      marrival_map.erase(i);
+    }
+
+    /**
+     * The DispatchThread runs dispatch_entry to empty out the dispatch_queue.
+     */
+    class DispatchThread : public Thread {
+      Shard *shard;
+    public:
+      explicit DispatchThread(Shard *shard) : shard(shard) {}
+      void *entry() override {
+	shard->dq->entry(shard);
+	return 0;
+      }
+    } dispatch_thread;
+
+    Shard(DispatchQueue *dq, const string &lock_name)
+      : dq(dq),
+	lock(lock_name),
+	mqueue(dq->cct->_conf->ms_pq_max_tokens_per_priority,
+	       dq->cct->_conf->ms_pq_min_cost),
+	dispatch_thread(this) {}
+  };
+  vector<Shard*> shards;
+
+  Shard *get_shard(const Connection *con) {
+    if (shards.size() == 1 || !con)
+      return shards[0];
+    return shards[rjhash64((uintptr_t)con) % shards.size()];
+  }
+
+  void queue_code(int code, Connection *con) {
+    Shard *shard = get_shard(con);
+    Mutex::Locker l(shard->lock);
+    if (stop)
+      return;
+    shard->mqueue.enqueue_strict(
+      0,
+      CEPH_MSG_PRIO_HIGHEST,
+      QueueItem(code, con));
+    shard->cond.Signal();
+  }
 
   Mutex local_delivery_lock;
   Cond local_delivery_cond;
@@ -125,16 +164,14 @@ class DispatchQueue {
   /// Throttle preventing us from building up a big backlog waiting for dispatch
   Throttle dispatch_throttler;
 
-  bool stop;
+  /// read by every shard's thread, each under only its own shard lock
+  std::atomic<bool> stop;
   void local_delivery(Message *m, int priority);
   void run_local_delivery();
 
   double get_max_age(utime_t now) const;
 
-  int get_queue_len() const {
-    Mutex::Locker l(lock);
-    return mqueue.length();
-  }
+  int get_queue_len() const;
 
   /**
    * Release memory accounting back to the dispatch throttler.
@@ -144,54 +181,19 @@ class DispatchQueue {
   void dispatch_throttle_release(uint64_t msize);
 
   void queue_connect(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_CONNECT, con));
-    cond.Signal();
+    queue_code(D_CONNECT, con);
   }
   void queue_accept(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_ACCEPT, con));
-    cond.Signal();
+    queue_code(D_ACCEPT, con);
   }
   void queue_remote_reset(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_BAD_REMOTE_RESET, con));
-    cond.Signal();
+    queue_code(D_BAD_REMOTE_RESET, con);
   }
   void queue_reset(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_BAD_RESET, con));
-    cond.Signal();
+    queue_code(D_BAD_RESET, con);
   }
   void queue_refused(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_CONN_REFUSED, con));
-    cond.Signal();
+    queue_code(D_CONN_REFUSED, con);
   }
 
   bool can_fast_dispatch(const Message *m) const;
@@ -204,28 +206,36 @@ class DispatchQueue {
     return next_id++;
   }
   void start();
-  void entry();
+  void entry(Shard *shard);
   void wait();
   void shutdown();
-  bool is_started() const {return dispatch_thread.is_started();}
+  bool is_started() const {return shards[0]->dispatch_thread.is_started();}
 
   DispatchQueue(CephContext *cct, Messenger *msgr, string &name)
     : cct(cct), msgr(msgr),
-      lock("Messenger::DispatchQueue::lock" + name),
-      mqueue(cct->_conf->ms_pq_max_tokens_per_priority,
-	     cct->_conf->ms_pq_min_cost),
       next_id(1),
-      dispatch_thread(this),
       local_delivery_lock("Messenger::DispatchQueue::local_delivery_lock" + name),
       stop_local_delivery(false),
       local_delivery_thread(this),
       dispatch_throttler(cct, string("msgr_dispatch_throttler-") + name,
                          cct->_conf->ms_dispatch_throttle_bytes),
       stop(false)
-    {}
+    {
+      uint64_t num_shards = std::max<uint64_t>(
+	1, cct->_conf->get_val<uint64_t>("ms_dispatch_shards"));
+      for (uint64_t i = 0; i < num_shards; ++i) {
+	string lock_name = "Messenger::DispatchQueue::lock" + name;
+	if (i)
+	  lock_name += "-" + stringify(i);
+	shards.push_back(new Shard(this, lock_name));
+      }
+    }
   ~DispatchQueue() {
-    assert(mqueue.empty());
-    assert(marrival.empty());
+    for (auto shard : shards) {
+      assert(shard->mqueue.empty());
+      assert(shard->marrival.empty());
+      delete shard;
+    }
     assert(local_messages.empty());
   }
 };
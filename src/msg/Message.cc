@@ -206,7 +206,20 @@ void Message::encode(uint64_t features, int crcflags)
   // encode and copy out of *m
   if (empty_payload()) {
     assert(middle.length() == 0);
-    encode_payload(features);
+    bool cached = false;
+    if (encode_cache) {
+      std::lock_guard<std::mutex> l(encode_cache->lock);
+      auto p = encode_cache->entries.find(features);
+      if (p != encode_cache->entries.end()) {
+	payload = p->second.front;
+	middle = p->second.middle;
+	header.version = p->second.version;
+	header.compat_version = p->second.compat_version;
+	cached = true;
+      }
+    }
+    if (!cached)
+      encode_payload(features);
 
     if (byte_throttler) {
       byte_throttler->take(payload.length() + middle.length());
@@ -216,6 +229,14 @@ void Message::encode(uint64_t features, int crcflags)
     // is incompatible.
     if (header.compat_version == 0)
       header.compat_version = header.version;
+
+    if (encode_cache && !cached) {
+      std::lock_guard<std::mutex> l(encode_cache->lock);
+      encode_cache->entries.emplace(
+	features,
+	MessageEncodeCache::Entry{payload, middle,
+	                          header.version, header.compat_version});
+    }
   }
   if (crcflags & MSG_CRC_HEADER)
     calc_front_crc();
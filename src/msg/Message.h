@@ -16,6 +16,9 @@
 #define CEPH_MESSAGE_H
  
 #include <stdlib.h>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <ostream>
 
 #include <boost/intrusive_ptr.hpp>
@@ -232,6 +235,24 @@ namespace bi = boost::intrusive;
 // XioMessenger diagnostic "ping pong" flag (resend msg when send completes)
 #define MSG_MAGIC_REDUPE       0x0100
 
+/**
+ * Front and middle encodings shared by identical copies of a message
+ * that is sent to several peers.  The first copy encoded for a feature
+ * set stores its encoding here and the other copies reuse it instead of
+ * calling encode_payload() again.
+ */
+struct MessageEncodeCache {
+  struct Entry {
+    bufferlist front;
+    bufferlist middle;
+    __u16 version;
+    __u16 compat_version;
+  };
+  std::mutex lock;
+  std::map<uint64_t, Entry> entries;  ///< by features
+};
+typedef std::shared_ptr<MessageEncodeCache> MessageEncodeCacheRef;
+
 class Message : public RefCountedObject {
 protected:
   ceph_msg_header  header;      // headerelope
@@ -287,6 +308,9 @@ protected:
   // release a count back to this throttler when we are destroyed
   Throttle *msg_throttler = nullptr;
 
+  // shared with identical copies of this message, see MessageEncodeCache
+  MessageEncodeCacheRef encode_cache;
+
   // keep track of how big this message was when we reserved space in
   // the msgr dispatch_throttler, so that we can properly release it
   // later.  this is necessary because messages can enter the dispatch
@@ -379,6 +403,14 @@ public:
     msg_throttler = nullptr;
   }
 
+  /**
+   * Declare that this message encodes exactly like the other messages
+   * sharing @cache, so that each feature set is encoded only once.
+   */
+  void set_encode_cache(const MessageEncodeCacheRef& cache) {
+    encode_cache = cache;
+  }
+
   bool empty_payload() const { return payload.length() == 0; }
   bufferlist& get_payload() { return payload; }
   void set_payload(bufferlist& bl) {
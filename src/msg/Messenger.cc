@@ -10,6 +10,9 @@
 
 #include "msg/simple/SimpleMessenger.h"
 #include "msg/async/AsyncMessenger.h"
+#include "msg/direct/DirectMessenger.h"
+#include "msg/FastStrategy.h"
+#include "msg/QueueStrategy.h"
 #ifdef HAVE_XIO
 #include "msg/xio/XioMessenger.h"
 #endif
@@ -34,6 +37,24 @@ Messenger *Messenger::create(CephContext *cct, const string &type,
     return new SimpleMessenger(cct, name, std::move(lname), nonce);
   else if (r == 1 || type.find("async") != std::string::npos)
     return new AsyncMessenger(cct, name, type, std::move(lname), nonce);
+  else if (type == "direct") {
+    // in-process only: peers in other processes get no connection, and
+    // messages skip the policy throttlers
+    if (!cct->check_experimental_feature_enabled("ms-type-direct")) {
+      lderr(cct) << "ms_type 'direct' is experimental and requires "
+		 << "'ms-type-direct' in "
+		 << "enable_experimental_unrecoverable_data_corrupting_features"
+		 << dendl;
+      return nullptr;
+    }
+    auto threads = cct->_conf->get_val<uint64_t>("ms_direct_dispatch_threads");
+    DispatchStrategy *strategy;
+    if (threads)
+      strategy = new QueueStrategy(threads);
+    else
+      strategy = new FastStrategy();
+    return new DirectMessenger(cct, name, std::move(lname), nonce, strategy);
+  }
 #ifdef HAVE_XIO
   else if ((type == "xio") &&
 	   cct->check_experimental_feature_enabled("ms-type-xio"))
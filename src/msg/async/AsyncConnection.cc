@@ -18,6 +18,8 @@
 
 #include "include/Context.h"
 #include "include/random.h"
+#include "include/ipaddr.h"
+#include "include/str_list.h"
 #include "common/errno.h"
 #include "AsyncMessenger.h"
 #include "AsyncConnection.h"
@@ -98,7 +100,8 @@ class C_tick_wakeup : public EventCallback {
   }
 };
 
-static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
+static void alloc_aligned_buffer(RxBufferPool *pool, bufferlist& data,
+				 unsigned len, unsigned off)
 {
   // create a buffer to read into that matches the data alignment
   unsigned alloc_len = 0;
@@ -111,7 +114,7 @@ static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
     left -= head;
   }
   alloc_len += left;
-  bufferptr ptr(buffer::create_page_aligned(alloc_len));
+  bufferptr ptr(pool->get(alloc_len));
   if (head)
     ptr.set_offset(CEPH_PAGE_SIZE - head);
   data.push_back(std::move(ptr));
@@ -139,12 +142,14 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQu
   // double recv_max_prefetch see "read_until"
   recv_buf = new char[2*recv_max_prefetch];
   state_buffer = new char[4096];
+  send_batch_bytes = cct->_conf->get_val<uint64_t>("ms_async_send_batch_bytes");
   logger->inc(l_msgr_created_connections);
 }
 
 AsyncConnection::~AsyncConnection()
 {
   assert(out_q.empty());
+  assert(!incoming_q.load());
   assert(sent.empty());
   delete authorizer;
   if (recv_buf)
@@ -207,11 +212,13 @@ ssize_t AsyncConnection::_try_send(bool more)
   }
 
   assert(center->in_thread());
+  uint64_t queued = outcoming_bl.length();
   ssize_t r = cs.send(outcoming_bl, more);
   if (r < 0) {
     ldout(async_msgr->cct, 1) << __func__ << " send error: " << cpp_strerror(r) << dendl;
     return r;
   }
+  logger->inc(l_msgr_send_bytes, queued - outcoming_bl.length());
 
   ldout(async_msgr->cct, 10) << __func__ << " sent bytes " << r
                              << " remaining bytes " << outcoming_bl.length() << dendl;
@@ -594,7 +601,10 @@ void AsyncConnection::process()
           unsigned data_off = le32_to_cpu(current_header.data_off);
           if (data_len) {
             // get a buffer
-            map<ceph_tid_t,pair<bufferlist,int> >::iterator p = rx_buffers.find(current_header.tid);
+            // compressed data is inflated into a buffer of its own
+            map<ceph_tid_t,pair<bufferlist,int> >::iterator p = rx_buffers.end();
+            if (!(current_header.reserved & CEPH_MSG_HEADER_DATA_COMPRESSED))
+              p = rx_buffers.find(current_header.tid);
             if (p != rx_buffers.end()) {
               ldout(async_msgr->cct,10) << __func__ << " seleting rx buffer v " << p->second.second
                                   << " at offset " << data_off
@@ -606,7 +616,8 @@ void AsyncConnection::process()
               data_blp = data_buf.begin();
             } else {
               ldout(async_msgr->cct,20) << __func__ << " allocating new rx buffer at offset " << data_off << dendl;
-              alloc_aligned_buffer(data_buf, data_len, data_off);
+              alloc_aligned_buffer(async_msgr->get_stack()->get_rx_buffer_pool(),
+                                   data_buf, data_len, data_off);
               data_blp = data_buf.begin();
             }
           }
@@ -678,6 +689,12 @@ void AsyncConnection::process()
 
           ldout(async_msgr->cct, 20) << __func__ << " got " << front.length() << " + " << middle.length()
                               << " + " << data.length() << " byte message" << dendl;
+          if (current_header.reserved &
+              (CEPH_MSG_HEADER_MIDDLE_COMPRESSED | CEPH_MSG_HEADER_DATA_COMPRESSED)) {
+            r = decompress_message(current_header);
+            if (r < 0)
+              goto fail;
+          }
           Message *message = decode_message(async_msgr->cct, async_msgr->crcflags, current_header, footer,
                                             front, middle, data, this);
           if (!message) {
@@ -1027,7 +1044,7 @@ ssize_t AsyncConnection::_process_connection()
           ldout(async_msgr->cct, 10) << __func__ <<  " connect_msg.authorizer_len="
                                      << connect_msg.authorizer_len << " protocol="
                                      << connect_msg.authorizer_protocol << dendl;
-        connect_msg.flags = 0;
+        connect_msg.flags = CEPH_MSG_CONNECT_COMPRESS;
         if (policy.lossy)
           connect_msg.flags |= CEPH_MSG_CONNECT_LOSSY;  // this is fyi, actually, server decides!
         bl.append((char*)&connect_msg, sizeof(connect_msg));
@@ -1160,6 +1177,7 @@ ssize_t AsyncConnection::_process_connection()
         assert(connect_seq == connect_reply.connect_seq);
         backoff = utime_t();
         set_features((uint64_t)connect_reply.features & (uint64_t)connect_msg.features);
+        setup_compression(connect_reply.flags & CEPH_MSG_CONNECT_COMPRESS);
         ldout(async_msgr->cct, 10) << __func__ << " connect success " << connect_seq
                                    << ", lossy = " << policy.lossy << ", features "
                                    << get_features() << dendl;
@@ -1790,8 +1808,12 @@ ssize_t AsyncConnection::handle_connect_msg(ceph_msg_connect &connect, bufferlis
   reply.authorizer_len = authorizer_reply.length();
   if (policy.lossy)
     reply.flags = reply.flags | CEPH_MSG_CONNECT_LOSSY;
+  // only answer peers that asked, older ones don't expect the flag
+  if (connect.flags & CEPH_MSG_CONNECT_COMPRESS)
+    reply.flags = reply.flags | CEPH_MSG_CONNECT_COMPRESS;
 
   set_features((uint64_t)reply.features & (uint64_t)connect.features);
+  setup_compression(connect.flags & CEPH_MSG_CONNECT_COMPRESS);
   ldout(async_msgr->cct, 10) << __func__ << " accept features " << get_features() << dendl;
 
   session_security.reset(
@@ -1928,22 +1950,32 @@ int AsyncConnection::send_message(Message *m)
   if (can_fast_prepare)
     prepare_send_message(f, m, bl);
 
-  std::lock_guard<std::mutex> l(write_lock);
-  // "features" changes will change the payload encoding
-  if (can_fast_prepare && (can_write == WriteStatus::NOWRITE || get_features() != f)) {
-    // ensure the correctness of message encoding
-    bl.clear();
-    m->get_payload().clear();
-    ldout(async_msgr->cct, 5) << __func__ << " clear encoded buffer previous "
-                              << f << " != " << get_features() << dendl;
-  }
   if (can_write == WriteStatus::CLOSED) {
     ldout(async_msgr->cct, 10) << __func__ << " connection closed."
                                << " Drop message " << m << dendl;
     m->put();
+    return 0;
+  }
+
+  // push without write_lock so that threads sending to the same peer do
+  // not contend; only the sender that finds the stack empty has to wake
+  // up the writer, the others ride along with that wakeup
+  m->trace.event("async enqueueing message");
+  IncomingMessage *in = new IncomingMessage{m, std::move(bl), f, nullptr};
+  IncomingMessage *head = incoming_q.load(std::memory_order_relaxed);
+  do {
+    in->next = head;
+  } while (!incoming_q.compare_exchange_weak(head, in,
+					     std::memory_order_release,
+					     std::memory_order_relaxed));
+  if (head)
+    return 0;
+
+  std::lock_guard<std::mutex> l(write_lock);
+  if (can_write == WriteStatus::CLOSED) {
+    // closed while we were pushing, nobody else will look at the stack
+    _drain_incoming();
   } else {
-    m->trace.event("async enqueueing message");
-    out_q[m->get_priority()].emplace_back(std::move(bl), m);
     ldout(async_msgr->cct, 15) << __func__ << " inline write is denied, reschedule m=" << m << dendl;
     if (can_write != WriteStatus::REPLACING)
       center->dispatch_event_external(write_handler);
@@ -1951,6 +1983,45 @@ int AsyncConnection::send_message(Message *m)
   return 0;
 }
 
+void AsyncConnection::_drain_incoming()
+{
+  IncomingMessage *in = incoming_q.exchange(nullptr, std::memory_order_acquire);
+  if (!in)
+    return;
+
+  // restore submission order
+  IncomingMessage *fifo = nullptr;
+  while (in) {
+    IncomingMessage *next = in->next;
+    in->next = fifo;
+    fifo = in;
+    in = next;
+  }
+
+  while (fifo) {
+    in = fifo;
+    fifo = fifo->next;
+    Message *m = in->m;
+    if (can_write == WriteStatus::CLOSED) {
+      ldout(async_msgr->cct, 10) << __func__ << " connection closed."
+                                 << " Drop message " << m << dendl;
+      m->put();
+    } else {
+      // "features" changes will change the payload encoding
+      if (in->bl.length() &&
+	  (can_write == WriteStatus::NOWRITE || get_features() != in->features)) {
+	// ensure the correctness of message encoding
+	in->bl.clear();
+	m->get_payload().clear();
+	ldout(async_msgr->cct, 5) << __func__ << " clear encoded buffer previous "
+				  << in->features << " != " << get_features() << dendl;
+      }
+      out_q[m->get_priority()].emplace_back(std::move(in->bl), m);
+    }
+    delete in;
+  }
+}
+
 void AsyncConnection::requeue_sent()
 {
   if (sent.empty())
@@ -2003,6 +2074,7 @@ void AsyncConnection::discard_out_queue()
     (*p)->put();
   }
   sent.clear();
+  _drain_incoming();
   for (map<int, list<pair<bufferlist, Message*> > >::iterator p = out_q.begin(); p != out_q.end(); ++p)
     for (list<pair<bufferlist, Message*> >::iterator r = p->second.begin(); r != p->second.end(); ++r) {
       ldout(async_msgr->cct, 20) << __func__ << " discard " << r->second << dendl;
@@ -2173,12 +2245,232 @@ void AsyncConnection::prepare_send_message(uint64_t features, Message *m, buffer
   bl.append(m->get_data());
 }
 
+void AsyncConnection::setup_compression(bool peer_can_decompress)
+{
+  tx_compressor.reset();
+  if (!peer_can_decompress)
+    return;
+
+  CephContext *cct = async_msgr->cct;
+  list<string> types;
+  get_str_list(cct->_conf->get_val<string>("ms_compress_peer_types"), types);
+  if (std::find(types.begin(), types.end(),
+		ceph_entity_type_name(peer_type)) == types.end())
+    return;
+
+  list<string> networks;
+  get_str_list(cct->_conf->get_val<string>("ms_compress_networks"), networks);
+  if (!networks.empty()) {
+    bool found = false;
+    for (auto& n : networks) {
+      struct sockaddr_storage net;
+      unsigned int prefix_len;
+      if (!parse_network(n.c_str(), &net, &prefix_len)) {
+	lderr(cct) << __func__ << " unable to parse network " << n
+		   << " in ms_compress_networks" << dendl;
+	continue;
+      }
+      if (network_contains((struct sockaddr*)&net, prefix_len,
+			   peer_addr.get_sockaddr())) {
+	found = true;
+	break;
+      }
+    }
+    if (!found)
+      return;
+  }
+
+  string alg = cct->_conf->get_val<string>("ms_compression_algorithm");
+  tx_compressor = Compressor::create(cct, alg);
+  if (!tx_compressor) {
+    lderr(cct) << __func__ << " unable to load compressor " << alg << dendl;
+    return;
+  }
+  tx_compress_min_size = cct->_conf->get_val<uint64_t>("ms_compress_min_size");
+  tx_compress_required_ratio =
+    cct->_conf->get_val<double>("ms_compress_required_ratio");
+  ldout(cct, 10) << __func__ << " compressing with " << alg
+		 << " for segments >= " << tx_compress_min_size << dendl;
+}
+
+bool AsyncConnection::compress_segment(bufferlist &seg)
+{
+  if (seg.length() < tx_compress_min_size)
+    return false;
+
+  bufferlist compressed;
+  int r = tx_compressor->compress(seg, compressed);
+  if (r < 0 ||
+      compressed.length() > seg.length() * tx_compress_required_ratio) {
+    ldout(async_msgr->cct, 20) << __func__ << " " << seg.length() << " -> "
+			       << compressed.length() << " r " << r
+			       << ", sending uncompressed" << dendl;
+    logger->inc(l_msgr_compress_rejected);
+    return false;
+  }
+
+  bufferlist out;
+  __u8 type = tx_compressor->get_type();
+  encode(type, out);
+  encode((uint32_t)seg.length(), out);
+  out.claim_append(compressed);
+  logger->inc(l_msgr_compress_in_bytes, seg.length());
+  logger->inc(l_msgr_compress_out_bytes, out.length());
+  seg.swap(out);
+  return true;
+}
+
+void AsyncConnection::compress_message(ceph_msg_header &header, bufferlist &bl)
+{
+  if (std::max<uint64_t>(header.middle_len, header.data_len) <
+      tx_compress_min_size)
+    return;
+
+  bufferlist front, middle, data;
+  bl.splice(0, header.front_len, &front);
+  bl.splice(0, header.middle_len, &middle);
+  data.claim(bl);
+
+  if (compress_segment(middle)) {
+    header.reserved = header.reserved | CEPH_MSG_HEADER_MIDDLE_COMPRESSED;
+    header.middle_len = middle.length();
+  }
+  if (compress_segment(data)) {
+    header.reserved = header.reserved | CEPH_MSG_HEADER_DATA_COMPRESSED;
+    header.data_len = data.length();
+  }
+
+  bl.claim_append(front);
+  bl.claim_append(middle);
+  bl.claim_append(data);
+}
+
+int AsyncConnection::decompress_segment(bufferlist &seg)
+{
+  __u8 type;
+  uint32_t len;
+  bufferlist::iterator p = seg.begin();
+  try {
+    decode(type, p);
+    decode(len, p);
+  } catch (buffer::error& e) {
+    ldout(async_msgr->cct, 1) << __func__ << " short compressed segment" << dendl;
+    return -EINVAL;
+  }
+
+  CompressorRef& c = rx_compressors[type];
+  if (!c) {
+    c = Compressor::create(async_msgr->cct, type);
+    if (!c) {
+      lderr(async_msgr->cct) << __func__ << " unable to load compressor "
+			     << Compressor::get_comp_alg_name(type) << dendl;
+      return -EOPNOTSUPP;
+    }
+  }
+
+  bufferlist out;
+  int r = c->decompress(p, seg.length() - p.get_off(), out);
+  if (r < 0 || out.length() != len) {
+    ldout(async_msgr->cct, 1) << __func__ << " failed to decompress " << len
+			      << " bytes with " << c->get_type_name()
+			      << ": r " << r << " got " << out.length() << dendl;
+    return r < 0 ? r : -EINVAL;
+  }
+  logger->inc(l_msgr_decompress_bytes, out.length());
+  seg.swap(out);
+  return 0;
+}
+
+int AsyncConnection::get_raw_segment_len(bufferlist &seg, uint32_t *len)
+{
+  __u8 type;
+  bufferlist::iterator p = seg.begin();
+  try {
+    decode(type, p);
+    decode(*len, p);
+  } catch (buffer::error& e) {
+    ldout(async_msgr->cct, 1) << __func__ << " short compressed segment" << dendl;
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int AsyncConnection::decompress_message(ceph_msg_header &header)
+{
+  // the throttles were charged the compressed length; don't inflate past
+  // what they would admit in the first place
+  uint64_t raw_len = header.front_len;
+  for (auto seg : { make_pair(CEPH_MSG_HEADER_MIDDLE_COMPRESSED, &middle),
+		    make_pair(CEPH_MSG_HEADER_DATA_COMPRESSED, &data) }) {
+    if (header.reserved & seg.first) {
+      uint32_t len;
+      int r = get_raw_segment_len(*seg.second, &len);
+      if (r < 0)
+	return r;
+      raw_len += len;
+    } else {
+      raw_len += seg.second->length();
+    }
+  }
+  uint64_t max = dispatch_queue->dispatch_throttler.get_max();
+  if (policy.throttler_bytes && policy.throttler_bytes->get_max() > 0 &&
+      (max == 0 || (uint64_t)policy.throttler_bytes->get_max() < max))
+    max = policy.throttler_bytes->get_max();
+  if (max && raw_len > max) {
+    ldout(async_msgr->cct, 1) << __func__ << " message would inflate to "
+			      << raw_len << " bytes, over the " << max
+			      << " byte limit" << dendl;
+    return -EMSGSIZE;
+  }
+
+  if (header.reserved & CEPH_MSG_HEADER_MIDDLE_COMPRESSED) {
+    int r = decompress_segment(middle);
+    if (r < 0)
+      return r;
+    header.middle_len = middle.length();
+  }
+  if (header.reserved & CEPH_MSG_HEADER_DATA_COMPRESSED) {
+    int r = decompress_segment(data);
+    if (r < 0)
+      return r;
+    if (data.length()) {
+      // restore the page alignment the sender asked for
+      bufferlist aligned;
+      alloc_aligned_buffer(async_msgr->get_stack()->get_rx_buffer_pool(),
+			   aligned, data.length(), le32_to_cpu(header.data_off));
+      aligned.copy_in(0, data.length(), data);
+      data.swap(aligned);
+    }
+    header.data_len = data.length();
+  }
+  header.reserved = 0;
+
+  // charge the throttles for what the message grew by
+  uint64_t msg_size = front.length() + middle.length() + data.length();
+  if (msg_size > cur_msg_size) {
+    uint64_t extra = msg_size - cur_msg_size;
+    ldout(async_msgr->cct, 10) << __func__ << " taking " << extra
+			       << " more bytes for the inflated message" << dendl;
+    if (policy.throttler_bytes)
+      policy.throttler_bytes->take(extra);
+    dispatch_queue->dispatch_throttler.take(extra);
+    cur_msg_size = msg_size;
+  }
+  return 0;
+}
+
 ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
 {
   FUNCTRACE(async_msgr->cct);
   assert(center->in_thread());
   m->set_seq(++out_seq);
 
+  // the segment lengths come fresh from prepare_send_message(), but the
+  // flags may be left over from an earlier, compressed, send
+  m->get_header().reserved = 0;
+  if (tx_compressor)
+    compress_message(m->get_header(), bl);
+
   if (msgr->crcflags & MSG_CRC_HEADER)
     m->calc_header_crc();
 
@@ -2212,13 +2504,15 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
                              << " data=" << header.data_len
                              << " off " << header.data_off << dendl;
 
-  if ((bl.length() <= ASYNC_COALESCE_THRESHOLD) && (bl.buffers().size() > 1)) {
-    for (const auto &pb : bl.buffers()) {
+  // copy small segments so that a batch of small messages goes out as
+  // a few contiguous iovecs
+  for (const auto &pb : bl.buffers()) {
+    if (pb.length() <= ASYNC_COALESCE_THRESHOLD)
       outcoming_bl.append((char*)pb.c_str(), pb.length());
-    }
-  } else {
-    outcoming_bl.claim_append(bl);  
+    else
+      outcoming_bl.append(pb);
   }
+  bl.clear();
 
   // send footer; if receiver doesn't support signatures, use the old footer format
   ceph_msg_footer_old old_footer;
@@ -2238,16 +2532,22 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
   }
 
   m->trace.event("async writing message");
-  ldout(async_msgr->cct, 20) << __func__ << " sending " << m->get_seq()
-                             << " " << m << dendl;
-  ssize_t total_send_size = outcoming_bl.length();
-  ssize_t rc = _try_send(more);
-  if (rc < 0) {
-    ldout(async_msgr->cct, 1) << __func__ << " error sending " << m << ", "
-                              << cpp_strerror(rc) << dendl;
+  ssize_t rc = 0;
+  if (more && outcoming_bl.length() < send_batch_bytes) {
+    // more messages are queued, the caller will flush the batch
+    ldout(async_msgr->cct, 20) << __func__ << " batching " << m->get_seq()
+                               << " " << m << ", " << outcoming_bl.length()
+                               << " bytes queued" << dendl;
   } else {
-    logger->inc(l_msgr_send_bytes, total_send_size - outcoming_bl.length());
-    ldout(async_msgr->cct, 10) << __func__ << " sending " << m << (rc ? " continuely." :" done.") << dendl;
+    ldout(async_msgr->cct, 20) << __func__ << " sending " << m->get_seq()
+                               << " " << m << dendl;
+    rc = _try_send(more);
+    if (rc < 0) {
+      ldout(async_msgr->cct, 1) << __func__ << " error sending " << m << ", "
+                                << cpp_strerror(rc) << dendl;
+    } else {
+      ldout(async_msgr->cct, 10) << __func__ << " sending " << m << (rc ? " continuely." :" done.") << dendl;
+    }
   }
   if (m->get_type() == CEPH_MSG_OSD_OP)
     OID_EVENT_TRACE_WITH_MSG(m, "SEND_MSG_OSD_OP_END", false);
@@ -2421,7 +2721,8 @@ void AsyncConnection::handle_write()
         sent.push_back(m);
         m->get();
       }
-      more = _has_next_outgoing();
+      // a pending ack can ride along with the last batch
+      more = _has_next_outgoing() || ack_left;
       write_lock.unlock();
 
       // send_message or requeue messages may not encode message
@@ -2442,6 +2743,7 @@ void AsyncConnection::handle_write()
     write_lock.unlock();
 
     // if r > 0 mean data still lefted, so no need _try_send.
+    // otherwise flush the last batch, together with the ack if any
     if (r == 0) {
       uint64_t left = ack_left;
       if (left) {
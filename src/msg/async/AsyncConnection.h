@@ -27,6 +27,7 @@
 #include "auth/AuthSessionHandler.h"
 #include "common/ceph_time.h"
 #include "common/perf_counters.h"
+#include "compressor/Compressor.h"
 #include "include/buffer.h"
 #include "msg/Connection.h"
 #include "msg/Messenger.h"
@@ -73,6 +74,12 @@ class AsyncConnection : public Connection {
   void handle_ack(uint64_t seq);
   void _append_keepalive_or_ack(bool ack=false, utime_t *t=NULL);
   ssize_t write_message(Message *m, bufferlist& bl, bool more);
+  void setup_compression(bool peer_can_decompress);
+  bool compress_segment(bufferlist &seg);
+  void compress_message(ceph_msg_header &header, bufferlist &bl);
+  int get_raw_segment_len(bufferlist &seg, uint32_t *len);
+  int decompress_segment(bufferlist &seg);
+  int decompress_message(ceph_msg_header &header);
   void inject_delay();
   ssize_t _reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
                     bufferlist &authorizer_reply) {
@@ -94,7 +101,7 @@ class AsyncConnection : public Connection {
     return 0;
   }
   bool is_queued() const {
-    return !out_q.empty() || outcoming_bl.length();
+    return !out_q.empty() || incoming_q.load() || outcoming_bl.length();
   }
   void shutdown_socket() {
     for (auto &&t : register_time_events)
@@ -110,8 +117,10 @@ class AsyncConnection : public Connection {
       cs.close();
     }
   }
+  void _drain_incoming();
   Message *_get_next_outgoing(bufferlist *bl) {
     Message *m = 0;
+    _drain_incoming();
     if (!out_q.empty()) {
       map<int, list<pair<bufferlist, Message*> > >::reverse_iterator it = out_q.rbegin();
       assert(!it->second.empty());
@@ -126,7 +135,7 @@ class AsyncConnection : public Connection {
     return m;
   }
   bool _has_next_outgoing() const {
-    return !out_q.empty();
+    return !out_q.empty() || incoming_q.load();
   }
   void reset_recv_state();
 
@@ -304,6 +313,16 @@ class AsyncConnection : public Connection {
   // lockfree, only used in own thread
   bufferlist outcoming_bl;
   bool open_write = false;
+  // queued messages are gathered into outcoming_bl up to this many bytes
+  // before a send, see write_message()
+  uint64_t send_batch_bytes = 0;
+
+  // wire compression of middle and data segments, set up by
+  // setup_compression() once the handshake completes
+  CompressorRef tx_compressor;
+  uint64_t tx_compress_min_size = 0;
+  double tx_compress_required_ratio = 1.0;
+  map<int, CompressorRef> rx_compressors;
 
   std::mutex write_lock;
   enum class WriteStatus {
@@ -315,6 +334,16 @@ class AsyncConnection : public Connection {
   std::atomic<WriteStatus> can_write;
   list<Message*> sent; // the first bufferlist need to inject seq
   map<int, list<pair<bufferlist, Message*> > > out_q;  // priority queue for outbound msgs
+  /// a message handed to send_message(), waiting to be moved to out_q
+  struct IncomingMessage {
+    Message *m;
+    bufferlist bl;
+    uint64_t features; ///< features bl was encoded with, if any
+    IncomingMessage *next;
+  };
+  /// lock-free stack of messages from send_message(), newest first.
+  /// senders only push; whoever holds write_lock drains it into out_q
+  std::atomic<IncomingMessage*> incoming_q = {nullptr};
   bool keepalive;
 
   std::mutex lock;
@@ -137,6 +137,17 @@ int EventCenter::init(int n, unsigned i, const std::string &t)
   file_events.resize(n);
   nevent = n;
 
+  uint64_t busy_poll_us = cct->_conf->get_val<uint64_t>("ms_async_busy_poll_us");
+  if (busy_poll_us) {
+    uint64_t pct = std::min<uint64_t>(
+      100, cct->_conf->get_val<uint64_t>("ms_async_busy_poll_budget"));
+    busy_poll_window = std::chrono::microseconds(busy_poll_us);
+    busy_poll_budget = std::chrono::milliseconds(pct * 10);
+    busy_poll_period_start = ceph::mono_clock::now();
+    ldout(cct, 10) << __func__ << " busy poll " << busy_poll_us
+		   << "us, budget " << pct << "%" << dendl;
+  }
+
   if (!driver->need_wakeup())
     return 0;
 
@@ -244,6 +255,9 @@ int EventCenter::create_file_event(int fd, int mask, EventCallbackRef ctxt)
   if (mask & EVENT_WRITABLE) {
     event->write_cb = ctxt;
   }
+  if (mask & EVENT_ERROR) {
+    event->err_cb = ctxt;
+  }
   ldout(cct, 20) << __func__ << " create event end fd=" << fd << " mask=" << mask
                  << " original mask is " << event->mask << dendl;
   return 0;
@@ -275,6 +289,9 @@ void EventCenter::delete_file_event(int fd, int mask)
   if (mask & EVENT_WRITABLE && event->write_cb) {
     event->write_cb = nullptr;
   }
+  if (mask & EVENT_ERROR && event->err_cb) {
+    event->err_cb = nullptr;
+  }
 
   event->mask = event->mask & (~mask);
   ldout(cct, 30) << __func__ << " delete event end fd=" << fd << " mask=" << mask
@@ -320,6 +337,14 @@ void EventCenter::wakeup()
   // No need to wake up since we never sleep
   if (!pollers.empty() || !driver->need_wakeup())
     return ;
+  // or aren't sleeping now.  Leave a note before rechecking the flag:
+  // either we see it cleared and write the pipe, or process_events()
+  // sees the note after clearing it and doesn't block.
+  if (spinning.load()) {
+    wakeup_skipped.store(true);
+    if (spinning.load())
+      return ;
+  }
 
   ldout(cct, 20) << __func__ << dendl;
   char buf = 'c';
@@ -358,6 +383,15 @@ int EventCenter::process_time_events()
   return processed;
 }
 
+bool EventCenter::should_busy_poll(ceph::mono_time now)
+{
+  if (now - busy_poll_period_start >= std::chrono::seconds(1)) {
+    busy_poll_period_start = now;
+    busy_poll_spent = ceph::timespan::zero();
+  }
+  return now < busy_poll_until && busy_poll_spent < busy_poll_budget;
+}
+
 int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *working_dur)
 {
   struct timeval tv;
@@ -367,6 +401,22 @@ int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *
 
   auto it = time_events.begin();
   bool blocking = pollers.empty() && !external_num_events.load();
+  bool busy_polling = false;
+  ceph::mono_time poll_start;
+  if (blocking && busy_poll_window != ceph::timespan::zero()) {
+    poll_start = ceph::mono_clock::now();
+    if (should_busy_poll(poll_start)) {
+      spinning.store(true);
+      busy_polling = true;
+      blocking = false;
+    } else if (spinning.load()) {
+      spinning.store(false);
+      // a wakeup() skipped while we were spinning must not be lost,
+      // whether it was for an external event or e.g. a worker stop
+      bool skipped = wakeup_skipped.exchange(false);
+      blocking = !external_num_events.load() && !skipped;
+    }
+  }
   // If exists external events or poller, don't block
   if (!blocking) {
     if (it != time_events.end() && now >= it->first)
@@ -419,6 +469,11 @@ int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *
       }
     }
 
+    if (event->mask & fired_events[j].mask & EVENT_ERROR) {
+      cb = event->err_cb;
+      cb->do_request(fired_events[j].fd);
+    }
+
     ldout(cct, 30) << __func__ << " event_wq process is " << fired_events[j].fd << " mask is " << fired_events[j].mask << dendl;
   }
 
@@ -445,6 +500,16 @@ int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *
       numevents += pollers[i]->poll();
   }
 
+  if (busy_poll_window != ceph::timespan::zero()) {
+    auto end = ceph::mono_clock::now();
+    if (numevents > 0) {
+      busy_poll_until = end + busy_poll_window;
+    } else if (busy_polling) {
+      busy_poll_spent += end - poll_start;
+      busy_poll_unreported += end - poll_start;
+    }
+  }
+
   if (working_dur)
     *working_dur = ceph::mono_clock::now() - working_start;
   return numevents;
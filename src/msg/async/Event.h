@@ -48,6 +48,8 @@
 #define EVENT_NONE 0
 #define EVENT_READABLE 1
 #define EVENT_WRITABLE 2
+/// pending socket error or error queue entry; only reported by epoll
+#define EVENT_ERROR 4
 
 class EventCenter;
 
@@ -103,7 +105,8 @@ class EventCenter {
     int mask;
     EventCallbackRef read_cb;
     EventCallbackRef write_cb;
-    FileEvent(): mask(0), read_cb(NULL), write_cb(NULL) {}
+    EventCallbackRef err_cb;
+    FileEvent(): mask(0), read_cb(NULL), write_cb(NULL), err_cb(NULL) {}
   };
 
   struct TimeEvent {
@@ -175,7 +178,24 @@ class EventCenter {
   unsigned idx;
   AssociatedCenters *global_centers = nullptr;
 
+  // Adaptive busy polling: after doing some work, keep polling without
+  // blocking for busy_poll_window so that the next request doesn't pay
+  // for a kernel sleep/wakeup.  Idle spinning is limited to
+  // busy_poll_budget out of every second.
+  ceph::timespan busy_poll_window = ceph::timespan::zero();
+  ceph::timespan busy_poll_budget = ceph::timespan::zero();
+  ceph::mono_time busy_poll_until;
+  ceph::mono_time busy_poll_period_start;
+  ceph::timespan busy_poll_spent = ceph::timespan::zero();
+  ceph::timespan busy_poll_unreported = ceph::timespan::zero();
+  // set while spinning, external threads needn't write the notify pipe
+  std::atomic_bool spinning = { false };
+  // a wakeup() that skipped the notify pipe because we were spinning;
+  // consumed when spinning stops, before deciding to block
+  std::atomic_bool wakeup_skipped = { false };
+
   int process_time_events();
+  bool should_busy_poll(ceph::mono_time now);
   FileEvent *_get_file_event(int fd) {
     assert(fd < nevent);
     return &file_events[fd];
@@ -205,6 +225,12 @@ class EventCenter {
   void delete_time_event(uint64_t id);
   int process_events(unsigned timeout_microseconds, ceph::timespan *working_dur = nullptr);
   void wakeup();
+  /// idle busy-poll time accumulated since the last call
+  ceph::timespan take_busy_poll_time() {
+    ceph::timespan t = busy_poll_unreported;
+    busy_poll_unreported = ceph::timespan::zero();
+    return t;
+  }
 
   // Used by external thread
   void dispatch_event_external(EventCallbackRef e);
@@ -55,6 +55,7 @@ int EpollDriver::add_event(int fd, int cur_mask, int add_mask)
 
   ee.events = EPOLLET;
   add_mask |= cur_mask; /* Merge old events */
+  /* EVENT_ERROR needs no flag, epoll always reports EPOLLERR */
   if (add_mask & EVENT_READABLE)
     ee.events |= EPOLLIN;
   if (add_mask & EVENT_WRITABLE)
@@ -123,7 +124,7 @@ int EpollDriver::event_wait(vector<FiredFileEvent> &fired_events, struct timeval
 
       if (e->events & EPOLLIN) mask |= EVENT_READABLE;
       if (e->events & EPOLLOUT) mask |= EVENT_WRITABLE;
-      if (e->events & EPOLLERR) mask |= EVENT_READABLE|EVENT_WRITABLE;
+      if (e->events & EPOLLERR) mask |= EVENT_READABLE|EVENT_WRITABLE|EVENT_ERROR;
       if (e->events & EPOLLHUP) mask |= EVENT_READABLE|EVENT_WRITABLE;
       fired_events[j].fd = e->data.fd;
       fired_events[j].mask = mask;
@@ -22,7 +22,13 @@
 
 #include <algorithm>
 
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define HAVE_MSG_ZEROCOPY 1
+#endif
+
 #include "PosixStack.h"
+#include "ZeroCopyTracker.h"
 
 #include "include/buffer.h"
 #include "include/str_list.h"
@@ -36,15 +42,163 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "PosixStack "
 
+/**
+ * Reads MSG_ZEROCOPY completions off a socket's error queue
+ *
+ * The reaper is registered with the worker's EventCenter for EVENT_ERROR on
+ * the socket, so completions are picked up as they arrive whether or not
+ * the connection is reading.  It also owns the fd once the connection
+ * closes with sends still in flight: a closed socket's error queue can not
+ * be read, so there would be no telling when the kernel lets go of pages
+ * it is transmitting from.  Instead the socket stops sending, which lets
+ * the peer ack what is in flight, and stays open in the background for up
+ * to ms_async_zerocopy_linger_ms.  Buffers still outstanding after that are
+ * deliberately leaked: memory that is never freed can not be reused while a
+ * nic is still reading it.
+ */
+class PosixZeroCopyReaper : public EventCallback {
+  CephContext *cct;
+  PerfCounters *logger;
+  EventCenter *center;
+  int fd;
+  uint64_t linger_event = 0;
+
+  class C_linger_expired : public EventCallback {
+    PosixZeroCopyReaper *reaper;
+  public:
+    explicit C_linger_expired(PosixZeroCopyReaper *r) : reaper(r) {}
+    void do_request(uint64_t id) override {
+      reaper->linger_event = 0;
+      reaper->finish();
+    }
+  } linger_expired;
+
+  void finish() {
+    if (!pins.empty()) {
+      ldout(cct, 1) << __func__ << " fd " << fd << " closing with "
+		    << pins.size() << " zerocopy sends outstanding, "
+		    << "leaking their buffers" << dendl;
+      bufferlist *leaked = new bufferlist;
+      pins.release_all(leaked);
+    }
+    if (linger_event)
+      center->delete_time_event(linger_event);
+    center->delete_file_event(fd, EVENT_ERROR);
+    ::close(fd);
+    delete this;
+  }
+
+public:
+  /// sent data the kernel may still be reading
+  ZeroCopyTracker pins;
+  /// the kernel copied a zerocopy send instead
+  bool kernel_copied = false;
+
+  PosixZeroCopyReaper(CephContext *cct, PerfCounters *logger,
+		      EventCenter *center, int fd)
+    : cct(cct), logger(logger), center(center), fd(fd),
+      linger_expired(this) {
+    center->create_file_event(fd, EVENT_ERROR, this);
+  }
+
+  /// drop pins on buffers the kernel is done with
+  void reap() {
+#ifdef HAVE_MSG_ZEROCOPY
+    while (true) {
+      char control[128];
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+	break;
+      for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+	   cm = CMSG_NXTHDR(&msg, cm)) {
+	if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+	    !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+	  continue;
+	struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+	if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+	  continue;
+	bool copied = serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED;
+	if (copied && !kernel_copied) {
+	  // e.g. loopback or a nic without scatter-gather: we pay for
+	  // pinning and notifications and still get a copy
+	  ldout(cct, 10) << __func__ << " fd " << fd << " kernel copied "
+			 << "zerocopy send, disabling zerocopy" << dendl;
+	  logger->inc(l_msgr_send_zerocopy_copied);
+	  kernel_copied = true;
+	}
+	pins.complete(serr->ee_info, serr->ee_data, copied);
+      }
+    }
+#endif
+  }
+
+  void do_request(uint64_t fd_or_id) override {
+    reap();
+    if (linger_event && pins.empty())
+      finish();
+  }
+
+  /// the connection is done with the socket; close it once pins drain
+  void close() {
+    reap();
+    if (pins.empty()) {
+      finish();
+      return;
+    }
+    ::shutdown(fd, SHUT_WR);
+    // the connection's events left ours level triggered; re-add it alone
+    center->delete_file_event(fd, EVENT_ERROR);
+    center->create_file_event(fd, EVENT_ERROR, this);
+    linger_event = center->create_time_event(
+      cct->_conf->get_val<uint64_t>("ms_async_zerocopy_linger_ms") * 1000,
+      &linger_expired);
+    ldout(cct, 10) << __func__ << " fd " << fd << " lingering for "
+		   << pins.size() << " zerocopy sends" << dendl;
+  }
+};
+
 class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   NetHandler &handler;
   int _fd;
   entity_addr_t sa;
   bool connected;
+  CephContext *cct;
+  PerfCounters *logger;
+  EventCenter *center;
+
+  /// sendmsg batches carrying a buffer at least this large go out with
+  /// MSG_ZEROCOPY; 0 if disabled
+  uint64_t zc_threshold = 0;
+  /// created with the first zerocopy send
+  PosixZeroCopyReaper *zc = nullptr;
+
+  void zc_pin(unsigned calls, bufferlist& bl) {
+    if (!zc)
+      zc = new PosixZeroCopyReaper(cct, logger, center, _fd);
+    zc->pins.pin(calls, bl);
+  }
 
  public:
-  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected)
-      : handler(h), _fd(f), sa(sa), connected(connected) {}
+  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected,
+				    Worker *w)
+      : handler(h), _fd(f), sa(sa), connected(connected),
+	cct(w->cct), logger(w->perf_logger), center(&w->center) {
+#ifdef HAVE_MSG_ZEROCOPY
+    zc_threshold = cct->_conf->get_val<uint64_t>("ms_async_zerocopy_threshold");
+    if (zc_threshold) {
+      int one = 1;
+      if (::setsockopt(_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+	int r = -errno;
+	ldout(cct, 5) << __func__ << " SO_ZEROCOPY unavailable on fd " << _fd
+		      << ": " << cpp_strerror(r) << dendl;
+	zc_threshold = 0;
+      }
+    }
+#endif
+  }
 
   int is_connected() override {
     if (connected)
@@ -74,13 +228,15 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 
   // return the sent length
   // < 0 means error occurred
-  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more)
+  // *calls counts the sendmsg calls that succeeded
+  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more,
+			    int flags, unsigned *calls)
   {
     size_t sent = 0;
     while (1) {
       MSGR_SIGPIPE_STOPPER;
       ssize_t r;
-      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0) | flags);
       if (r < 0) {
         if (errno == EINTR) {
           continue;
@@ -90,6 +246,7 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         return -errno;
       }
 
+      ++*calls;
       sent += r;
       if (len == sent) break;
 
@@ -110,7 +267,14 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t send(bufferlist &bl, bool more) override {
+    if (zc) {
+      zc->reap();
+      if (zc->kernel_copied)
+	zc_threshold = 0;
+    }
+
     size_t sent_bytes = 0;
+    unsigned zc_calls = 0;
     std::list<bufferptr>::const_iterator pb = bl.buffers().begin();
     uint64_t left_pbrs = bl.buffers().size();
     while (left_pbrs) {
@@ -122,15 +286,37 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
       msg.msg_iovlen = size;
       msg.msg_iov = msgvec;
       unsigned msglen = 0;
+      bool zc = false;
       for (auto iov = msgvec; iov != msgvec + size; iov++) {
 	iov->iov_base = (void*)(pb->c_str());
 	iov->iov_len = pb->length();
 	msglen += pb->length();
+	if (zc_threshold && pb->length() >= zc_threshold)
+	  zc = true;
 	++pb;
       }
-      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more);
-      if (r < 0)
+      int flags = 0;
+      unsigned calls = 0;
+#ifdef HAVE_MSG_ZEROCOPY
+      if (zc)
+	flags |= MSG_ZEROCOPY;
+#endif
+      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more, flags,
+			     &calls);
+      if (zc) {
+	zc_calls += calls;
+	if (r > 0)
+	  logger->inc(l_msgr_send_zerocopy_bytes, r);
+      }
+      if (r < 0) {
+	// the kernel may already be reading some of this from earlier
+	// calls; hold on to all of it, the connection is going down anyway
+	if (zc_calls) {
+	  bufferlist pinned(bl);
+	  zc_pin(zc_calls, pinned);
+	}
         return r;
+      }
 
       // "r" is the remaining length
       sent_bytes += r;
@@ -143,10 +329,12 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
       bufferlist swapped;
       if (sent_bytes < bl.length()) {
         bl.splice(sent_bytes, bl.length()-sent_bytes, &swapped);
-        bl.swap(swapped);
-      } else {
-        bl.clear();
       }
+      bl.swap(swapped);
+      // swapped now holds what went out; keep it until the kernel is done
+      // with it if any of it was sent zerocopy
+      if (zc_calls)
+	zc_pin(zc_calls, swapped);
     }
 
     return static_cast<ssize_t>(sent_bytes);
@@ -155,7 +343,15 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     ::shutdown(_fd, SHUT_RDWR);
   }
   void close() override {
-    ::close(_fd);
+    if (!zc) {
+      ::close(_fd);
+    } else if (center->in_thread()) {
+      zc->close();
+    } else {
+      PosixZeroCopyReaper *reaper = zc;
+      center->submit_to(center->get_id(), [reaper]() { reaper->close(); },
+			true);
+    }
   }
   int fd() const override {
     return _fd;
@@ -206,7 +402,7 @@ int PosixServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &op
   out->set_sockaddr((sockaddr*)&ss);
   handler.set_priority(sd, opt.priority, out->get_family());
 
-  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true));
+  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true, w));
   *sock = ConnectedSocket(std::move(csi));
   return 0;
 }
@@ -274,7 +470,7 @@ int PosixWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, C
 
   net.set_priority(sd, opts.priority, addr.get_family());
   *socket = ConnectedSocket(
-      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock)));
+      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock, this)));
   return 0;
 }
 
@@ -292,3 +488,27 @@ PosixNetworkStack::PosixNetworkStack(CephContext *c, const string &t)
       lderr(cct) << __func__ << " failed to parse " << corestr << " in " << cct->_conf->ms_async_affinity_cores << dendl;
   }
 }
+
+void PosixNetworkStack::spawn_worker(unsigned i, std::function<void ()> &&func)
+{
+  threads.resize(i+1);
+  threads[i] = std::thread(func);
+#ifdef __linux__
+  // pin the worker so that a busy-polling thread keeps its core and
+  // its cache warm
+  int cpuid = get_cpuid(i);
+  if (cpuid >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpuid, &cpuset);
+    int r = pthread_setaffinity_np(threads[i].native_handle(),
+				   sizeof(cpuset), &cpuset);
+    if (r)
+      lderr(cct) << __func__ << " failed to bind worker " << i << " to cpu "
+		 << cpuid << ": " << cpp_strerror(r) << dendl;
+    else
+      ldout(cct, 10) << __func__ << " worker " << i << " bound to cpu "
+		     << cpuid << dendl;
+  }
+#endif
+}
@@ -47,10 +47,7 @@ class PosixNetworkStack : public NetworkStack {
       return -1;
     return coreids[id % coreids.size()];
   }
-  void spawn_worker(unsigned i, std::function<void ()> &&func) override {
-    threads.resize(i+1);
-    threads[i] = std::thread(func);
-  }
+  void spawn_worker(unsigned i, std::function<void ()> &&func) override;
   void join_worker(unsigned i) override {
     assert(threads.size() > i && threads[i].joinable());
     threads[i].join();
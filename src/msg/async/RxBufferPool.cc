@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "RxBufferPool.h"
+
+#include "common/ceph_context.h"
+#include "common/deleter.h"
+#include "common/dout.h"
+#include "include/intarith.h"
+#include "include/page.h"
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix *_dout << "RxBufferPool "
+
+// allocations are rounded to this so a steady stream of similar sized
+// messages reuses the same free list
+static const size_t RX_POOL_GRANULARITY = 64 * 1024;
+
+RxBufferPool::RxBufferPool(CephContext *c)
+  : cct(c),
+    min_size(c->_conf->get_val<uint64_t>("ms_async_rx_buffer_pool_min_size")),
+    max_cached(c->_conf->get_val<uint64_t>("ms_async_rx_buffer_pool_size"))
+{
+}
+
+RxBufferPool::~RxBufferPool()
+{
+  for (auto& p : free_bufs)
+    for (auto b : p.second)
+      ::free(b);
+}
+
+ceph::bufferptr RxBufferPool::get(unsigned len)
+{
+  if (!max_cached || len < min_size)
+    return ceph::bufferptr(ceph::buffer::create_page_aligned(len));
+
+  size_t alloc_len = round_up_to<size_t>(len, RX_POOL_GRANULARITY);
+  char *p = nullptr;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    auto i = free_bufs.find(alloc_len);
+    if (i != free_bufs.end()) {
+      p = i->second.back();
+      i->second.pop_back();
+      if (i->second.empty())
+	free_bufs.erase(i);
+      cached -= alloc_len;
+    }
+  }
+  if (!p) {
+    void *v;
+    int r = ::posix_memalign(&v, CEPH_PAGE_SIZE, alloc_len);
+    if (r)
+      throw ceph::buffer::bad_alloc();
+    p = static_cast<char*>(v);
+    ldout(cct, 20) << __func__ << " allocated " << alloc_len << dendl;
+  }
+
+  // the deleter holds a ref, so buffers can outlive the messenger
+  std::shared_ptr<RxBufferPool> pool = shared_from_this();
+  ceph::bufferptr bp(ceph::buffer::claim_buffer(
+		       alloc_len, p,
+		       make_deleter([pool, p, alloc_len] {
+			   pool->put(p, alloc_len);
+			 })));
+  bp.set_length(len);
+  return bp;
+}
+
+void RxBufferPool::put(char *p, size_t alloc_len)
+{
+  {
+    std::lock_guard<std::mutex> l(lock);
+    if (cached + alloc_len <= max_cached) {
+      free_bufs[alloc_len].push_back(p);
+      cached += alloc_len;
+      return;
+    }
+  }
+  ::free(p);
+}
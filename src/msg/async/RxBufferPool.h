@@ -0,0 +1,58 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_ASYNC_RXBUFFERPOOL_H
+#define CEPH_MSG_ASYNC_RXBUFFERPOOL_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "include/buffer.h"
+
+class CephContext;
+
+/**
+ * Recycles the page aligned buffers message data segments are read into.
+ *
+ * Large data segments (replication and recovery writes) would otherwise
+ * be a fresh page aligned allocation per message, and a fresh set of page
+ * faults when the kernel copies into them.  Buffers handed out here go
+ * back to a free list, bounded in bytes, when the last bufferptr
+ * referencing them is dropped, from whatever thread that happens on.
+ */
+class RxBufferPool : public std::enable_shared_from_this<RxBufferPool> {
+  CephContext *cct;
+  const size_t min_size;   ///< smaller requests bypass the pool
+  const size_t max_cached; ///< bytes kept on the free lists
+
+  std::mutex lock;
+  std::map<size_t, std::vector<char*>> free_bufs; ///< by allocation size
+  size_t cached = 0;
+
+  void put(char *p, size_t alloc_len);
+
+ public:
+  explicit RxBufferPool(CephContext *c);
+  ~RxBufferPool();
+
+  /// a page aligned buffer of len bytes
+  ceph::bufferptr get(unsigned len);
+
+  size_t get_cached_bytes() {
+    std::lock_guard<std::mutex> l(lock);
+    return cached;
+  }
+};
+
+#endif
@@ -57,6 +57,9 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
           // TODO do something?
         }
         w->perf_logger->tinc(l_msgr_running_total_time, dur);
+        ceph::timespan polled = w->center.take_busy_poll_time();
+        if (polled != ceph::timespan::zero())
+          w->perf_logger->tinc(l_msgr_busy_poll_time, polled);
       }
       w->reset();
       w->destroy();
@@ -101,7 +104,9 @@ Worker* NetworkStack::create_worker(CephContext *c, const string &type, unsigned
   return nullptr;
 }
 
-NetworkStack::NetworkStack(CephContext *c, const string &t): type(t), started(false), cct(c)
+NetworkStack::NetworkStack(CephContext *c, const string &t)
+  : type(t), started(false), rx_buffer_pool(std::make_shared<RxBufferPool>(c)),
+    cct(c)
 {
   assert(cct->_conf->ms_async_op_threads > 0);
 
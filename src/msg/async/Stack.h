@@ -21,6 +21,7 @@
 #include "common/perf_counters.h"
 #include "msg/msg_types.h"
 #include "msg/async/Event.h"
+#include "msg/async/RxBufferPool.h"
 
 class Worker;
 class ConnectedSocketImpl {
@@ -198,6 +199,16 @@ enum {
   l_msgr_running_recv_time,
   l_msgr_running_fast_dispatch_time,
 
+  l_msgr_send_zerocopy_bytes,
+  l_msgr_send_zerocopy_copied,
+
+  l_msgr_busy_poll_time,
+
+  l_msgr_compress_in_bytes,
+  l_msgr_compress_out_bytes,
+  l_msgr_compress_rejected,
+  l_msgr_decompress_bytes,
+
   l_msgr_last,
 };
 
@@ -238,6 +249,16 @@ class Worker {
     plb.add_time(l_msgr_running_recv_time, "msgr_running_recv_time", "The total time of message receiving");
     plb.add_time(l_msgr_running_fast_dispatch_time, "msgr_running_fast_dispatch_time", "The total time of fast dispatch");
 
+    plb.add_u64_counter(l_msgr_send_zerocopy_bytes, "msgr_send_zerocopy_bytes", "Network bytes sent with MSG_ZEROCOPY", NULL, 0, unit_t(BYTES));
+    plb.add_u64_counter(l_msgr_send_zerocopy_copied, "msgr_send_zerocopy_copied", "MSG_ZEROCOPY sends the kernel copied anyway");
+
+    plb.add_time(l_msgr_busy_poll_time, "msgr_busy_poll_time", "The total time spent busy polling without finding work");
+
+    plb.add_u64_counter(l_msgr_compress_in_bytes, "msgr_compress_in_bytes", "Message segment bytes sent compressed, before compression", NULL, 0, unit_t(BYTES));
+    plb.add_u64_counter(l_msgr_compress_out_bytes, "msgr_compress_out_bytes", "Message segment bytes sent compressed, after compression", NULL, 0, unit_t(BYTES));
+    plb.add_u64_counter(l_msgr_compress_rejected, "msgr_compress_rejected", "Message segments sent uncompressed due to a poor compression ratio");
+    plb.add_u64_counter(l_msgr_decompress_bytes, "msgr_decompress_bytes", "Message segment bytes received compressed, after decompression", NULL, 0, unit_t(BYTES));
+
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
   }
@@ -292,6 +313,9 @@ class NetworkStack {
 
   std::function<void ()> add_thread(unsigned i);
 
+  /// data segment buffers, shared by all workers
+  std::shared_ptr<RxBufferPool> rx_buffer_pool;
+
  protected:
   CephContext *cct;
   vector<Worker*> workers;
@@ -324,6 +348,9 @@ class NetworkStack {
   void start();
   void stop();
   virtual Worker *get_worker();
+  RxBufferPool *get_rx_buffer_pool() {
+    return rx_buffer_pool.get();
+  }
   Worker *get_worker(unsigned i) {
     return workers[i];
   }
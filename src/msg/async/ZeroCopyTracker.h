@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_ASYNC_ZEROCOPYTRACKER_H
+#define CEPH_MSG_ASYNC_ZEROCOPYTRACKER_H
+
+#include <cstdint>
+#include <deque>
+
+#include "include/buffer.h"
+
+/**
+ * Keeps buffers sent with MSG_ZEROCOPY referenced until the kernel is done
+ * with them.
+ *
+ * The kernel numbers every successful zerocopy sendmsg on a socket with a
+ * 32 bit id, counting from 0, and later reports completed ids on the
+ * socket error queue as inclusive ranges that may cover several sends and
+ * arrive in any order.  Each batch of sent data is pinned here with the
+ * ids of the sendmsg calls that carried it and released once all of them
+ * have completed.
+ */
+class ZeroCopyTracker {
+  struct pinned_t {
+    uint32_t first, last;  ///< zerocopy sendmsg ids, inclusive
+    uint32_t done;         ///< how many of them have completed
+    bufferlist bl;
+  };
+  std::deque<pinned_t> pending;
+  /// id the kernel will assign to our next successful zerocopy sendmsg
+  uint32_t next_id;
+  /// sends the kernel reported having copied instead
+  uint64_t copied = 0;
+
+  // ids wrap, so order them by signed distance
+  static bool before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+  }
+
+public:
+  explicit ZeroCopyTracker(uint32_t first_id = 0) : next_id(first_id) {}
+
+  bool empty() const {
+    return pending.empty();
+  }
+  /// number of sent batches still pinned
+  size_t size() const {
+    return pending.size();
+  }
+  uint64_t get_copied() const {
+    return copied;
+  }
+
+  /// pin bl, which went out in the next @p calls zerocopy sendmsg calls
+  void pin(unsigned calls, bufferlist& bl) {
+    pending.push_back(pinned_t{next_id, next_id + calls - 1, 0, bufferlist()});
+    pending.back().bl.claim(bl);
+    next_id += calls;
+  }
+
+  /**
+   * The kernel finished with zerocopy sends lo..hi, inclusive
+   *
+   * @param was_copied the kernel copied the data rather than sending from
+   *        our pages (SO_EE_CODE_ZEROCOPY_COPIED)
+   */
+  void complete(uint32_t lo, uint32_t hi, bool was_copied) {
+    if (was_copied)
+      copied += hi - lo + 1;
+    for (auto p = pending.begin(); p != pending.end(); ) {
+      uint32_t s = before(p->first, lo) ? lo : p->first;
+      uint32_t e = before(hi, p->last) ? hi : p->last;
+      if (!before(e, s))
+	p->done += e - s + 1;
+      if (p->done == p->last - p->first + 1)
+	p = pending.erase(p);
+      else
+	++p;
+    }
+  }
+
+  /// give up on every outstanding pin, handing the buffers to the caller
+  void release_all(bufferlist *out) {
+    for (auto& p : pending)
+      out->claim_append(p.bl);
+    pending.clear();
+  }
+};
+
+#endif
@@ -14,6 +14,19 @@
 
 #include "DirectMessenger.h"
 #include "msg/DispatchStrategy.h"
+#include "common/debug.h"
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix *_dout << "-- " << get_myaddr() << " "
+
+namespace {
+/// bound and started DirectMessengers, by address
+std::mutex registry_lock;
+std::map<entity_addr_t, DirectMessenger*> registry;
+/// ports handed out by bind() when the caller does not pick one
+std::atomic<int> next_port{1};
+}
 
 
 class DirectConnection : public Connection {
@@ -74,6 +87,12 @@ int DirectConnection::send_message(Message *m)
     m->put();
     return -ENOTCONN;
   }
+  m->get_header().src = msgr->get_myname();
+  // nothing is read off the wire, so all receive stamps are the send time
+  utime_t now = ceph_clock_now();
+  m->set_recv_stamp(now);
+  m->set_throttle_stamp(now);
+  m->set_recv_complete_stamp(now);
   // attach reply_connection to the Message, so that calls to
   // m->get_connection()->send_message() can be dispatched back to the sender
   m->set_connection(conn);
@@ -114,6 +133,7 @@ DirectMessenger::DirectMessenger(CephContext *cct, entity_name_t name,
                                  DispatchStrategy *dispatchers)
   : SimplePolicyMessenger(cct, name, mname, nonce),
     dispatchers(dispatchers),
+    nonce(nonce),
     loopback_connection(create_loopback(this, name, dispatchers))
 {
   dispatchers->set_messenger(this);
@@ -121,6 +141,26 @@ DirectMessenger::DirectMessenger(CephContext *cct, entity_name_t name,
 
 DirectMessenger::~DirectMessenger()
 {
+  unregister();
+}
+
+void DirectMessenger::unregister()
+{
+  std::lock_guard<std::mutex> l(registry_lock);
+  if (registered) {
+    registry.erase(get_myaddr());
+    registered = false;
+  }
+}
+
+ConnectionRef DirectMessenger::lookup_peer(const entity_inst_t& dst)
+{
+  std::lock_guard<std::mutex> l(lock);
+  auto p = peers.find(dst);
+  if (p == peers.end()) {
+    return nullptr;
+  }
+  return p->second;
 }
 
 int DirectMessenger::set_direct_peer(DirectMessenger *peer)
@@ -128,11 +168,11 @@ int DirectMessenger::set_direct_peer(DirectMessenger *peer)
   if (get_myinst() == peer->get_myinst()) {
     return -EADDRINUSE; // must have a different entity instance
   }
-  peer_inst = peer->get_myinst();
+  const entity_inst_t peer_inst = peer->get_myinst();
 
   // allocate a Connection that dispatches to the peer messenger
   auto direct_connection = boost::intrusive_ptr<DirectConnection>(
-      new DirectConnection(cct, peer, peer->dispatchers.get()));
+      new DirectConnection(cct, this, peer->dispatchers.get()));
 
   direct_connection->set_peer_addr(peer_inst.addr);
   direct_connection->set_peer_type(peer_inst.name.type());
@@ -141,7 +181,7 @@ int DirectMessenger::set_direct_peer(DirectMessenger *peer)
   // if set_direct_peer() was already called on the peer messenger, we can
   // finish by attaching their connections. if not, the later call to
   // peer->set_direct_peer() will attach their connection to ours
-  auto connection = peer->get_connection(get_myinst());
+  auto connection = peer->lookup_peer(get_myinst());
   if (connection) {
     auto p = static_cast<DirectConnection*>(connection.get());
 
@@ -149,17 +189,30 @@ int DirectMessenger::set_direct_peer(DirectMessenger *peer)
     direct_connection->set_direct_reply_connection(p);
   }
 
-  peer_connection = std::move(direct_connection);
+  std::lock_guard<std::mutex> l(lock);
+  peers[peer_inst] = std::move(direct_connection);
   return 0;
 }
 
 int DirectMessenger::bind(const entity_addr_t &bind_addr)
 {
-  if (peer_connection) {
-    return -EINVAL; // can't change address after sharing it with the peer
+  {
+    std::lock_guard<std::mutex> l(lock);
+    if (!peers.empty()) {
+      return -EINVAL; // can't change address after sharing it with a peer
+    }
+  }
+  if (started) {
+    return -EINVAL; // already reachable at the old address
+  }
+  entity_addr_t addr = bind_addr;
+  if (addr.get_port() == 0) {
+    addr.set_port(next_port++);
   }
-  set_myaddr(bind_addr);
-  loopback_connection->set_peer_addr(bind_addr);
+  addr.set_nonce(nonce);
+  set_myaddr(addr);
+  loopback_connection->set_peer_addr(addr);
+  bound = true;
   return 0;
 }
 
@@ -171,12 +224,18 @@ int DirectMessenger::client_bind(const entity_addr_t &bind_addr)
 
 int DirectMessenger::start()
 {
-  if (!peer_connection) {
-    return -EINVAL; // did not connect to a peer
-  }
   if (started) {
     return -EINVAL; // already started
   }
+  if (bound) {
+    std::lock_guard<std::mutex> l(registry_lock);
+    if (!registry.emplace(get_myaddr(), this).second) {
+      lderr(cct) << __func__ << " address " << get_myaddr()
+                 << " is already in use" << dendl;
+      return -EADDRINUSE;
+    }
+    registered = true;
+  }
 
   dispatchers->start();
   return SimplePolicyMessenger::start();
@@ -188,8 +247,13 @@ int DirectMessenger::shutdown()
     return -EINVAL; // not started
   }
 
+  // stop new peers from finding us before breaking the existing ones
+  unregister();
   mark_down_all();
-  peer_connection.reset();
+  {
+    std::lock_guard<std::mutex> l(lock);
+    peers.clear();
+  }
   loopback_connection.reset();
 
   dispatchers->shutdown();
@@ -206,13 +270,32 @@ void DirectMessenger::wait()
 
 ConnectionRef DirectMessenger::get_connection(const entity_inst_t& dst)
 {
-  if (dst == peer_inst) {
-    return peer_connection;
-  }
   if (dst == get_myinst()) {
     return loopback_connection;
   }
-  return nullptr;
+  auto conn = lookup_peer(dst);
+  if (conn && conn->is_connected()) {
+    return conn;
+  }
+
+  // connect on demand to a messenger bound to that address. holding the
+  // registry lock keeps the peer from shutting down underneath us, and
+  // serializes concurrent connects between the same pair
+  std::lock_guard<std::mutex> l(registry_lock);
+  auto p = registry.find(dst.addr);
+  if (!started || p == registry.end() ||
+      p->second->get_myinst() != dst) {
+    return conn; // not reachable, or explicitly attached and marked down
+  }
+  conn = lookup_peer(dst);
+  if (conn && conn->is_connected()) {
+    return conn; // lost the race to another connect
+  }
+  DirectMessenger *peer = p->second;
+  ldout(cct, 10) << __func__ << " connecting to " << dst << dendl;
+  set_direct_peer(peer);
+  peer->set_direct_peer(this);
+  return lookup_peer(dst);
 }
 
 ConnectionRef DirectMessenger::get_loopback_connection()
@@ -232,21 +315,37 @@ int DirectMessenger::send_message(Message *m, const entity_inst_t& dst)
 
 void DirectMessenger::mark_down(const entity_addr_t& addr)
 {
-  ConnectionRef conn;
-  if (addr == peer_inst.addr) {
-    conn = peer_connection;
-  } else if (addr == get_myaddr()) {
-    conn = loopback_connection;
+  std::vector<ConnectionRef> conns;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    for (auto& p : peers) {
+      if (p.first.addr == addr) {
+        conns.push_back(p.second);
+      }
+    }
+  }
+  if (addr == get_myaddr() && loopback_connection) {
+    conns.push_back(loopback_connection);
   }
-  if (conn) {
+  // mark_down() reaches into the peer, so do it without holding our lock
+  for (auto& conn : conns) {
     conn->mark_down();
   }
 }
 
 void DirectMessenger::mark_down_all()
 {
-  if (peer_connection) {
-    peer_connection->mark_down();
+  std::vector<ConnectionRef> conns;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    for (auto& p : peers) {
+      conns.push_back(p.second);
+    }
+  }
+  for (auto& conn : conns) {
+    conn->mark_down();
+  }
+  if (loopback_connection) {
+    loopback_connection->mark_down();
   }
-  loopback_connection->mark_down();
 }
@@ -15,6 +15,9 @@
 #ifndef CEPH_MSG_DIRECTMESSENGER_H
 #define CEPH_MSG_DIRECTMESSENGER_H
 
+#include <map>
+#include <mutex>
+
 #include "msg/SimplePolicyMessenger.h"
 #include "common/Semaphore.h"
 
@@ -22,46 +25,66 @@
 class DispatchStrategy;
 
 /**
- * DirectMessenger provides a direct path between two messengers
- * within a process. A pair of DirectMessengers share their
- * DispatchStrategy with each other, and calls to send_message()
- * forward the message directly to the other.
+ * DirectMessenger provides a direct path between messengers within a
+ * process. Calls to send_message() hand the Message object to the peer's
+ * DispatchStrategy without encoding or decoding it, so messages must be
+ * usable in the state they were constructed in.
  *
- * This is for testing and i/o injection only, and cannot be used
- * for normal messengers with ms_type.
+ * Peers are attached explicitly with set_direct_peer(), or on demand by
+ * get_connection() when the destination is a DirectMessenger that was
+ * bound to that address and started in this process. The latter is what
+ * ms_type "direct" uses, so co-located daemons and benchmarks can talk
+ * to each other through the normal Messenger interface. Peers in other
+ * processes are unreachable and policy throttlers are not applied, so
+ * that ms_type is gated behind the "ms-type-direct" experimental feature.
  */
 class DirectMessenger : public SimplePolicyMessenger {
  private:
   /// strategy for local dispatch
   std::unique_ptr<DispatchStrategy> dispatchers;
-  /// peer instance for comparison in get_connection()
-  entity_inst_t peer_inst;
-  /// connection that sends to the peer's dispatchers
-  ConnectionRef peer_connection;
+  /// nonce stamped into our address by bind()
+  const uint64_t nonce;
+  /// protects peers
+  std::mutex lock;
+  /// connections that send to the dispatchers of each peer instance
+  std::map<entity_inst_t, ConnectionRef> peers;
   /// connection that sends to my own dispatchers
   ConnectionRef loopback_connection;
+  /// true once bind() succeeds; only bound messengers can be found by
+  /// address and connected to on demand
+  bool bound = false;
+  /// true while we are listed in the process-wide address registry
+  bool registered = false;
   /// semaphore for signalling wait() from shutdown()
   Semaphore sem;
 
+  /// return our connection to the given peer instance, if any
+  ConnectionRef lookup_peer(const entity_inst_t& dst);
+
+  /// remove us from the address registry
+  void unregister();
+
  public:
   DirectMessenger(CephContext *cct, entity_name_t name,
                   string mname, uint64_t nonce,
                   DispatchStrategy *dispatchers);
   ~DirectMessenger();
 
-  /// attach to a peer messenger. must be called before start()
+  /// attach to a peer messenger. replaces any earlier connection to the
+  /// same peer instance
   int set_direct_peer(DirectMessenger *peer);
 
 
   // Messenger interface
 
-  /// sets the addr. must not be called after set_direct_peer() or start()
+  /// sets the addr, picking a unique port if none is given. must not be
+  /// called after set_direct_peer() or start()
   int bind(const entity_addr_t& bind_addr) override;
 
   /// sets the addr. must not be called after set_direct_peer() or start()
   int client_bind(const entity_addr_t& bind_addr) override;
 
-  /// starts dispatchers
+  /// starts dispatchers and, if bound, makes us reachable by address
   int start() override;
 
   /// breaks connections, stops dispatchers, and unblocks callers of wait()
@@ -71,7 +94,8 @@ class DirectMessenger : public SimplePolicyMessenger {
   void wait() override;
 
   /// returns a connection to the peer instance, a loopback connection to our
-  /// own instance, or null if not connected
+  /// own instance, or null if the peer is neither attached nor bound and
+  /// started in this process
   ConnectionRef get_connection(const entity_inst_t& dst) override;
 
   /// returns a loopback connection that dispatches to this messenger
@@ -2760,8 +2760,24 @@ void BlueStore::ExtentMap::fault_range(
 
   assert(last >= start);
   string key;
+  // fetch every unloaded shard in the range with one batched lookup
+  set<string> keys;
+  for (auto i = start; i <= last; ++i) {
+    assert((size_t)i < shards.size());
+    if (!shards[i].loaded) {
+      generate_extent_shard_key_and_apply(
+	onode->key, shards[i].shard_info->offset, &key,
+	[&](const string& final_key) {
+	  keys.insert(keys.end(), final_key);
+	}
+      );
+    }
+  }
+  map<string, bufferlist> vals;
+  if (!keys.empty()) {
+    db->get(PREFIX_OBJ, keys, &vals);
+  }
   while (start <= last) {
-    assert((size_t)start < shards.size());
     auto p = &shards[start];
     if (!p->loaded) {
       dout(30) << __func__ << " opening shard 0x" << std::hex
@@ -2770,13 +2786,14 @@ void BlueStore::ExtentMap::fault_range(
       generate_extent_shard_key_and_apply(
 	onode->key, p->shard_info->offset, &key,
         [&](const string& final_key) {
-          int r = db->get(PREFIX_OBJ, final_key, &v);
-          if (r < 0) {
+	  auto q = vals.find(final_key);
+	  if (q == vals.end()) {
 	    derr << __func__ << " missing shard 0x" << std::hex
 		 << p->shard_info->offset << std::dec << " for " << onode->oid
 		 << dendl;
-	    assert(r >= 0);
-          }
+	    assert(q != vals.end());
+	  }
+	  v.claim(q->second);
         }
       );
       p->extents = decode_some(v);
@@ -4918,6 +4935,12 @@ int BlueStore::_open_db(bool create, bool to_repair_db)
     }
   }
 
+  if (kv_backend == "rocksdb" &&
+      cct->_conf->get_val<bool>("bluestore_rocksdb_cf_migrate")) {
+    // move prefixes of an existing db into their own column families
+    kv_options["cf_migrate"] = "1";
+  }
+
   db = KeyValueDB::create(cct,
 			  kv_backend,
 			  fn,
@@ -8005,15 +8028,18 @@ int BlueStore::omap_get_values(
     o->flush();
     _key_encode_u64(o->onode.nid, &final_key);
     final_key.push_back('.');
+    set<string> final_keys;
     for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
       final_key.resize(9); // keep prefix
       final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  got " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
-	out->insert(make_pair(*p, val));
-      }
+      final_keys.insert(final_keys.end(), final_key);
+    }
+    map<string, bufferlist> vals;
+    db->get(prefix, final_keys, &vals);
+    for (auto& p : vals) {
+      dout(30) << __func__ << "  got " << pretty_binary_string(p.first)
+	       << " -> " << p.first.substr(9) << dendl;
+      out->insert(out->end(), make_pair(p.first.substr(9), p.second));
     }
   }
  out:
@@ -8049,17 +8075,22 @@ int BlueStore::omap_check_keys(
     o->flush();
     _key_encode_u64(o->onode.nid, &final_key);
     final_key.push_back('.');
+    set<string> final_keys;
     for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
       final_key.resize(9); // keep prefix
       final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  have " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
-	out->insert(*p);
+      final_keys.insert(final_keys.end(), final_key);
+    }
+    map<string, bufferlist> vals;
+    db->get(prefix, final_keys, &vals);
+    for (auto& k : final_keys) {
+      if (vals.count(k)) {
+	dout(30) << __func__ << "  have " << pretty_binary_string(k)
+		 << " -> " << k.substr(9) << dendl;
+	out->insert(out->end(), k.substr(9));
       } else {
-	dout(30) << __func__ << "  miss " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
+	dout(30) << __func__ << "  miss " << pretty_binary_string(k)
+		 << " -> " << k.substr(9) << dendl;
       }
     }
   }
@@ -8647,6 +8678,19 @@ void BlueStore::_txc_finish(TransContext *txc)
   }
   txc->shared_blobs_written.clear();
 
+  if (!txc->removed_collections.empty() &&
+      cct->_conf->get_val<bool>("bluestore_compact_on_collection_remove")) {
+    for (auto& c : txc->removed_collections) {
+      string temp_start, temp_end, start, end;
+      get_coll_key_range(c->cid, c->cnode.bits, &temp_start, &temp_end,
+			 &start, &end);
+      dout(20) << __func__ << " compacting removed " << c->cid << " range "
+	       << pretty_binary_string(start) << " to "
+	       << pretty_binary_string(end) << dendl;
+      db->compact_range_async(PREFIX_OBJ, temp_start, temp_end);
+      db->compact_range_async(PREFIX_OBJ, start, end);
+    }
+  }
   while (!txc->removed_collections.empty()) {
     _queue_reap_collection(txc->removed_collections.front());
     txc->removed_collections.pop_front();
@@ -8860,7 +8904,7 @@ void BlueStore::_kv_start()
   for (int i = 0; i < m_finisher_num; ++i) {
     ostringstream oss;
     oss << "finisher-" << i;
-    Finisher *f = new Finisher(cct, oss.str(), "finisher");
+    Finisher *f = new Finisher(cct, oss.str(), "finisher", true);
     finishers.push_back(f);
   }
 
@@ -11382,7 +11426,7 @@ void BlueStore::_do_omap_clear(TransContext *txc, const string& omap_prefix,
   string prefix, tail;
   get_omap_header(id, &prefix);
   get_omap_tail(id, &tail);
-  txc->t->rm_range_keys(omap_prefix, prefix, tail);
+  txc->t->rm_range_keys_bulk(omap_prefix, prefix, tail);
   dout(20) << __func__ << " remove range start: "
            << pretty_binary_string(prefix) << " end: "
            << pretty_binary_string(tail) << dendl;
@@ -11526,7 +11570,7 @@ int BlueStore::_omap_rmkey_range(TransContext *txc,
     o->flush();
     get_omap_key(o->onode.nid, first, &key_first);
     get_omap_key(o->onode.nid, last, &key_last);
-    txc->t->rm_range_keys(prefix, key_first, key_last);
+    txc->t->rm_range_keys_bulk(prefix, key_first, key_last);
     dout(20) << __func__ << " remove range start: "
              << pretty_binary_string(key_first) << " end: "
              << pretty_binary_string(key_last) << dendl;
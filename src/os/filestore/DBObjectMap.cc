@@ -1067,6 +1067,7 @@ int DBObjectMap::get_state()
     state.seq = 1;
     state.legacy = false;
   }
+  next_seq = state.seq;
   return 0;
 }
 
@@ -1146,20 +1147,16 @@ int DBObjectMap::write_state(KeyValueDB::Transaction _t) {
 }
 
 
-DBObjectMap::Header DBObjectMap::_lookup_map_header(
+DBObjectMap::Header DBObjectMap::lookup_map_header(
   const MapHeaderLock &l,
   const ghobject_t &oid)
 {
   assert(l.get_locked() == oid);
 
   _Header *header = new _Header();
-  {
-    Mutex::Locker l(cache_lock);
-    if (caches.lookup(oid, header)) {
-      assert(!in_use.count(header->seq));
-      in_use.insert(header->seq);
-      return Header(header, RemoveOnDelete(this));
-    }
+  if (cache_shard(oid).lookup(oid, header)) {
+    get_seq(header->seq);
+    return Header(header, RemoveOnDelete(this));
   }
 
   bufferlist out;
@@ -1169,43 +1166,44 @@ DBObjectMap::Header DBObjectMap::_lookup_map_header(
     return Header();
   }
 
-  Header ret(header, RemoveOnDelete(this));
   bufferlist::iterator iter = out.begin();
+  header->decode(iter);
+  cache_shard(oid).add(oid, *header);
 
-  ret->decode(iter);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.add(oid, *ret);
-  }
-
-  assert(!in_use.count(header->seq));
-  in_use.insert(header->seq);
-  return ret;
+  get_seq(header->seq);
+  return Header(header, RemoveOnDelete(this));
 }
 
 DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
 						      Header parent)
 {
+  assert(header_lock.is_locked_by_me());
+  if (next_seq >= state.seq) {
+    // persist the new limit before any seq below it can be used
+    state.seq = next_seq + seq_batch;
+    write_state();
+  }
   Header header = Header(new _Header(), RemoveOnDelete(this));
-  header->seq = state.seq++;
+  header->seq = next_seq++;
   if (parent) {
     header->parent = parent->seq;
     header->spos = parent->spos;
   }
   header->num_children = 1;
   header->oid = oid;
-  assert(!in_use.count(header->seq));
-  in_use.insert(header->seq);
-
-  write_state();
+  get_seq(header->seq);
   return header;
 }
 
 DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
 {
-  Mutex::Locker l(header_lock);
-  while (in_use.count(input->parent))
-    header_cond.Wait(header_lock);
+  {
+    InUseShard *s = seq_shard(input->parent);
+    Mutex::Locker l(s->lock);
+    while (s->in_use.count(input->parent))
+      s->cond.Wait(s->lock);
+    s->in_use.insert(input->parent);
+  }
   map<string, bufferlist> out;
   set<string> keys;
   keys.insert(HEADER_KEY);
@@ -1222,13 +1220,13 @@ DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
     return Header();
   }
 
+  // input->parent is already marked in use above
   Header header = Header(new _Header(), RemoveOnDelete(this));
   bufferlist::iterator iter = out.begin()->second.begin();
   header->decode(iter);
   assert(header->seq == input->parent);
   dout(20) << "lookup_parent: parent seq is " << header->seq << " with parent "
        << header->parent << dendl;
-  in_use.insert(header->seq);
   return header;
 }
 
@@ -1237,10 +1235,9 @@ DBObjectMap::Header DBObjectMap::lookup_create_map_header(
   const ghobject_t &oid,
   KeyValueDB::Transaction t)
 {
-  Mutex::Locker l(header_lock);
-  Header header = _lookup_map_header(hl, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header) {
-    header = _generate_new_header(oid, Header());
+    header = generate_new_header(oid, Header());
     set_map_header(hl, oid, *header, t);
   }
   return header;
@@ -1279,10 +1276,7 @@ void DBObjectMap::remove_map_header(
   set<string> to_remove;
   to_remove.insert(map_header_key(oid));
   t->rmkeys(HOBJECT_TO_SEQ, to_remove);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.clear(oid);
-  }
+  cache_shard(oid).clear(oid);
 }
 
 void DBObjectMap::set_map_header(
@@ -1297,10 +1291,7 @@ void DBObjectMap::set_map_header(
   map<string, bufferlist> to_set;
   header.encode(to_set[map_header_key(oid)]);
   t->set(HOBJECT_TO_SEQ, to_set);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.add(oid, header);
-  }
+  cache_shard(oid).add(oid, header);
 }
 
 bool DBObjectMap::check_spos(const ghobject_t &oid,
@@ -60,17 +60,30 @@ public:
   boost::scoped_ptr<KeyValueDB> db;
 
   /**
-   * Serializes access to next_seq as well as the in_use set
+   * Serializes access to next_seq and the persisted State
    */
   Mutex header_lock;
-  Cond header_cond;
-  Cond map_header_cond;
 
   /**
-   * Set of headers currently in use
+   * Headers and map headers currently in use.  Seqs are sharded by seq
+   * and oids by hash so that operations on unrelated objects don't
+   * contend on a single lock.
    */
-  set<uint64_t> in_use;
-  set<ghobject_t> map_header_in_use;
+  struct InUseShard {
+    Mutex lock;
+    Cond cond;
+    set<uint64_t> in_use;
+    set<ghobject_t> map_header_in_use;
+    InUseShard() : lock("DBObjectMap::InUseShard::lock") {}
+  };
+  vector<InUseShard*> in_use_shards;
+
+  InUseShard *seq_shard(uint64_t seq) {
+    return in_use_shards[seq % in_use_shards.size()];
+  }
+  InUseShard *oid_shard(const ghobject_t &oid) {
+    return in_use_shards[oid.hobj.get_hash() % in_use_shards.size()];
+  }
 
   /**
    * Takes the map_header_in_use entry in constructor, releases in
@@ -85,10 +98,11 @@ public:
   public:
     explicit MapHeaderLock(DBObjectMap *db) : db(db) {}
     MapHeaderLock(DBObjectMap *db, const ghobject_t &oid) : db(db), locked(oid) {
-      Mutex::Locker l(db->header_lock);
-      while (db->map_header_in_use.count(*locked))
-	db->map_header_cond.Wait(db->header_lock);
-      db->map_header_in_use.insert(*locked);
+      InUseShard *s = db->oid_shard(oid);
+      Mutex::Locker l(s->lock);
+      while (s->map_header_in_use.count(*locked))
+	s->cond.Wait(s->lock);
+      s->map_header_in_use.insert(*locked);
     }
 
     const ghobject_t &get_locked() const {
@@ -107,19 +121,36 @@ public:
 
     ~MapHeaderLock() {
       if (locked) {
-	Mutex::Locker l(db->header_lock);
-	assert(db->map_header_in_use.count(*locked));
-	db->map_header_cond.Signal();
-	db->map_header_in_use.erase(*locked);
+	InUseShard *s = db->oid_shard(*locked);
+	Mutex::Locker l(s->lock);
+	assert(s->map_header_in_use.count(*locked));
+	s->cond.SignalAll();
+	s->map_header_in_use.erase(*locked);
       }
     }
   };
 
   DBObjectMap(CephContext* cct, KeyValueDB *db)
     : ObjectMap(cct), db(db), header_lock("DBOBjectMap"),
-      cache_lock("DBObjectMap::CacheLock"),
-      caches(cct->_conf->filestore_omap_header_cache_size)
-    {}
+      next_seq(state.seq),
+      seq_batch(std::max<uint64_t>(
+	1, cct->_conf->get_val<uint64_t>("filestore_omap_seq_batch")))
+    {
+      unsigned shards = std::max<int64_t>(
+	1, cct->_conf->get_val<int64_t>("filestore_omap_header_cache_shards"));
+      size_t per_shard = std::max<size_t>(
+	1, cct->_conf->filestore_omap_header_cache_size / shards);
+      for (unsigned i = 0; i < shards; ++i) {
+	in_use_shards.push_back(new InUseShard);
+	caches.push_back(new SimpleLRU<ghobject_t, _Header>(per_shard));
+      }
+    }
+  ~DBObjectMap() override {
+    for (auto s : in_use_shards)
+      delete s;
+    for (auto c : caches)
+      delete c;
+  }
 
   int set_keys(
     const ghobject_t &oid,
@@ -366,8 +397,16 @@ public:
 private:
   /// Implicit lock on Header->seq
   typedef ceph::shared_ptr<_Header> Header;
-  Mutex cache_lock;
-  SimpleLRU<ghobject_t, _Header> caches;
+  /// Map header cache, sharded like oid_shard()
+  vector<SimpleLRU<ghobject_t, _Header>*> caches;
+  SimpleLRU<ghobject_t, _Header> &cache_shard(const ghobject_t &oid) {
+    return *caches[oid.hobj.get_hash() % caches.size()];
+  }
+
+  /// Next seq to hand out; state.seq is the persisted reservation limit
+  uint64_t next_seq;
+  /// Seqs reserved per State write
+  const uint64_t seq_batch;
 
   string map_header_key(const ghobject_t &oid);
   string header_key(uint64_t seq);
@@ -496,7 +535,8 @@ private:
   /**
    * Generate new header for c oid with new seq number
    *
-   * Has the side effect of syncronously saving the new DBObjectMap state
+   * Seqs are reserved seq_batch at a time; exhausting the reservation
+   * has the side effect of saving the new DBObjectMap state
    */
   Header _generate_new_header(const ghobject_t &oid, Header parent);
   Header generate_new_header(const ghobject_t &oid, Header parent) {
@@ -504,20 +544,30 @@ private:
     return _generate_new_header(oid, parent);
   }
 
-  /// Lookup leaf header for c oid
-  Header _lookup_map_header(
+  /// Lookup leaf header for c oid, serialized by the MapHeaderLock alone
+  Header lookup_map_header(
     const MapHeaderLock &l,
     const ghobject_t &oid);
-  Header lookup_map_header(
-    const MapHeaderLock &l2,
-    const ghobject_t &oid) {
-    Mutex::Locker l(header_lock);
-    return _lookup_map_header(l2, oid);
-  }
 
   /// Lookup header node for input
   Header lookup_parent(Header input);
 
+  /// Mark seq in use, it must not already be
+  void get_seq(uint64_t seq) {
+    InUseShard *s = seq_shard(seq);
+    Mutex::Locker l(s->lock);
+    assert(!s->in_use.count(seq));
+    s->in_use.insert(seq);
+  }
+  /// Release seq, waking anyone waiting on it in lookup_parent
+  void put_seq(uint64_t seq) {
+    InUseShard *s = seq_shard(seq);
+    Mutex::Locker l(s->lock);
+    assert(s->in_use.count(seq));
+    s->in_use.erase(seq);
+    s->cond.SignalAll();
+  }
+
 
   /// Helpers
   int _get_header(Header header, bufferlist *bl);
@@ -564,10 +614,7 @@ private:
     explicit RemoveOnDelete(DBObjectMap *db) :
       db(db) {}
     void operator() (_Header *header) {
-      Mutex::Locker l(db->header_lock);
-      assert(db->in_use.count(header->seq));
-      db->in_use.erase(header->seq);
-      db->header_cond.Signal();
+      db->put_seq(header->seq);
       delete header;
     }
   };
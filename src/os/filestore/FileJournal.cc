@@ -1212,17 +1212,12 @@ void FileJournal::write_thread_entry()
       // flight if we hit this limit to ensure we keep the device
       // saturated.
       while (aio_num > 0) {
-	int exp = std::min<int>(aio_num * 2, 24);
-	long unsigned min_new = 1ull << exp;
 	uint64_t cur = aio_write_queue_bytes;
-	dout(20) << "write_thread_entry aio throttle: aio num " << aio_num << " bytes " << aio_bytes
-		 << " ... exp " << exp << " min_new " << min_new
-		 << " ... pending " << cur << dendl;
-	if (cur >= min_new)
+	if (!aio_should_defer(cur))
 	  break;
 	dout(20) << "write_thread_entry deferring until more aios complete: "
-		 << aio_num << " aios with " << aio_bytes << " bytes needs " << min_new
-		 << " bytes to start a new aio (currently " << cur << " pending)" << dendl;
+		 << aio_num << " aios with " << aio_bytes << " bytes ("
+		 << cur << " pending)" << dendl;
 	aio_cond.Wait(aio_lock);
 	dout(20) << "write_thread_entry woke up" << dendl;
       }
@@ -1275,6 +1270,40 @@ void FileJournal::write_thread_entry()
 }
 
 #ifdef HAVE_LIBAIO
+/**
+ * decide whether the writer should hold off on a new aio so that queued
+ * entries coalesce into a larger write.
+ *
+ * @param pending bytes queued for the journal but not yet written
+ */
+bool FileJournal::aio_should_defer(uint64_t pending)
+{
+  assert(aio_lock.is_locked());
+  if (pending >= (1ull << 24))
+    return false;
+
+  if (cct->_conf->get_val<bool>("journal_aio_adaptive_batch") &&
+      aio_lat_avg > 0 && aio_bw_avg > 0) {
+    // two in flight keeps the device busy across a completion; past that,
+    // group commit once what is in flight covers the bandwidth-delay
+    // product, so a slower device gets proportionally larger writes.
+    double bdp = aio_bw_avg * aio_lat_avg;
+    dout(20) << __func__ << " aio num " << aio_num << " bytes " << aio_bytes
+	     << " ... lat " << aio_lat_avg << " bw " << aio_bw_avg
+	     << " bdp " << bdp << " ... pending " << pending << dendl;
+    return aio_num >= 2 && aio_bytes >= bdp;
+  }
+
+  // no estimate yet: try to do this adaptively so that we submit larger
+  // aios once we have lots of them in flight.
+  int exp = std::min<int>(aio_num * 2, 24);
+  long unsigned min_new = 1ull << exp;
+  dout(20) << __func__ << " aio num " << aio_num << " bytes " << aio_bytes
+	   << " ... exp " << exp << " min_new " << min_new
+	   << " ... pending " << pending << dendl;
+  return pending < min_new;
+}
+
 void FileJournal::do_aio_write(bufferlist& bl)
 {
 
@@ -1350,6 +1379,8 @@ void FileJournal::do_aio_write(bufferlist& bl)
     }
   }
 
+  submit_aio_batch();
+
   write_pos = pos;
   if (write_pos == header.max_size)
     write_pos = get_top();
@@ -1357,7 +1388,7 @@ void FileJournal::do_aio_write(bufferlist& bl)
 }
 
 /**
- * write a buffer using aio
+ * prepare aio(s) writing a buffer; submit_aio_batch() sends them
  *
  * @param seq seq to trigger when this aio completes.  if 0, do not update any state
  * on completion.
@@ -1397,41 +1428,65 @@ int FileJournal::write_aio_bl(off64_t& pos, bufferlist& bl, uint64_t seq)
 
     aio_num++;
     aio_bytes += aio.len;
-
-    // need to save current aio len to update write_pos later because current
-    // aio could be ereased from aio_queue once it is done
-    uint64_t cur_len = aio.len;
-    // unlock aio_lock because following io_submit might take time to return
+    aio_batch.push_back(&aio);
+    pos += aio.len;
     aio_lock.Unlock();
+  }
+  return 0;
+}
 
-    iocb *piocb = &aio.iocb;
-
-    // 2^16 * 125us = ~8 seconds, so max sleep is ~16 seconds
-    int attempts = 16;
-    int delay = 125;
-    do {
-      int r = io_submit(aio_ctx, 1, &piocb);
-      dout(20) << "write_aio_bl io_submit return value: " << r << dendl;
-      if (r < 0) {
-	derr << "io_submit to " << aio.off << "~" << cur_len
-	     << " got " << cpp_strerror(r) << dendl;
-	if (r == -EAGAIN && attempts-- > 0) {
-	  usleep(delay);
-	  delay *= 2;
-	  continue;
-	}
-	check_align(pos, tbl);
-	assert(0 == "io_submit got unexpected error");
-      } else {
-	break;
+/**
+ * submit every aio prepared since the last call with as few io_submit
+ * calls as the aio context allows.
+ */
+void FileJournal::submit_aio_batch()
+{
+  if (aio_batch.empty())
+    return;
+
+  vector<iocb*> iocbs;
+  iocbs.reserve(aio_batch.size());
+  {
+    Mutex::Locker locker(aio_lock);
+    auto now = ceph::mono_clock::now();
+    for (auto a : aio_batch) {
+      a->submitted = now;
+      iocbs.push_back(&a->iocb);
+    }
+  }
+
+  // 2^16 * 125us = ~8 seconds, so max sleep is ~16 seconds
+  int attempts = 16;
+  int delay = 125;
+  size_t submitted = 0;
+  while (submitted < iocbs.size()) {
+    int r = io_submit(aio_ctx, iocbs.size() - submitted, &iocbs[submitted]);
+    dout(20) << __func__ << " io_submit of " << iocbs.size() - submitted
+	     << " return value: " << r << dendl;
+    if (r == 0)
+      r = -EAGAIN;
+    if (r < 0) {
+      // not yet submitted, so it can't have completed under us
+      aio_info *aio = aio_batch[submitted];
+      derr << "io_submit to " << aio->off << "~" << aio->len
+	   << " got " << cpp_strerror(r) << dendl;
+      if (r == -EAGAIN && attempts-- > 0) {
+	usleep(delay);
+	delay *= 2;
+	continue;
       }
-    } while (true);
-    pos += cur_len;
+      check_align(aio->off, aio->bl);
+      assert(0 == "io_submit got unexpected error");
+    }
+    submitted += r;
   }
+  if (logger)
+    logger->inc(l_filestore_journal_wr_aios, submitted);
+  aio_batch.clear();
+
   aio_lock.Lock();
   write_finish_cond.Signal();
   aio_lock.Unlock();
-  return 0;
 }
 #endif
 
@@ -1494,6 +1549,9 @@ void FileJournal::check_aio_completion()
 
   bool completed_something = false, signal = false;
   uint64_t new_journaled_seq = 0;
+  auto now = ceph::mono_clock::now();
+  auto busy_since = aio_last_done;
+  uint64_t done_bytes = 0;
 
   list<aio_info>::iterator p = aio_queue.begin();
   while (p != aio_queue.end() && p->done) {
@@ -1503,11 +1561,25 @@ void FileJournal::check_aio_completion()
       new_journaled_seq = p->seq;
       completed_something = true;
     }
+    // feed the device latency and bandwidth estimates aio_should_defer uses
+    double lat = std::chrono::duration<double>(now - p->submitted).count();
+    aio_lat_avg = aio_lat_avg > 0 ? aio_lat_avg * 7 / 8 + lat / 8 : lat;
+    if (done_bytes == 0 && p->submitted > busy_since)
+      busy_since = p->submitted;  // the device sat idle before this one
+    done_bytes += p->len;
     aio_num--;
     aio_bytes -= p->len;
     aio_queue.erase(p++);
     signal = true;
   }
+  if (done_bytes) {
+    double busy = std::chrono::duration<double>(now - busy_since).count();
+    if (busy > 0) {
+      double bw = done_bytes / busy;
+      aio_bw_avg = aio_bw_avg > 0 ? aio_bw_avg * 7 / 8 + bw / 8 : bw;
+    }
+    aio_last_done = now;
+  }
 
   if (completed_something) {
     // kick finisher?
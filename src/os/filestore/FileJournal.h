@@ -22,6 +22,7 @@ using std::deque;
 
 #include "Journal.h"
 #include "common/Cond.h"
+#include "common/ceph_time.h"
 #include "common/Mutex.h"
 #include "common/Thread.h"
 #include "common/Throttle.h"
@@ -259,6 +260,7 @@ private:
     bool done;
     uint64_t off, len;    ///< these are for debug only
     uint64_t seq;         ///< seq number to complete on aio completion, if non-zero
+    ceph::mono_time submitted;
 
     aio_info(bufferlist& b, uint64_t o, uint64_t s)
       : iov(NULL), done(false), off(o), len(b.length()), seq(s) {
@@ -276,7 +278,13 @@ private:
   int aio_num, aio_bytes;
   uint64_t aio_write_queue_ops;
   uint64_t aio_write_queue_bytes;
+  /// device latency (sec) and bandwidth (bytes/sec) seen by completed aios
+  double aio_lat_avg, aio_bw_avg;
+  ceph::mono_time aio_last_done;
   /// End protected by aio_lock
+
+  /// aios prepared by write_aio_bl, submitted together by submit_aio_batch
+  vector<aio_info*> aio_batch;
 #endif
 
   uint64_t last_committed_seq;
@@ -353,6 +361,8 @@ private:
   void check_aio_completion();
   void do_aio_write(bufferlist& bl);
   int write_aio_bl(off64_t& pos, bufferlist& bl, uint64_t seq);
+  void submit_aio_batch();
+  bool aio_should_defer(uint64_t pending);
 
 
   void check_align(off64_t pos, bufferlist& bl);
@@ -417,6 +427,7 @@ private:
     aio_num(0), aio_bytes(0),
     aio_write_queue_ops(0),
     aio_write_queue_bytes(0),
+    aio_lat_avg(0), aio_bw_avg(0),
 #endif
     last_committed_seq(0),
     journaled_since_start(0),
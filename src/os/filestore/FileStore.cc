@@ -581,13 +581,13 @@ FileStore::FileStore(CephContext* cct, const std::string &base,
   for (int i = 0; i < m_ondisk_finisher_num; ++i) {
     ostringstream oss;
     oss << "filestore-ondisk-" << i;
-    Finisher *f = new Finisher(cct, oss.str(), "fn_odsk_fstore");
+    Finisher *f = new Finisher(cct, oss.str(), "fn_odsk_fstore", true);
     ondisk_finishers.push_back(f);
   }
   for (int i = 0; i < m_apply_finisher_num; ++i) {
     ostringstream oss;
     oss << "filestore-apply-" << i;
-    Finisher *f = new Finisher(cct, oss.str(), "fn_appl_fstore");
+    Finisher *f = new Finisher(cct, oss.str(), "fn_appl_fstore", true);
     apply_finishers.push_back(f);
   }
 
@@ -617,6 +617,7 @@ FileStore::FileStore(CephContext* cct, const std::string &base,
   plb.add_time_avg(l_filestore_journal_latency, "journal_latency", "Average journal queue completing latency");
   plb.add_u64_counter(l_filestore_journal_wr, "journal_wr", "Journal write IOs");
   plb.add_u64_avg(l_filestore_journal_wr_bytes, "journal_wr_bytes", "Journal data written");
+  plb.add_u64_counter(l_filestore_journal_wr_aios, "journal_wr_aios", "Journal aios submitted");
   plb.add_u64(l_filestore_op_queue_max_ops, "op_queue_max_ops", "Max operations in writing to FS queue");
   plb.add_u64(l_filestore_op_queue_ops, "op_queue_ops", "Operations in writing to FS queue");
   plb.add_u64_counter(l_filestore_ops, "ops", "Operations written to store");
@@ -2001,6 +2002,8 @@ int FileStore::umount()
     wbthrottle.stop();
   }
   op_tp.stop();
+  // no more writes can queue splits; finish the step in progress
+  index_manager.stop_split();
 
   journal_stop();
   if (!(generic_flags & SKIP_JOURNAL_REPLAY))
@@ -74,6 +74,7 @@ enum {
   l_filestore_journal_latency,
   l_filestore_journal_wr,
   l_filestore_journal_wr_bytes,
+  l_filestore_journal_wr_aios,
   l_filestore_journal_full,
   l_filestore_committing,
   l_filestore_commitcycle,
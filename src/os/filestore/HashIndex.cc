@@ -424,6 +424,20 @@ int HashIndex::_created(const vector<string> &path,
     return r;
 
   if (must_split(info)) {
+    // leave it to the background splitter unless it has fallen so far
+    // behind that the directory has grown to twice the split size
+    if (split_async && info.objs <= 2 * split_threshold()) {
+      auto p = split_pending.emplace(path, false);
+      if (!p.second)
+	return 0;
+      if (split_async(path)) {
+	dout(10) << __func__ << " " << path << " has " << info.objs
+		 << " objects, queued split." << dendl;
+	return 0;
+      }
+      // the splitter is stopping; do it here
+      split_pending.erase(p.first);
+    }
     dout(1) << __func__ << " " << path << " has " << info.objs
             << " objects, starting split." << dendl;
     int r = initiate_split(path, info);
@@ -744,13 +758,17 @@ bool HashIndex::must_merge(const subdir_info_s &info) {
 	  info.subdirs == 0);
 }
 
+uint64_t HashIndex::split_threshold() const {
+  return (unsigned)(abs(merge_threshold) * split_multiplier + settings.split_rand_factor) * 16;
+}
+
 bool HashIndex::must_split(const subdir_info_s &info, int target_level) {
   // target_level is used for ceph-objectstore-tool to split dirs offline.
   // if it is set (defalult is 0) and current hash level < target_level, 
   // this dir would be split no matters how many objects it has.
   return (info.hash_level < (unsigned)MAX_HASH_LEVEL &&
          ((target_level > 0 && info.hash_level < (unsigned)target_level) ||
-         (info.objs > ((unsigned)(abs(merge_threshold) * split_multiplier + settings.split_rand_factor) * 16))));
+         (info.objs > split_threshold())));
 }
 
 int HashIndex::initiate_merge(const vector<string> &path, subdir_info_s info) {
@@ -901,6 +919,120 @@ int HashIndex::complete_split(const vector<string> &path, subdir_info_s info) {
   return end_split_or_merge(path);
 }
 
+int HashIndex::split_step(const vector<string> &path, bool *done) {
+  int r = _split_step(path, done);
+  if (r < 0) {
+    // a failed step leaves an op tagged for cleanup() at the next mount;
+    // drop the entry so the next write can queue the directory again
+    split_pending.erase(path);
+  }
+  return r;
+}
+
+int HashIndex::_split_step(const vector<string> &path, bool *done) {
+  *done = true;
+  auto pending = split_pending.find(path);
+  if (pending == split_pending.end())
+    return 0;
+
+  // the directory may have been merged or removed since it was queued
+  int exists = 0;
+  int r = path_exists(path, &exists);
+  subdir_info_s info;
+  if (r == 0 && exists)
+    r = get_info(path, &info);
+  if (r < 0 || !exists) {
+    split_pending.erase(pending);
+    return (r == -ENOENT || r == -ENODATA) ? 0 : r;
+  }
+  if (!pending->second) {
+    if (!must_split(info)) {
+      split_pending.erase(pending);
+      return 0;
+    }
+    dout(1) << __func__ << " " << path << " has " << info.objs
+	    << " objects, starting background split." << dendl;
+    pending->second = true;
+  }
+
+  map<string, ghobject_t> objects;
+  r = list_objects(path, 0, 0, &objects);
+  if (r < 0)
+    return r;
+  vector<string> subdirs_vec;
+  r = list_subdirs(path, &subdirs_vec);
+  if (r < 0)
+    return r;
+  set<string> subdirs(subdirs_vec.begin(), subdirs_vec.end());
+  map<string, map<string, ghobject_t> > mapped;
+  for (auto &i : objects) {
+    vector<string> new_path;
+    get_path_components(i.second, &new_path);
+    mapped[new_path[info.hash_level]][i.first] = i.second;
+  }
+
+  vector<string> dst = path;
+  dst.push_back("");
+  for (auto &i : mapped) {
+    subdir_info_s info_new;
+    info_new.objs = i.second.size();
+    info_new.subdirs = 0;
+    info_new.hash_level = info.hash_level + 1;
+    // same rule as complete_split: don't create a subdir only to merge it
+    if (!subdirs.count(i.first) && must_merge(info_new))
+      continue;
+
+    dst.back() = i.first;
+    r = start_split(path);
+    if (r < 0)
+      return r;
+    subdir_info_s temp;
+    bool copied = false;
+    if (!subdirs.count(i.first)) {
+      r = create_path(dst);
+      if (r < 0)
+	return r;
+    } else {
+      // info on the subdir implies these are already accounted for there
+      copied = (get_info(dst, &temp) == 0);
+    }
+    for (auto &j : i.second) {
+      r = link_object(path, dst, j.second, j.first);
+      if (r < 0 && r != -EEXIST)
+	return r;
+    }
+    r = fsync_dir(dst);
+    if (r < 0)
+      return r;
+    if (!copied) {
+      r = set_info(dst, info_new);
+      if (r < 0)
+	return r;
+      r = fsync_dir(dst);
+      if (r < 0)
+	return r;
+    }
+    r = remove_objects(path, i.second, &objects);
+    if (r < 0)
+      return r;
+    r = reset_attr(path);
+    if (r < 0)
+      return r;
+    r = fsync_dir(path);
+    if (r < 0)
+      return r;
+    dout(20) << __func__ << " " << path << " moved " << i.second.size()
+	     << " objects to " << i.first << dendl;
+    *done = false;
+    return end_split_or_merge(path);
+  }
+
+  dout(1) << __func__ << " " << path << " background split completed."
+	  << dendl;
+  split_pending.erase(pending);
+  return 0;
+}
+
 void HashIndex::get_path_components(const ghobject_t &oid,
 				    vector<string> *path) {
   char buf[MAX_HASH_LEVEL + 1];
@@ -74,6 +74,13 @@ private:
   int merge_threshold;
   int split_multiplier;
 
+  /// Queues a background split of a directory and returns true, or
+  /// returns false if it can't be queued; empty to split inline.
+  std::function<bool(const vector<string>&)> split_async;
+  /// Directories queued for background split, true once one has started.
+  /// Protected by access_lock.
+  map<vector<string>, bool> split_pending;
+
   /// Encodes current subdir state for determining when to split/merge.
   struct subdir_info_s {
     uint64_t objs;       ///< Objects in subdir.
@@ -197,6 +204,29 @@ public:
   /// @see CollectionIndex
   int apply_layout_settings(int target_level) override;
 
+  /// Split directories from the write path in the background via @p f
+  void set_split_async(std::function<bool(const vector<string>&)> f) {
+    split_async = f;
+  }
+
+  /// Forget a queued background split that will not run.  Call with
+  /// access_lock held for write.
+  void cancel_split(const vector<string> &path) {
+    split_pending.erase(path);
+  }
+
+  /**
+   * Move one hash bucket of a directory queued by split_async into its
+   * subdirectory.  Each step is a complete split op as far as cleanup()
+   * is concerned, so the caller may drop access_lock between steps.
+   *
+   * Call with access_lock held for write.
+   */
+  int split_step(
+    const vector<string> &path, ///< [in] Subdir being split
+    bool *done			///< [out] True if nothing is left to move
+    ); ///< @return Error Code, 0 on success
+
 protected:
   int _init() override;
 
@@ -276,6 +306,12 @@ private:
     const subdir_info_s &info ///< [in] Info to check
     ); /// @return True if info must be merged, False otherwise
 
+  /// Objects in a directory above which it is split
+  uint64_t split_threshold() const;
+
+  /// split_step, leaving split_pending to the caller on error
+  int _split_step(const vector<string> &path, bool *done);
+
   /// Encapsulates logic for when to merge.
   bool must_split(
     const subdir_info_s &info, ///< [in] Info to check
@@ -25,6 +25,7 @@
 #include "common/Cond.h"
 #include "common/config.h"
 #include "common/debug.h"
+#include "common/errno.h"
 #include "include/buffer.h"
 
 #include "IndexManager.h"
@@ -33,6 +34,11 @@
 
 #include "chain_xattr.h"
 
+#define dout_context cct
+#define dout_subsys ceph_subsys_filestore
+#undef dout_prefix
+#define dout_prefix *_dout << "index_manager "
+
 static int set_version(const char *path, uint32_t version) {
   bufferlist bl;
   encode(version, bl);
@@ -62,6 +68,7 @@ static int get_version(const char *path, uint32_t *version) {
 }
 
 IndexManager::~IndexManager() {
+  stop_split();
 
   for (ceph::unordered_map<coll_t, CollectionIndex* > ::iterator it = col_indices.begin();
        it != col_indices.end(); ++it) {
@@ -88,6 +95,90 @@ int IndexManager::init_index(coll_t c, const char *path, uint32_t version) {
   return index.read_settings();
 }
 
+bool IndexManager::queue_split(HashIndex *index, const vector<string> &path)
+{
+  Mutex::Locker l(split_lock);
+  if (split_stop)
+    return false;
+  split_queue.push_back(make_pair(index, path));
+  if (!split_thread.is_started())
+    split_thread.create("filestore_split");
+  split_cond.Signal();
+  return true;
+}
+
+void IndexManager::stop_split()
+{
+  split_lock.Lock();
+  split_stop = true;
+  split_cond.Signal();
+  split_lock.Unlock();
+  if (split_thread.is_started())
+    split_thread.join();
+
+  // Whatever was still queued is abandoned.  Forget it in the indices so
+  // that the next write to those directories queues them again; every
+  // step that did run is a complete split op, so the layout is consistent.
+  split_lock.Lock();
+  list<pair<HashIndex*, vector<string> > > abandoned;
+  abandoned.swap(split_queue);
+  split_lock.Unlock();
+  for (auto &i : abandoned) {
+    RWLock::WLocker l(i.first->access_lock);
+    i.first->cancel_split(i.second);
+  }
+
+  // a later mount starts the thread again on its first queued split
+  Mutex::Locker l(split_lock);
+  split_stop = false;
+}
+
+void IndexManager::split_thread_entry()
+{
+  split_lock.Lock();
+  while (!split_stop) {
+    if (split_queue.empty()) {
+      split_cond.Wait(split_lock);
+      continue;
+    }
+    HashIndex *index = split_queue.front().first;
+    vector<string> path;
+    path.swap(split_queue.front().second);
+    split_queue.pop_front();
+    split_lock.Unlock();
+
+    // one bucket per step so readers and writers on the collection get
+    // the lock in between
+    bool done = false;
+    int r = 0;
+    while (!done) {
+      RWLock::WLocker l(index->access_lock);
+      if (split_stop) {
+	index->cancel_split(path);
+	break;
+      }
+      r = index->split_step(path, &done);
+      if (r < 0)
+	break;
+    }
+    if (r < 0)
+      derr << __func__ << " split of " << path << " in " << index->coll()
+	   << " failed: " << cpp_strerror(r) << dendl;
+
+    split_lock.Lock();
+  }
+  split_lock.Unlock();
+}
+
+void IndexManager::setup_split(HashIndex *index)
+{
+  if (!cct->_conf->get_val<bool>("filestore_split_async"))
+    return;
+  index->set_split_async([this, index](const vector<string> &p) {
+      return queue_split(index, p);
+    });
+}
+
 int IndexManager::build_index(coll_t c, const char *path, CollectionIndex **index) {
   if (upgrade) {
     // Need to check the collection generation
@@ -107,6 +198,7 @@ int IndexManager::build_index(coll_t c, const char *path, CollectionIndex **inde
 			     cct->_conf->filestore_merge_threshold,
 			     cct->_conf->filestore_split_multiple,
 			     version);
+      setup_split(static_cast<HashIndex*>(*index));
       return (*index)->read_settings();
     }
     default: ceph_abort();
@@ -118,6 +210,7 @@ int IndexManager::build_index(coll_t c, const char *path, CollectionIndex **inde
 			   cct->_conf->filestore_split_multiple,
 			   CollectionIndex::HOBJECT_WITH_POOL,
 			   cct->_conf->filestore_index_retry_probability);
+    setup_split(static_cast<HashIndex*>(*index));
     return (*index)->read_settings();
   }
 }
@@ -14,6 +14,8 @@
 #ifndef OS_INDEXMANAGER_H
 #define OS_INDEXMANAGER_H
 
+#include <atomic>
+
 #include "include/memory.h"
 #include "include/unordered_map.h"
 
@@ -21,6 +23,7 @@
 #include "common/Cond.h"
 #include "common/config.h"
 #include "common/debug.h"
+#include "common/Thread.h"
 
 #include "CollectionIndex.h"
 #include "HashIndex.h"
@@ -54,6 +57,26 @@ class IndexManager {
   bool upgrade;
   ceph::unordered_map<coll_t, CollectionIndex* > col_indices;
 
+  /// Directories waiting for a background split; indices are never freed
+  /// before ~IndexManager, so the raw pointers stay valid.
+  Mutex split_lock;
+  Cond split_cond;
+  std::atomic<bool> split_stop;
+  list<pair<HashIndex*, vector<string> > > split_queue;
+
+  struct SplitThread : public Thread {
+    IndexManager *im;
+    explicit SplitThread(IndexManager *im) : im(im) {}
+    void *entry() override {
+      im->split_thread_entry();
+      return 0;
+    }
+  } split_thread;
+
+  void setup_split(HashIndex *index);
+  bool queue_split(HashIndex *index, const vector<string> &path);
+  void split_thread_entry();
+
   /**
    * Index factory
    *
@@ -72,10 +95,22 @@ public:
   explicit IndexManager(CephContext* cct,
 			bool upgrade) : cct(cct),
 					lock("IndexManager lock"),
-					upgrade(upgrade) {}
+					upgrade(upgrade),
+					split_lock("IndexManager::split_lock"),
+					split_stop(false),
+					split_thread(this) {}
 
   ~IndexManager();
 
+  /**
+   * Stop the background splitter
+   *
+   * Waits for the bucket being moved, if any, and abandons the rest of
+   * the queue.  Directories left unsplit are queued again by the next
+   * write to them.  Called on umount.
+   */
+  void stop_split();
+
   /**
    * Reserve and return index for c
    *
@@ -419,6 +419,19 @@ void KStore::Onode::flush()
   dout(20) << __func__ << " done" << dendl;
 }
 
+void KStore::Onode::trim_stripe_cache(uint64_t max)
+{
+  std::lock_guard<std::mutex> l(stripe_lock);
+  auto p = stripe_cache.begin();
+  while (stripe_cache_bytes > max && p != stripe_cache.end()) {
+    stripe_cache_bytes -= p->second.length();
+    stripe_cache.erase(p++);
+  }
+  // holes are free to keep but not worth remembering once committed
+  if (stripe_cache_bytes == 0)
+    stripe_cache.clear();
+}
+
 // OnodeHashLRU
 
 #undef dout_prefix
@@ -1241,7 +1254,8 @@ int KStore::_do_read(
     uint64_t offset,
     size_t length,
     bufferlist& bl,
-    uint32_t op_flags)
+    uint32_t op_flags,
+    TransContext *txc)
 {
   int r = 0;
   uint64_t stripe_size = o->onode.stripe_size;
@@ -1268,7 +1282,7 @@ int KStore::_do_read(
   stripe_off = offset % stripe_size;
   while (length > 0) {
     bufferlist stripe;
-    _do_read_stripe(o, offset - stripe_off, &stripe);
+    _do_read_stripe(txc, o, offset - stripe_off, &stripe);
     dout(30) << __func__ << " stripe " << offset - stripe_off << " got "
 	     << stripe.length() << dendl;
     unsigned swant = std::min<unsigned>(stripe_size - stripe_off, length);
@@ -1981,6 +1995,20 @@ void KStore::_txc_finalize(OpSequencer *osr, TransContext *txc)
   dout(20) << __func__ << " osr " << osr << " txc " << txc
 	   << " onodes " << txc->onodes << dendl;
 
+  // write out merged stripes
+  for (auto& p : txc->stripes) {
+    const OnodeRef& o = p.first;
+    if (!o->exists)
+      continue;
+    for (auto& q : p.second) {
+      if (q.second.removed)
+	continue;
+      string key;
+      get_data_key(o->onode.nid, q.first, &key);
+      txc->t->set(PREFIX_DATA, key, q.second.bl);
+    }
+  }
+
   // finalize onodes
   for (set<OnodeRef>::iterator p = txc->onodes.begin();
        p != txc->onodes.end();
@@ -1993,6 +2021,26 @@ void KStore::_txc_finalize(OpSequencer *osr, TransContext *txc)
     std::lock_guard<std::mutex> l((*p)->flush_lock);
     (*p)->flush_txns.insert(txc);
   }
+
+  // publish our stripes to the onode cache so later txcs see them before
+  // they commit.  this happens after the flush_txns insert above so a
+  // racing _txc_finish can't trim them away.
+  for (auto& p : txc->stripes) {
+    const OnodeRef& o = p.first;
+    if (!o->exists) {
+      o->clear_stripe_cache();
+      continue;
+    }
+    std::lock_guard<std::mutex> l(o->stripe_lock);
+    ++o->stripe_gen;
+    for (auto& q : p.second) {
+      if (q.second.removed)
+	o->_cache_stripe(q.first, bufferlist());
+      else
+	o->_cache_stripe(q.first, q.second.bl);
+    }
+  }
+  txc->stripes.clear();
 }
 
 void KStore::_txc_finish_kv(TransContext *txc)
@@ -2035,7 +2083,8 @@ void KStore::_txc_finish(TransContext *txc)
     (*p)->flush_txns.erase(txc);
     if ((*p)->flush_txns.empty()) {
       (*p)->flush_cond.notify_all();
-      (*p)->clear_pending_stripes();
+      (*p)->trim_stripe_cache(cct->_conf->get_val<uint64_t>(
+				"kstore_onode_stripe_cache_size"));
     }
   }
 
@@ -2576,34 +2625,65 @@ void KStore::_dump_onode(OnodeRef o)
   }
 }
 
-void KStore::_do_read_stripe(OnodeRef o, uint64_t offset, bufferlist *pbl)
+void KStore::_do_read_stripe(TransContext *txc, OnodeRef o, uint64_t offset,
+			     bufferlist *pbl)
 {
-  map<uint64_t,bufferlist>::iterator p = o->pending_stripes.find(offset);
-  if (p == o->pending_stripes.end()) {
-    string key;
-    get_data_key(o->onode.nid, offset, &key);
-    db->get(PREFIX_DATA, key, pbl);
-    o->pending_stripes[offset] = *pbl;
-  } else {
-    *pbl = p->second;
+  if (txc) {
+    auto p = txc->stripes.find(o);
+    if (p != txc->stripes.end()) {
+      auto q = p->second.find(offset);
+      if (q != p->second.end()) {
+	if (q->second.removed)
+	  pbl->clear();
+	else
+	  *pbl = q->second.bl;
+	return;
+      }
+    }
   }
+  uint64_t gen;
+  {
+    std::lock_guard<std::mutex> l(o->stripe_lock);
+    auto p = o->stripe_cache.find(offset);
+    if (p != o->stripe_cache.end()) {
+      *pbl = p->second;
+      return;
+    }
+    gen = o->stripe_gen;
+  }
+  // anything written by an in-flight txc is in the cache, so the kv
+  // store is current for this stripe
+  string key;
+  get_data_key(o->onode.nid, offset, &key);
+  db->get(PREFIX_DATA, key, pbl);
+  // a txc may have published (and even committed and trimmed) a newer
+  // version while we were reading; don't cache what we got in that case
+  std::lock_guard<std::mutex> l(o->stripe_lock);
+  if (o->stripe_gen == gen &&
+      o->stripe_cache_bytes + pbl->length() <=
+      cct->_conf->get_val<uint64_t>("kstore_onode_stripe_cache_size") &&
+      !o->stripe_cache.count(offset))
+    o->_cache_stripe(offset, *pbl);
 }
 
 void KStore::_do_write_stripe(TransContext *txc, OnodeRef o,
 			      uint64_t offset, bufferlist& bl)
 {
-  o->pending_stripes[offset] = bl;
-  string key;
-  get_data_key(o->onode.nid, offset, &key);
-  txc->t->set(PREFIX_DATA, key, bl);
+  TransContext::stripe_t& s = txc->stripes[o][offset];
+  s.bl = bl;
+  s.removed = false;
 }
 
 void KStore::_do_remove_stripe(TransContext *txc, OnodeRef o, uint64_t offset)
 {
-  o->pending_stripes.erase(offset);
-  string key;
-  get_data_key(o->onode.nid, offset, &key);
-  txc->t->rmkey(PREFIX_DATA, key);
+  TransContext::stripe_t& s = txc->stripes[o][offset];
+  s.bl.clear();
+  if (!s.removed) {
+    s.removed = true;
+    string key;
+    get_data_key(o->onode.nid, offset, &key);
+    txc->t->rmkey(PREFIX_DATA, key);
+  }
 }
 
 int KStore::_do_write(TransContext *txc,
@@ -2647,7 +2727,7 @@ int KStore::_do_write(TransContext *txc,
     }
     uint64_t stripe_off = offset - offset_rem;
     bufferlist prev;
-    _do_read_stripe(o, stripe_off, &prev);
+    _do_read_stripe(txc, o, stripe_off, &prev);
     dout(20) << __func__ << " read previous stripe " << stripe_off
 	     << ", got " << prev.length() << dendl;
     bufferlist bl;
@@ -2738,7 +2818,7 @@ int KStore::_zero(TransContext *txc,
     while (pos < offset + length) {
       if (stripe_off || end - pos < stripe_size) {
 	bufferlist stripe;
-	_do_read_stripe(o, pos - stripe_off, &stripe);
+	_do_read_stripe(txc, o, pos - stripe_off, &stripe);
 	dout(30) << __func__ << " stripe " << pos - stripe_off << " got "
 		 << stripe.length() << dendl;
 	bufferlist bl;
@@ -2795,7 +2875,7 @@ int KStore::_do_truncate(TransContext *txc, OnodeRef o, uint64_t offset)
     while (pos < o->onode.size) {
       if (stripe_off) {
 	bufferlist stripe;
-	_do_read_stripe(o, pos - stripe_off, &stripe);
+	_do_read_stripe(txc, o, pos - stripe_off, &stripe);
 	dout(30) << __func__ << " stripe " << pos - stripe_off << " got "
 		 << stripe.length() << dendl;
 	bufferlist t;
@@ -3132,7 +3212,7 @@ int KStore::_clone(TransContext *txc,
   // data
   oldo->flush();
 
-  r = _do_read(oldo, 0, oldo->onode.size, bl, 0);
+  r = _do_read(oldo, 0, oldo->onode.size, bl, 0, txc);
   if (r < 0)
     goto out;
 
@@ -3202,7 +3282,7 @@ int KStore::_clone_range(TransContext *txc,
   newo->exists = true;
   _assign_nid(txc, newo);
 
-  r = _do_read(oldo, srcoff, length, bl, 0);
+  r = _do_read(oldo, srcoff, length, bl, 0, txc);
   if (r < 0)
     goto out;
 
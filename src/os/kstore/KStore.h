@@ -75,7 +75,16 @@ public:
     uint64_t tail_offset;
     bufferlist tail_bl;
 
-    map<uint64_t,bufferlist> pending_stripes;  ///< unwritten stripes
+    /// protect stripe_cache; nests inside flush_lock
+    std::mutex stripe_lock;
+    /// stripes of in-flight txcs, plus recently used committed ones.  An
+    /// empty bufferlist is a hole.  Only trimmed when flush_txns is empty,
+    /// since until then the kv store may not have the data yet.
+    map<uint64_t,bufferlist> stripe_cache;
+    uint64_t stripe_cache_bytes;
+    /// bumped whenever a txc publishes stripes or the cache is cleared, so
+    /// a reader that went to the kv store can tell its result may be stale
+    uint64_t stripe_gen;
 
     Onode(CephContext* cct, const ghobject_t& o, const string& k)
       : cct(cct),
@@ -84,7 +93,9 @@ public:
 	key(k),
 	dirty(false),
 	exists(false),
-        tail_offset(0) {
+        tail_offset(0),
+	stripe_cache_bytes(0),
+	stripe_gen(0) {
     }
 
     void flush();
@@ -100,9 +111,20 @@ public:
       tail_offset = 0;
       tail_bl.clear();
     }
-    void clear_pending_stripes() {
-      pending_stripes.clear();
+    void _cache_stripe(uint64_t offset, const bufferlist& bl) {
+      bufferlist& s = stripe_cache[offset];
+      stripe_cache_bytes -= s.length();
+      s = bl;
+      stripe_cache_bytes += s.length();
     }
+    void clear_stripe_cache() {
+      std::lock_guard<std::mutex> l(stripe_lock);
+      stripe_cache.clear();
+      stripe_cache_bytes = 0;
+      ++stripe_gen;
+    }
+    /// trim the stripe cache to max bytes; call with no txcs in flight
+    void trim_stripe_cache(uint64_t max);
   };
   typedef boost::intrusive_ptr<Onode> OnodeRef;
 
@@ -225,6 +247,16 @@ public:
     uint64_t ops, bytes;
 
     set<OnodeRef> onodes;     ///< these onodes need to be updated/written
+
+    /// a stripe written by this txc; removed ones are already rmkey'd
+    struct stripe_t {
+      bufferlist bl;
+      bool removed = false;
+    };
+    /// stripes written by this txc, by onode and offset.  Partial writes
+    /// to the same stripe merge here and reach the kv transaction once,
+    /// at finalize.
+    map<OnodeRef, map<uint64_t,stripe_t>> stripes;
     KeyValueDB::Transaction t; ///< then we will commit this
     Context *oncommit;         ///< signal on commit
     Context *onreadable;         ///< signal on readable
@@ -388,7 +420,8 @@ private:
     kv_stop = false;
   }
 
-  void _do_read_stripe(OnodeRef o, uint64_t offset, bufferlist *pbl);
+  void _do_read_stripe(TransContext *txc, OnodeRef o, uint64_t offset,
+		       bufferlist *pbl);
   void _do_write_stripe(TransContext *txc, OnodeRef o,
 			uint64_t offset, bufferlist& bl);
   void _do_remove_stripe(TransContext *txc, OnodeRef o, uint64_t offset);
@@ -468,7 +501,8 @@ public:
     uint64_t offset,
     size_t len,
     bufferlist& bl,
-    uint32_t op_flags = 0);
+    uint32_t op_flags = 0,
+    TransContext *txc = nullptr);
 
   using ObjectStore::fiemap;
   int fiemap(CollectionHandle& c, const ghobject_t& oid, uint64_t offset, size_t len, map<uint64_t, uint64_t>& destmap) override;
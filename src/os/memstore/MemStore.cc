@@ -158,7 +158,7 @@ int MemStore::_load()
     int r = cbl.read_file(fn.c_str(), &err);
     if (r < 0)
       return r;
-    CollectionRef c(new Collection(cct, *q));
+    CollectionRef c(new Collection(cct, *q, page_arena));
     bufferlist::iterator p = cbl.begin();
     c->decode(p);
     coll_map[*q] = c;
@@ -250,7 +250,7 @@ MemStore::CollectionRef MemStore::get_collection(const coll_t& cid)
 ObjectStore::CollectionHandle MemStore::create_new_collection(const coll_t& cid)
 {
   RWLock::WLocker l(coll_lock);
-  Collection *c = new Collection(cct, cid);
+  Collection *c = new Collection(cct, cid, page_arena);
   new_coll_map[cid] = c;
   return c;
 }
@@ -1516,7 +1516,8 @@ struct MemStore::PageSetObject : public Object {
   static thread_local PageSet::page_vector tls_pages;
 #endif
 
-  explicit PageSetObject(size_t page_size) : data(page_size), data_len(0) {}
+  PageSetObject(size_t page_size, std::shared_ptr<PageArena> arena)
+    : data(page_size, arena), data_len(0) {}
 
   size_t get_size() const override { return data_len; }
 
@@ -1743,6 +1744,6 @@ int MemStore::PageSetObject::truncate(uint64_t size)
 
 MemStore::ObjectRef MemStore::Collection::create_object() const {
   if (use_page_set)
-    return new PageSetObject(cct->_conf->memstore_page_size);
+    return new PageSetObject(cct->_conf->memstore_page_size, page_arena);
   return new BufferlistObject();
 }
@@ -99,6 +99,7 @@ public:
     int bits = 0;
     CephContext *cct;
     bool use_page_set;
+    std::shared_ptr<PageArena> page_arena; ///< shared by all collections
     ceph::unordered_map<ghobject_t, ObjectRef> object_hash;  ///< for lookup
     map<ghobject_t, ObjectRef> object_map;        ///< for iteration
     map<string,bufferptr> xattr;
@@ -181,10 +182,12 @@ public:
       return true;
     }
 
-    explicit Collection(CephContext *cct, coll_t c)
+    Collection(CephContext *cct, coll_t c,
+	       std::shared_ptr<PageArena> page_arena = nullptr)
       : CollectionImpl(c),
 	cct(cct),
 	use_page_set(cct->_conf->memstore_page_set),
+	page_arena(page_arena),
         lock("MemStore::Collection::lock", true, false),
 	exists(true) {}
   };
@@ -203,6 +206,7 @@ private:
   Finisher finisher;
 
   uint64_t used_bytes;
+  std::shared_ptr<PageArena> page_arena;
 
   void _do_transaction(Transaction& t);
 
@@ -246,7 +250,13 @@ public:
     : ObjectStore(cct, path),
       coll_lock("MemStore::coll_lock"),
       finisher(cct),
-      used_bytes(0) {}
+      used_bytes(0) {
+    if (cct->_conf->memstore_page_set &&
+	cct->_conf->get_val<bool>("memstore_page_arena"))
+      page_arena = std::make_shared<PageArena>(
+	cct->_conf->memstore_page_size,
+	cct->_conf->get_val<bool>("memstore_page_arena_hugepages"));
+  }
   ~MemStore() override { }
 
   string get_type() override {
@@ -16,41 +16,35 @@
 #define CEPH_PAGESET_H
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <vector>
-#include <boost/intrusive/avl_set.hpp>
+#include <sys/mman.h>
 #include <boost/intrusive_ptr.hpp>
 
 #include "include/encoding.h"
 
+class PageArena;
+
 struct Page {
   char *const data;
-  boost::intrusive::avl_set_member_hook<> hook;
   uint64_t offset;
+  PageArena *const arena; // owner of our memory, or null if from the heap
 
   // avoid RefCountedObject because it has a virtual destructor
   std::atomic<uint16_t> nrefs;
   void get() { ++nrefs; }
-  void put() { if (--nrefs == 0) delete this; }
+  inline void put();
 
   typedef boost::intrusive_ptr<Page> Ref;
   friend void intrusive_ptr_add_ref(Page *p) { p->get(); }
   friend void intrusive_ptr_release(Page *p) { p->put(); }
 
-  // key-value comparison functor for avl
-  struct Less {
-    bool operator()(uint64_t offset, const Page &page) const {
-      return offset < page.offset;
-    }
-    bool operator()(const Page &page, uint64_t offset) const {
-      return page.offset < offset;
-    }
-    bool operator()(const Page &lhs, const Page &rhs) const {
-      return lhs.offset < rhs.offset;
-    }
-  };
   void encode(bufferlist &bl, size_t page_size) const {
     using ceph::encode;
     bl.append(buffer::copy(data, page_size));
@@ -62,55 +56,208 @@ struct Page {
     decode(offset, p);
   }
 
-  static Ref create(size_t page_size, uint64_t offset = 0) {
+  // bytes needed for a page's data and the Page placed after it
+  static size_t slot_size(size_t page_size) {
     // ensure proper alignment of the Page
     const auto align = alignof(Page);
     page_size = (page_size + align - 1) & ~(align - 1);
+    return page_size + sizeof(Page);
+  }
+
+  static Ref create(size_t page_size, uint64_t offset = 0) {
     // allocate the Page and its data in a single buffer
-    auto buffer = new char[page_size + sizeof(Page)];
+    auto buffer = new char[slot_size(page_size)];
     // place the Page structure at the end of the buffer
-    return new (buffer + page_size) Page(buffer, offset);
+    return new (buffer + slot_size(page_size) - sizeof(Page))
+      Page(buffer, offset, nullptr);
   }
+  static inline Ref create(PageArena *arena, uint64_t offset = 0);
 
   // copy disabled
   Page(const Page&) = delete;
   const Page& operator=(const Page&) = delete;
 
  private: // private constructor, use create() instead
-  Page(char *data, uint64_t offset) : data(data), offset(offset), nrefs(1) {}
+  Page(char *data, uint64_t offset, PageArena *arena)
+    : data(data), offset(offset), arena(arena), nrefs(1) {}
 
   static void operator delete(void *p) {
     delete[] reinterpret_cast<Page*>(p)->data;
   }
 };
 
+// Carves Pages out of large anonymous mappings, optionally backed by 2MB
+// huge pages, so that a multi-GB MemStore isn't dominated by malloc and
+// TLB misses.  Freed pages are kept on a free list for reuse; the mappings
+// are returned to the OS only when the arena goes away.
+class PageArena {
+  static constexpr size_t huge_page_size = 2 << 20;
+
+  const size_t page_size;
+  const size_t slot_size;  // page data + Page, rounded to a cache line
+  const size_t chunk_size; // a multiple of the huge page size
+  const bool hugepages;
+
+  std::mutex mutex;
+  std::vector<char*> chunks;
+  std::vector<char*> free_slots;
+  char *next = nullptr; // unused tail of the last chunk
+  char *end = nullptr;
+
+  char *map_chunk() {
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (hugepages)
+      p = ::mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED) {
+      // no reserved huge pages; ask for transparent ones instead
+      p = ::mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+        throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+      if (hugepages)
+        ::madvise(p, chunk_size, MADV_HUGEPAGE);
+#endif
+    }
+    chunks.push_back(static_cast<char*>(p));
+    return static_cast<char*>(p);
+  }
+
+ public:
+  PageArena(size_t page_size, bool hugepages)
+    : page_size(page_size),
+      slot_size((Page::slot_size(page_size) + 63) & ~size_t(63)),
+      chunk_size((std::max(huge_page_size, slot_size * 16) +
+                  huge_page_size - 1) & ~(huge_page_size - 1)),
+      hugepages(hugepages) {}
+  ~PageArena() {
+    for (auto c : chunks)
+      ::munmap(c, chunk_size);
+  }
+
+  // disable copy
+  PageArena(const PageArena&) = delete;
+  const PageArena& operator=(const PageArena&) = delete;
+
+  size_t get_page_size() const { return page_size; }
+  size_t get_mapped_bytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return chunks.size() * chunk_size;
+  }
+
+  // return memory for one page's data followed by its Page
+  char *allocate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!free_slots.empty()) {
+      auto slot = free_slots.back();
+      free_slots.pop_back();
+      return slot;
+    }
+    if (next == nullptr || next + slot_size > end) {
+      next = map_chunk();
+      end = next + chunk_size;
+    }
+    auto slot = next;
+    next += slot_size;
+    return slot;
+  }
+  void release(char *slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    free_slots.push_back(slot);
+  }
+};
+
+inline void Page::put()
+{
+  if (--nrefs == 0) {
+    if (arena) {
+      auto a = arena;
+      auto d = data;
+      this->~Page();
+      a->release(d);
+    } else {
+      delete this;
+    }
+  }
+}
+
+inline Page::Ref Page::create(PageArena *arena, uint64_t offset)
+{
+  auto buffer = arena->allocate();
+  return new (buffer + slot_size(arena->get_page_size()) - sizeof(Page))
+    Page(buffer, offset, arena);
+}
+
 class PageSet {
  public:
   // alloc_range() and get_range() return page refs in a vector
   typedef std::vector<Page::Ref> page_vector;
 
  private:
-  // store pages in a boost intrusive avl_set
-  typedef Page::Less page_cmp;
-  typedef boost::intrusive::member_hook<Page,
-          boost::intrusive::avl_set_member_hook<>,
-          &Page::hook> member_option;
-  typedef boost::intrusive::avl_set<Page,
-          boost::intrusive::compare<page_cmp>, member_option> page_set;
-
-  typedef typename page_set::iterator iterator;
+  // index pages by page number in fixed-size leaves, so a dense object
+  // costs one map lookup per leaf instead of a tree walk per page
+  static constexpr unsigned leaf_bits = 9;
+  static constexpr uint64_t leaf_pages = 1ull << leaf_bits;
+  struct Leaf {
+    std::array<Page*, leaf_pages> slots{};
+    unsigned count = 0;
+  };
+  typedef std::map<uint64_t, std::unique_ptr<Leaf>> leaf_map;
 
-  page_set pages;
+  leaf_map leaves;
+  size_t count = 0;
   uint64_t page_size;
+  unsigned page_shift;
+  std::shared_ptr<PageArena> arena;
 
   typedef std::mutex lock_type;
   lock_type mutex;
 
-  void free_pages(iterator cur, iterator end) {
-    while (cur != end) {
-      Page *page = &*cur;
-      cur = pages.erase(cur);
-      page->put();
+  static unsigned shift_of(uint64_t page_size) {
+    assert(page_size && (page_size & (page_size - 1)) == 0);
+    return __builtin_ctzll(page_size);
+  }
+
+  Page::Ref create_page(uint64_t offset) {
+    if (arena)
+      return Page::create(arena.get(), offset);
+    return Page::create(page_size, offset);
+  }
+
+  // take ownership of a new page's initial reference
+  void insert(Page *page) {
+    const uint64_t index = page->offset >> page_shift;
+    auto &leaf = leaves[index >> leaf_bits];
+    if (!leaf)
+      leaf.reset(new Leaf);
+    auto &slot = leaf->slots[index & (leaf_pages - 1)];
+    assert(slot == nullptr);
+    slot = page;
+    ++leaf->count;
+    ++count;
+  }
+
+  // drop every page at or after page number @first
+  void free_pages(uint64_t first) {
+    auto l = leaves.lower_bound(first >> leaf_bits);
+    while (l != leaves.end()) {
+      const uint64_t base = l->first << leaf_bits;
+      Leaf &leaf = *l->second;
+      for (uint64_t i = first > base ? first - base : 0; i < leaf_pages; ++i) {
+        if (leaf.slots[i]) {
+          leaf.slots[i]->put();
+          leaf.slots[i] = nullptr;
+          --leaf.count;
+          --count;
+        }
+      }
+      if (leaf.count == 0)
+        l = leaves.erase(l);
+      else
+        ++l;
     }
   }
 
@@ -129,40 +276,52 @@ class PageSet {
   }
 
  public:
-  explicit PageSet(size_t page_size) : page_size(page_size) {}
+  // pages come from @arena when given one of the same page size
+  explicit PageSet(size_t page_size,
+                   std::shared_ptr<PageArena> arena = nullptr)
+    : page_size(page_size), page_shift(shift_of(page_size)),
+      arena(arena && arena->get_page_size() == page_size ? arena : nullptr) {}
   PageSet(PageSet &&rhs)
-    : pages(std::move(rhs.pages)), page_size(rhs.page_size) {}
+    : leaves(std::move(rhs.leaves)), count(rhs.count),
+      page_size(rhs.page_size), page_shift(rhs.page_shift),
+      arena(std::move(rhs.arena)) {
+    rhs.count = 0;
+  }
   ~PageSet() {
-    free_pages(pages.begin(), pages.end());
+    free_pages(0);
   }
 
   // disable copy
   PageSet(const PageSet&) = delete;
   const PageSet& operator=(const PageSet&) = delete;
 
-  bool empty() const { return pages.empty(); }
-  size_t size() const { return pages.size(); }
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
   size_t get_page_size() const { return page_size; }
 
   // allocate all pages that intersect the range [offset,length)
   void alloc_range(uint64_t offset, uint64_t length, page_vector &range) {
-    // loop in reverse so we can provide hints to avl_set::insert_check()
-    //	and get O(1) insertions after the first
-    uint64_t position = offset + length - 1;
-
     range.resize(count_pages(offset, length));
-    auto out = range.rbegin();
+    auto out = range.begin();
 
     std::lock_guard<lock_type> lock(mutex);
-    iterator cur = pages.end();
-    while (length) {
-      const uint64_t page_offset = position & ~(page_size-1);
-
-      typename page_set::insert_commit_data commit;
-      auto insert = pages.insert_check(cur, page_offset, page_cmp(), commit);
-      if (insert.second) {
-        auto page = Page::create(page_size, page_offset);
-        cur = pages.insert_commit(*page, commit);
+    Leaf *leaf = nullptr;
+    uint64_t leaf_index = 0;
+    for (uint64_t index = offset >> page_shift; out != range.end();
+         ++index, ++out) {
+      if (!leaf || (index >> leaf_bits) != leaf_index) {
+        leaf_index = index >> leaf_bits;
+        auto &l = leaves[leaf_index];
+        if (!l)
+          l.reset(new Leaf);
+        leaf = l.get();
+      }
+      auto &slot = leaf->slots[index & (leaf_pages - 1)];
+      if (!slot) {
+        auto page = create_page(index << page_shift);
+        slot = page.get(); // keeps the initial reference
+        ++leaf->count;
+        ++count;
 
         // assume that the caller will write to the range [offset,length),
         //  so we only need to zero memory outside of this range
@@ -174,57 +333,61 @@ class PageSet {
         // zero front of page between page_offset and offset
         if (offset > page->offset)
           std::fill(page->data, page->data + offset - page->offset, 0);
-      } else { // exists
-        cur = insert.first;
       }
       // add a reference to output vector
-      out->reset(&*cur);
-      ++out;
-
-      auto c = std::min(length, (position & (page_size-1)) + 1);
-      position -= c;
-      length -= c;
+      out->reset(slot);
     }
-    // make sure we sized the vector correctly
-    assert(out == range.rend());
   }
 
   // return all allocated pages that intersect the range [offset,length)
   void get_range(uint64_t offset, uint64_t length, page_vector &range) {
-    auto cur = pages.lower_bound(offset & ~(page_size-1), page_cmp());
-    while (cur != pages.end() && cur->offset < offset + length)
-      range.push_back(&*cur++);
+    if (length == 0)
+      return;
+    const uint64_t first = offset >> page_shift;
+    const uint64_t last = (offset + length - 1) >> page_shift;
+    for (auto l = leaves.lower_bound(first >> leaf_bits);
+         l != leaves.end() && (l->first << leaf_bits) <= last; ++l) {
+      const uint64_t base = l->first << leaf_bits;
+      const uint64_t stop = std::min(leaf_pages - 1, last - base);
+      for (uint64_t i = first > base ? first - base : 0; i <= stop; ++i) {
+        if (l->second->slots[i])
+          range.push_back(l->second->slots[i]);
+      }
+    }
   }
 
   void free_pages_after(uint64_t offset) {
     std::lock_guard<lock_type> lock(mutex);
-    auto cur = pages.lower_bound(offset & ~(page_size-1), page_cmp());
-    if (cur == pages.end())
-      return;
-    if (cur->offset < offset)
-      cur++;
-    free_pages(cur, pages.end());
+    free_pages((offset + page_size - 1) >> page_shift);
   }
 
   void encode(bufferlist &bl) const {
     using ceph::encode;
     encode(page_size, bl);
-    unsigned count = pages.size();
+    unsigned count = size();
     encode(count, bl);
-    for (auto p = pages.rbegin(); p != pages.rend(); ++p)
-      p->encode(bl, page_size);
+    // descending order, as older decoders expect
+    for (auto l = leaves.rbegin(); l != leaves.rend(); ++l) {
+      for (auto p = l->second->slots.rbegin(); p != l->second->slots.rend();
+           ++p) {
+        if (*p)
+          (*p)->encode(bl, page_size);
+      }
+    }
   }
   void decode(bufferlist::iterator &p) {
     using ceph::decode;
     assert(empty());
     decode(page_size, p);
+    page_shift = shift_of(page_size);
+    if (arena && arena->get_page_size() != page_size)
+      arena.reset();
     unsigned count;
     decode(count, p);
-    auto cur = pages.end();
     for (unsigned i = 0; i < count; i++) {
-      auto page = Page::create(page_size);
+      auto page = create_page(0);
       page->decode(p, page_size);
-      cur = pages.insert_before(cur, *page);
+      insert(page.get());
     }
   }
 };
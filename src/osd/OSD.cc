@@ -9987,6 +9987,9 @@ std::ostream& operator<<(std::ostream& out, const io_queue& q) {
   case io_queue::weightedpriority:
     out << "weightedpriority";
     break;
+  case io_queue::deficitroundrobin:
+    out << "deficitroundrobin";
+    break;
   case io_queue::mclock_opclass:
     out << "mclock_opclass";
     break;
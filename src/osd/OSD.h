@@ -54,6 +54,7 @@
 #include "common/simple_cache.hpp"
 #include "common/sharedptr_registry.hpp"
 #include "common/WeightedPriorityQueue.h"
+#include "common/DeficitRoundRobinQueue.h"
 #include "common/PrioritizedQueue.h"
 #include "osd/mClockOpClassQueue.h"
 #include "osd/mClockClientQueue.h"
@@ -1031,6 +1032,7 @@ public:
 enum class io_queue {
   prioritized,
   weightedpriority,
+  deficitroundrobin,
   mclock_opclass,
   mclock_client,
 };
@@ -1218,6 +1220,10 @@ struct OSDShard {
       pqueue = std::make_unique<
 	PrioritizedQueue<OpQueueItem,uint64_t>>(
 	  max_tok_per_prio, min_cost);
+    } else if (opqueue == io_queue::deficitroundrobin) {
+      pqueue = std::make_unique<
+	DeficitRoundRobinQueue<OpQueueItem,uint64_t>>(
+	  max_tok_per_prio, min_cost);
     } else if (opqueue == io_queue::mclock_opclass) {
       pqueue = std::make_unique<ceph::mClockOpClassQueue>(cct);
     } else if (opqueue == io_queue::mclock_client) {
@@ -2142,6 +2148,7 @@ private:
     if (cct->_conf->osd_op_queue == "debug_random") {
       static io_queue index_lookup[] = { io_queue::prioritized,
 					 io_queue::weightedpriority,
+					 io_queue::deficitroundrobin,
 					 io_queue::mclock_opclass,
 					 io_queue::mclock_client };
       srand(time(NULL));
@@ -2149,6 +2156,8 @@ private:
       return index_lookup[which];
     } else if (cct->_conf->osd_op_queue == "prioritized") {
       return io_queue::prioritized;
+    } else if (cct->_conf->osd_op_queue == "drr") {
+      return io_queue::deficitroundrobin;
     } else if (cct->_conf->osd_op_queue == "mclock_opclass") {
       return io_queue::mclock_opclass;
     } else if (cct->_conf->osd_op_queue == "mclock_client") {
@@ -892,6 +892,7 @@ Message * ReplicatedBackend::generate_subop(
   const bufferlist &log_entries,
   boost::optional<pg_hit_set_history_t> &hset_hist,
   ObjectStore::Transaction &op_t,
+  const bufferlist &op_t_bl,
   pg_shard_t peer,
   const pg_info_t &pinfo)
 {
@@ -910,7 +911,7 @@ Message * ReplicatedBackend::generate_subop(
     ObjectStore::Transaction t;
     encode(t, wr->get_data());
   } else {
-    encode(op_t, wr->get_data());
+    wr->set_data(op_t_bl);
     wr->get_header().data_off = op_t.get_data_alignment();
   }
 
@@ -957,6 +958,14 @@ void ReplicatedBackend::issue_op(
     // avoid doing the same work in generate_subop
     bufferlist logs;
     encode(log_entries, logs);
+    bufferlist op_t_bl;
+    encode(op_t, op_t_bl);
+
+    // replicas that aren't backfilling get the same pg_stats, and without
+    // a trace the fronts are identical: encode them once
+    MessageEncodeCacheRef encode_cache;
+    if (!(op->op && op->op->pg_trace))
+      encode_cache = std::make_shared<MessageEncodeCache>();
 
     for (const auto& shard : get_parent()->get_acting_recovery_backfill_shards()) {
       if (shard == parent->whoami_shard()) continue;
@@ -975,10 +984,13 @@ void ReplicatedBackend::issue_op(
 	  logs,
 	  hset_hist,
 	  op_t,
+	  op_t_bl,
 	  shard,
 	  pinfo);
       if (op->op && op->op->pg_trace)
 	wr->trace.init("replicated op", nullptr, &op->op->pg_trace);
+      else if (encode_cache && !pinfo.is_incomplete())
+	wr->set_encode_cache(encode_cache);
       get_parent()->send_message_osd_cluster(
 	  shard.osd, wr, get_osdmap()->get_epoch());
     }
@@ -1130,3 +1130,23 @@ TEST_F(ObjectMapTest, TestIterateBug18533) {
   tester.verify_keys("foo2", std::cout);
 }
 
+
+TEST_F(ObjectMapTest, ManyClones) {
+  /* Each clone makes two new headers, so this runs past the default
+   * filestore_omap_seq_batch reservation; check that each clone still
+   * sees its parent's keys.
+   */
+  const unsigned num_parents = 8;
+  const unsigned num_clones = 600;
+  for (unsigned p = 0; p < num_parents; ++p)
+    tester.test_set_key("parent" + num_str(p), "key", "val" + num_str(p));
+  for (unsigned i = 0; i < num_clones; ++i) {
+    unsigned p = i % num_parents;
+    string child = "child" + num_str(i);
+    tester.test_clone("parent" + num_str(p), child, std::cout);
+    string got;
+    ASSERT_EQ(1, tester.get_key(child, "key", &got));
+    ASSERT_EQ("val" + num_str(p), got);
+  }
+  tester.auto_verify_objects(std::cout);
+}
@@ -23,6 +23,7 @@
 #include <limits.h>
 #include <errno.h>
 #include <sys/uio.h>
+#include <thread>
 
 #include "include/buffer.h"
 #include "include/utime.h"
@@ -1504,6 +1505,43 @@ TEST(BufferList, buffers) {
   ASSERT_EQ((unsigned)1, bl.get_num_buffers());
 }
 
+TEST(BufferList, list_node_cache) {
+  // a freed segment node is handed out again to the same thread. use a
+  // new thread so its cache starts out empty
+  std::thread([] {
+    const bufferptr *node;
+    {
+      bufferlist bl;
+      bl.push_back(bufferptr(8));
+      node = &bl.front();
+    }
+    bufferlist bl;
+    bl.push_back(bufferptr(8));
+    EXPECT_EQ(node, &bl.front());
+    EXPECT_EQ(8u, bl.length());
+  }).join();
+
+  // nodes move freely between lists built and freed on different threads
+  bufferlist src;
+  std::thread t([&src] {
+    for (int i = 0; i < 100; ++i) {
+      bufferptr bp(1);
+      bp.c_str()[0] = 'a' + i % 26;
+      src.push_back(bp);
+    }
+  });
+  t.join();
+  ASSERT_EQ(100u, src.get_num_buffers());
+  bufferlist dst;
+  dst.append("x");
+  dst.claim_append(src);
+  ASSERT_EQ(0u, src.get_num_buffers());
+  ASSERT_EQ(101u, dst.get_num_buffers());
+  ASSERT_EQ('x', dst[0]);
+  for (unsigned i = 0; i < 100; ++i)
+    ASSERT_EQ('a' + i % 26, dst[i + 1]);
+}
+
 TEST(BufferList, to_str) {
   {
     bufferlist bl;
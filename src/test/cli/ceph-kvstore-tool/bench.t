@@ -0,0 +1,22 @@
+  $ ceph-kvstore-tool memdb bench.memdb bench onode 1000 512 32
+  bench onode:
+    1000 ops in 32 timed units, .* seconds (re)
+    throughput .* ops/s, .*/s (re)
+    latency usec: avg .* p50 .* p95 .* p99 .* p99.9 .* max .* (re)
+
+  $ ceph-kvstore-tool rocksdb bench.rocksdb bench scan 2048 512 64
+  bench scan:
+    2048 ops in 32 timed units, .* seconds (re)
+    throughput .* ops/s, .*/s (re)
+    latency usec: avg .* p50 .* p95 .* p99 .* p99.9 .* max .* (re)
+    write amplification .* \(wal .*, flush .*, compaction .*\) (re)
+
+bench only runs against a new store:
+
+  $ ceph-kvstore-tool rocksdb bench.rocksdb bench omap 100
+  bench needs a new or empty store path; bench.rocksdb is not empty
+  [1]
+
+  $ ceph-kvstore-tool bluestore-kv bench.bluestore bench omap 100
+  bench refuses to run against a bluestore-kv store
+  [1]
@@ -1,5 +1,5 @@
   $ ceph-kvstore-tool --help
-  Usage: ceph-kvstore-tool <leveldb|rocksdb|bluestore-kv> <store path> command [args...]
+  Usage: ceph-kvstore-tool <leveldb|rocksdb|memdb|bluestore-kv> <store path> command [args...]
   
   Commands:
     list [prefix]
@@ -17,4 +17,6 @@
     compact-prefix <prefix>
     compact-range <prefix> <start> <end>
     repair
+    bench <onode|omap|rmrange|scan> [num-ops] [value-size] [ops-per-tx]
+    bench replay <trace-file> [ops-per-tx]
   
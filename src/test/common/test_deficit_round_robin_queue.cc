@@ -0,0 +1,166 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "gtest/gtest.h"
+#include "common/DeficitRoundRobinQueue.h"
+
+#include <map>
+#include <memory>
+#include <random>
+#include <tuple>
+
+class DRRQueueTest : public testing::Test
+{
+protected:
+  typedef unsigned Klass;
+  // (priority, klass, seq) so that ordering can be checked
+  typedef std::tuple<unsigned, unsigned, unsigned> Item;
+  typedef DeficitRoundRobinQueue<Item, Klass> DQ;
+
+  static const unsigned max_cost = 1 << 22;
+  static const unsigned min_cost = 1 << 16;
+};
+
+TEST_F(DRRQueueTest, Empty)
+{
+  DQ q(max_cost, min_cost);
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(0u, q.length());
+  q.enqueue(1, 10, 0, Item(10, 1, 0));
+  ASSERT_FALSE(q.empty());
+  ASSERT_EQ(1u, q.length());
+  ASSERT_EQ(Item(10, 1, 0), q.dequeue());
+  ASSERT_TRUE(q.empty());
+}
+
+TEST_F(DRRQueueTest, StrictFirst)
+{
+  DQ q(max_cost, min_cost);
+  q.enqueue(1, 200, min_cost, Item(200, 1, 0));
+  q.enqueue_strict(1, 10, Item(10, 1, 1));
+  q.enqueue_strict(1, 63, Item(63, 1, 2));
+  q.enqueue_strict_front(2, 63, Item(63, 2, 3));
+  // highest strict priority first, round robin between its classes
+  auto a = q.dequeue();
+  auto b = q.dequeue();
+  ASSERT_EQ(63u, std::get<0>(a));
+  ASSERT_EQ(63u, std::get<0>(b));
+  ASSERT_NE(std::get<1>(a), std::get<1>(b));
+  ASSERT_EQ(Item(10, 1, 1), q.dequeue());
+  ASSERT_EQ(Item(200, 1, 0), q.dequeue());
+  ASSERT_TRUE(q.empty());
+}
+
+TEST_F(DRRQueueTest, FifoPerClass)
+{
+  DQ q(max_cost, min_cost);
+  std::mt19937 rng(0);
+  std::map<std::pair<unsigned, unsigned>, unsigned> next_seq;
+  const unsigned n = 20000;
+  for (unsigned i = 0; i < n; ++i) {
+    unsigned p = (rng() % 5) * 64;
+    unsigned k = rng() % 37;
+    q.enqueue(k, p, rng() % (1 << 23), Item(p, k, i));
+  }
+  std::map<std::pair<unsigned, unsigned>, unsigned> last;
+  for (unsigned i = 0; i < n; ++i) {
+    Item it = q.dequeue();
+    auto key = std::make_pair(std::get<0>(it), std::get<1>(it));
+    auto l = last.find(key);
+    if (l != last.end()) {
+      ASSERT_LT(l->second, std::get<2>(it));
+    }
+    last[key] = std::get<2>(it);
+  }
+  ASSERT_TRUE(q.empty());
+}
+
+TEST_F(DRRQueueTest, EnqueueFront)
+{
+  DQ q(max_cost, min_cost);
+  q.enqueue(1, 63, min_cost, Item(63, 1, 1));
+  q.enqueue(1, 63, min_cost, Item(63, 1, 2));
+  q.enqueue_front(1, 63, min_cost, Item(63, 1, 0));
+  ASSERT_EQ(Item(63, 1, 0), q.dequeue());
+  ASSERT_EQ(Item(63, 1, 1), q.dequeue());
+  ASSERT_EQ(Item(63, 1, 2), q.dequeue());
+}
+
+TEST_F(DRRQueueTest, ClientFairness)
+{
+  DQ q(max_cost, min_cost);
+  // one client with a deep queue must not starve a light one
+  for (unsigned i = 0; i < 1000; ++i)
+    q.enqueue(1, 63, min_cost, Item(63, 1, i));
+  for (unsigned i = 0; i < 10; ++i)
+    q.enqueue(2, 63, min_cost, Item(63, 2, i));
+
+  unsigned seen_heavy = 0, seen_light = 0;
+  while (seen_light < 10) {
+    Item it = q.dequeue();
+    if (std::get<1>(it) == 2)
+      ++seen_light;
+    else
+      ++seen_heavy;
+  }
+  // each turn is worth max_cost / min_cost ops of this size
+  ASSERT_LE(seen_heavy, 10 * (max_cost / min_cost));
+}
+
+TEST_F(DRRQueueTest, PriorityShare)
+{
+  DQ q(max_cost, min_cost);
+  const unsigned n = 10000;
+  for (unsigned i = 0; i < n; ++i) {
+    q.enqueue(1, 60, min_cost, Item(60, 1, i));
+    q.enqueue(2, 20, min_cost, Item(20, 2, i));
+  }
+  unsigned high = 0;
+  for (unsigned i = 0; i < n; ++i) {
+    if (std::get<0>(q.dequeue()) == 60)
+      ++high;
+  }
+  // 60:20 is a 3:1 share
+  ASSERT_NEAR(n * 3 / 4, high, n / 100);
+}
+
+TEST_F(DRRQueueTest, LargeCostPaysBack)
+{
+  DQ q(max_cost, min_cost);
+  for (unsigned i = 0; i < 100; ++i) {
+    q.enqueue(1, 1, max_cost, Item(1, 1, i));
+    q.enqueue(2, 1, min_cost, Item(1, 2, i));
+  }
+  // same priority, different cost: the cheap client gets many more ops
+  unsigned cheap = 0;
+  for (unsigned i = 0; i < 20; ++i) {
+    if (std::get<1>(q.dequeue()) == 2)
+      ++cheap;
+  }
+  ASSERT_GE(cheap, 15u);
+  while (!q.empty())
+    q.dequeue();
+}
+
+TEST_F(DRRQueueTest, RemoveByClass)
+{
+  DQ q(max_cost, min_cost);
+  for (unsigned i = 0; i < 30; ++i) {
+    unsigned k = i % 3;
+    unsigned p = (i % 2) ? 10 : 63;
+    if (i % 5 == 0)
+      q.enqueue_strict(k, p, Item(p, k, i));
+    else
+      q.enqueue(k, p, i * 1000, Item(p, k, i));
+  }
+  std::list<Item> removed;
+  q.remove_by_class(1, &removed);
+  ASSERT_EQ(10u, removed.size());
+  ASSERT_EQ(20u, q.length());
+  for (auto& i : removed)
+    ASSERT_EQ(1u, std::get<1>(i));
+  q.remove_by_class(7);
+  ASSERT_EQ(20u, q.length());
+  while (!q.empty())
+    ASSERT_NE(1u, std::get<1>(q.dequeue()));
+}
@@ -0,0 +1,117 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "common/Finisher.h"
+#include "include/stringify.h"
+#include "global/global_context.h"
+
+namespace {
+
+struct Domain {
+  std::atomic<int> active{0};
+  std::atomic<bool> overlapped{false};
+  vector<int> seen[4]; // per producer
+};
+
+class C_Record : public Context {
+  Domain *d;
+  int producer, seq;
+public:
+  C_Record(Domain *d, int p, int s) : d(d), producer(p), seq(s) {}
+  void finish(int r) override {
+    if (d->active++ != 0)
+      d->overlapped = true;
+    d->seen[producer].push_back(seq);
+    d->active--;
+  }
+};
+
+void run_finishers(bool pooled)
+{
+  const int num_finishers = 8;
+  const int num_producers = 4;
+  const int num_ops = 2000;
+
+  vector<Finisher*> finishers;
+  vector<Domain> domains(num_finishers);
+  for (int i = 0; i < num_finishers; ++i) {
+    finishers.push_back(new Finisher(g_ceph_context,
+				     "test-" + stringify(i), "fn_test",
+				     pooled));
+    finishers.back()->start();
+  }
+
+  vector<std::thread> producers;
+  for (int p = 0; p < num_producers; ++p) {
+    producers.emplace_back([&, p] {
+	for (int s = 0; s < num_ops; ++s) {
+	  // skew the load: finisher 0 gets half of everything
+	  int f = (s % 2) ? 0 : (s / 2) % num_finishers;
+	  finishers[f]->queue(new C_Record(&domains[f], p, s));
+	}
+      });
+  }
+  for (auto& t : producers)
+    t.join();
+
+  for (int i = 0; i < num_finishers; ++i) {
+    finishers[i]->wait_for_empty();
+    finishers[i]->stop();
+    delete finishers[i];
+
+    ASSERT_FALSE(domains[i].overlapped);
+    for (int p = 0; p < num_producers; ++p) {
+      auto& seen = domains[i].seen[p];
+      for (size_t j = 1; j < seen.size(); ++j)
+	ASSERT_LT(seen[j - 1], seen[j]);
+    }
+  }
+  size_t total = 0;
+  for (auto& d : domains)
+    for (auto& v : d.seen)
+      total += v.size();
+  ASSERT_EQ((size_t)num_producers * num_ops, total);
+}
+
+} // anonymous namespace
+
+TEST(Finisher, Dedicated)
+{
+  run_finishers(false);
+}
+
+TEST(Finisher, Pooled)
+{
+  g_conf->set_val("finisher_pool_threads", "3");
+  ASSERT_NE(nullptr, FinisherPool::get(g_ceph_context));
+  run_finishers(true);
+  g_conf->set_val("finisher_pool_threads", "0");
+}
+
+TEST(Finisher, PooledStopDrains)
+{
+  g_conf->set_val("finisher_pool_threads", "2");
+  Domain d;
+  Finisher f(g_ceph_context, "test-stop", "fn_test", true);
+  // contexts queued before start() run once the pool picks us up
+  for (int s = 0; s < 100; ++s)
+    f.queue(new C_Record(&d, 0, s));
+  f.start();
+  f.stop();
+  ASSERT_EQ(100u, d.seen[0].size());
+  g_conf->set_val("finisher_pool_threads", "0");
+}
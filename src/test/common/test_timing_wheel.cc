@@ -0,0 +1,194 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "common/timing_wheel.h"
+
+struct TestEvent {
+  uint64_t tick;
+  int id;
+  ceph::timing_wheel_hook hook;
+  TestEvent(uint64_t t, int i) : tick(t), id(i) {}
+};
+
+typedef ceph::timing_wheel<TestEvent, &TestEvent::hook,
+			   &TestEvent::tick> wheel_t;
+
+// drive the wheel the way a timer thread does: sleep until next_tick(),
+// then advance to it
+static std::vector<TestEvent*> drain(wheel_t& w, uint64_t until)
+{
+  std::vector<TestEvent*> out;
+  for (;;) {
+    uint64_t next = w.next_tick();
+    if (next == wheel_t::NONE || next > until)
+      break;
+    wheel_t::list_type expired;
+    w.advance(next, expired);
+    for (auto& e : expired) {
+      EXPECT_LE(e.tick, next);
+      out.push_back(&e);
+    }
+    expired.clear();
+  }
+  return out;
+}
+
+TEST(TimingWheel, Empty)
+{
+  wheel_t w(1000);
+  ASSERT_EQ(wheel_t::NONE, w.next_tick());
+  wheel_t::list_type expired;
+  w.advance(5000, expired);
+  ASSERT_TRUE(expired.empty());
+  ASSERT_EQ(5000u, w.get_cur());
+}
+
+TEST(TimingWheel, NextTickIsExactNearby)
+{
+  wheel_t w(100);
+  TestEvent a(110, 0);
+  w.insert(a);
+  ASSERT_EQ(110u, w.next_tick());
+
+  // an event in the past is due immediately
+  TestEvent b(50, 1);
+  w.insert(b);
+  ASSERT_EQ(100u, w.next_tick());
+
+  wheel_t::list_type expired;
+  w.advance(105, expired);
+  ASSERT_EQ(1u, expired.size());
+  ASSERT_EQ(&b, &expired.front());
+  expired.clear();
+  ASSERT_EQ(110u, w.next_tick());
+}
+
+TEST(TimingWheel, OrderAcrossLevels)
+{
+  const uint64_t start = 123456789;
+  wheel_t w(start);
+  std::mt19937_64 rng(42);
+  std::vector<std::unique_ptr<TestEvent>> events;
+  for (int i = 0; i < 5000; ++i) {
+    // spread over every level, plus the overflow list
+    uint64_t span = 1ull << (rng() % 34);
+    events.emplace_back(new TestEvent(start + rng() % span, i));
+    w.insert(*events.back());
+  }
+
+  auto fired = drain(w, wheel_t::NONE - 1);
+  ASSERT_EQ(events.size(), fired.size());
+  for (size_t i = 1; i < fired.size(); ++i)
+    ASSERT_LE(fired[i - 1]->tick, fired[i]->tick);
+  ASSERT_EQ(wheel_t::NONE, w.next_tick());
+}
+
+TEST(TimingWheel, FifoWithinTick)
+{
+  wheel_t w(0);
+  TestEvent a(10000, 0), b(10000, 1), c(10000, 2);
+  w.insert(a);
+  w.insert(b);
+  w.insert(c);
+  auto fired = drain(w, 10000);
+  ASSERT_EQ(3u, fired.size());
+  ASSERT_EQ(0, fired[0]->id);
+  ASSERT_EQ(1, fired[1]->id);
+  ASSERT_EQ(2, fired[2]->id);
+}
+
+TEST(TimingWheel, Erase)
+{
+  wheel_t w(0);
+  TestEvent a(5, 0), b(5000, 1), c(5000000, 2);
+  w.insert(a);
+  w.insert(b);
+  w.insert(c);
+
+  wheel_t::erase(b);
+  {
+    // destroying a linked event unlinks it too
+    TestEvent d(700, 3);
+    w.insert(d);
+  }
+  auto fired = drain(w, wheel_t::NONE - 1);
+  ASSERT_EQ(2u, fired.size());
+  ASSERT_EQ(&a, fired[0]);
+  ASSERT_EQ(&c, fired[1]);
+}
+
+TEST(TimingWheel, EraseFromExpiredBatch)
+{
+  wheel_t w(0);
+  TestEvent a(3, 0), b(3, 1);
+  w.insert(a);
+  w.insert(b);
+  wheel_t::list_type expired;
+  w.advance(10, expired);
+  ASSERT_EQ(2u, expired.size());
+  wheel_t::erase(b);
+  ASSERT_EQ(1u, expired.size());
+  ASSERT_EQ(&a, &expired.front());
+  expired.clear();
+}
+
+TEST(TimingWheel, LongIdle)
+{
+  wheel_t w(0);
+  wheel_t::list_type expired;
+  // the cursor follows the clock even when nothing is queued
+  w.advance(1ull << 40, expired);
+  TestEvent a((1ull << 40) + 3, 0);
+  w.insert(a);
+  ASSERT_EQ((1ull << 40) + 3, w.next_tick());
+  auto fired = drain(w, (1ull << 40) + 3);
+  ASSERT_EQ(1u, fired.size());
+}
+
+TEST(TimingWheel, ClockSteppedBack)
+{
+  const uint64_t start = 10000000;
+  wheel_t w(start);
+  TestEvent a(start + 10, 0), b(start + 100000, 1);
+  w.insert(a);
+  w.insert(b);
+  wheel_t::list_type expired;
+  w.advance(start + 5, expired);
+  ASSERT_TRUE(expired.empty());
+
+  // the clock goes back an hour's worth of ticks
+  const uint64_t now = start - 3600000;
+  ASSERT_LT(now, w.get_cur());
+  w.rebase(now);
+  ASSERT_EQ(now, w.get_cur());
+
+  // a new event isn't parked behind the old cursor
+  TestEvent c(now + 20, 2);
+  w.insert(c);
+  ASSERT_EQ(now + 20, w.next_tick());
+  auto fired = drain(w, now + 20);
+  ASSERT_EQ(1u, fired.size());
+  ASSERT_EQ(&c, fired[0]);
+
+  // the old events are still due at their own ticks
+  fired = drain(w, start + 10);
+  ASSERT_EQ(1u, fired.size());
+  ASSERT_EQ(&a, fired[0]);
+  fired = drain(w, start + 100000);
+  ASSERT_EQ(1u, fired.size());
+  ASSERT_EQ(&b, fired[0]);
+  ASSERT_EQ(wheel_t::NONE, w.next_tick());
+}
@@ -10,7 +10,7 @@
 #include "global/global_init.h"
 #include "common/ceph_argparse.h"
 
-#include "DirectMessenger.h"
+#include "msg/direct/DirectMessenger.h"
 #include "msg/FastStrategy.h"
 #include "msg/QueueStrategy.h"
 #include "messages/MPing.h"
@@ -400,15 +400,15 @@ TEST(DirectMessenger, StartWithoutPeer)
   DirectMessenger server(cct, entity_name_t::CLIENT(2),
                          "server", 0, new FastStrategy());
 
-  // can't start until set_direct_peer()
-  ASSERT_EQ(-EINVAL, client.start());
-  ASSERT_EQ(-EINVAL, server.start());
+  // both can start without a peer
+  ASSERT_EQ(0, client.start());
+  ASSERT_EQ(0, server.start());
 
-  ASSERT_EQ(0, client.set_direct_peer(&server));
+  // server was never bound, so it can't be found by address
+  ASSERT_EQ(nullptr, client.get_connection(server.get_myinst()));
+  ASSERT_EQ(-ENOTCONN, client.send_message(new MPing(), server.get_myinst()));
 
-  // only client can start
-  ASSERT_EQ(0, client.start());
-  ASSERT_EQ(-EINVAL, server.start());
+  ASSERT_EQ(0, client.set_direct_peer(&server));
 
   // client has a connection but can't send
   auto conn = client.get_connection(server.get_myinst());
@@ -419,6 +419,93 @@ TEST(DirectMessenger, StartWithoutPeer)
 
   ASSERT_EQ(0, client.shutdown());
   client.wait();
+
+  ASSERT_EQ(0, server.shutdown());
+  server.wait();
+}
+
+/// test on-demand connections to a bound messenger created with ms_type direct
+TEST(DirectMessenger, ConnectByAddress)
+{
+  auto cct = g_ceph_context;
+
+  // ms_type direct is experimental
+  ASSERT_EQ(nullptr, std::unique_ptr<Messenger>(
+	      Messenger::create(cct, "direct", entity_name_t::OSD(0),
+				"server", 1, 0)));
+  cct->_conf->set_val(
+    "enable_experimental_unrecoverable_data_corrupting_features",
+    "ms-type-direct");
+  cct->_conf->apply_changes(nullptr);
+
+  std::unique_ptr<Messenger> server{
+    Messenger::create(cct, "direct", entity_name_t::OSD(0), "server", 1, 0)};
+  std::unique_ptr<Messenger> client{
+    Messenger::create(cct, "direct", entity_name_t::CLIENT(1), "client", 2, 0)};
+  ASSERT_NE(nullptr, server);
+  ASSERT_NE(nullptr, client);
+
+  // the same message object arrives at the server
+  Message *sent = nullptr;
+  std::atomic<bool> got_request{false};
+  std::atomic<bool> got_reply{false};
+  MockDispatcher server_dispatcher(cct, [&] (Message *m) {
+    EXPECT_EQ(sent, m);
+    EXPECT_EQ(entity_name_t::CLIENT(1), m->get_source());
+    got_request = true;
+    m->get_connection()->send_message(new MPing());
+  });
+  server->add_dispatcher_head(&server_dispatcher);
+  MockDispatcher client_dispatcher(cct, [&] (Message *m) {
+    EXPECT_EQ(entity_name_t::OSD(0), m->get_source());
+    got_reply = true;
+  });
+  client->add_dispatcher_head(&client_dispatcher);
+
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  ASSERT_EQ(0, server->bind(bind_addr));
+  // a port is picked for us, and our nonce is stamped in
+  ASSERT_NE(0, server->get_myaddr().get_port());
+  ASSERT_EQ(1u, server->get_myaddr().get_nonce());
+
+  // a second messenger can't start on the same address
+  DirectMessenger other(cct, entity_name_t::OSD(1), "other", 1,
+                        new FastStrategy());
+  ASSERT_EQ(0, other.bind(server->get_myaddr()));
+
+  ASSERT_EQ(0, server->start());
+  ASSERT_EQ(0, client->start());
+  ASSERT_EQ(-EADDRINUSE, other.start());
+
+  auto conn = client->get_connection(server->get_myinst());
+  ASSERT_NE(nullptr, conn);
+  ASSERT_TRUE(conn->is_connected());
+  ASSERT_EQ(conn, client->get_connection(server->get_myinst()));
+
+  sent = new MPing();
+  ASSERT_EQ(0, conn->send_message(sent));
+  while (!got_request || !got_reply) {
+    usleep(1000);
+  }
+
+  // after mark_down() a new connection is made on demand
+  conn->mark_down();
+  ASSERT_FALSE(conn->is_connected());
+  auto conn2 = client->get_connection(server->get_myinst());
+  ASSERT_NE(nullptr, conn2);
+  ASSERT_NE(conn, conn2);
+  ASSERT_TRUE(conn2->is_connected());
+
+  // once the server shuts down it can no longer be found
+  ASSERT_EQ(0, server->shutdown());
+  server->wait();
+  ASSERT_FALSE(conn2->is_connected());
+  ASSERT_EQ(-ENOTCONN,
+            client->send_message(new MPing(), server->get_myinst()));
+
+  ASSERT_EQ(0, client->shutdown());
+  client->wait();
 }
 
 int main(int argc, char **argv)
@@ -0,0 +1,424 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * In-process messenger benchmark.  A server messenger and a set of
+ * client messengers are started in this process and MOSDOp/MOSDOpReply
+ * round trips are driven over loopback for every combination of
+ * messenger type, message size, concurrency and connection count.
+ * The "direct" type passes messages between the messengers without
+ * encoding them, which gives the floor the network stacks are measured
+ * against.
+ *
+ * Because both ends share a clock, each op is split into stages:
+ *
+ *   encode    client, Message::encode() of the MOSDOp
+ *   send      client send_message() until the server starts reading it
+ *   receive   server read of the message, including the partial decode
+ *   decode    server MOSDOp::finish_decode()
+ *   dispatch  end of read until the server fast dispatch runs
+ *   total     client, start of encode until the reply is dispatched
+ *
+ * and p50/p99/p999 of each stage are reported.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+using namespace std;
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/perf_histogram.h"
+#include "global/global_init.h"
+#include "include/str_list.h"
+#include "msg/Messenger.h"
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
+
+#include <atomic>
+
+/// Latency histogram with 1us linear buckets, values are in nanoseconds
+class LatencyHistogram : public PerfHistogram<1> {
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+
+ public:
+  explicit LatencyHistogram(int32_t max_us)
+    : PerfHistogram<1>({{"latency_ns", SCALE_LINEAR, 0, 1000, max_us + 2}}),
+      ranges(get_axis_bucket_ranges(m_axes_config[0])) {}
+
+  void add(utime_t start, utime_t end) {
+    inc(end > start ? int64_t((end - start).to_nsec()) : 0);
+  }
+
+  uint64_t count() const {
+    uint64_t total = 0;
+    for (int32_t i = 0; i < m_axes_config[0].m_buckets; ++i)
+      total += read_bucket(i);
+    return total;
+  }
+
+  /// upper bound in us of the bucket holding the given percentile,
+  /// or -1 if it falls into the overflow bucket
+  double percentile(double p) const {
+    uint64_t total = count();
+    if (!total)
+      return 0;
+    uint64_t target = std::max<uint64_t>(1, std::ceil(total * p / 100.0));
+    uint64_t seen = 0;
+    int32_t last = m_axes_config[0].m_buckets - 1;
+    for (int32_t i = 0; i < last; ++i) {
+      seen += read_bucket(i);
+      if (seen >= target)
+        return double(ranges[i].second + 1) / 1000.0;
+    }
+    return -1;
+  }
+};
+
+enum {
+  STAGE_ENCODE,
+  STAGE_SEND,
+  STAGE_RECEIVE,
+  STAGE_DECODE,
+  STAGE_DISPATCH,
+  STAGE_TOTAL,
+  STAGE_MAX,
+};
+
+static const char *stage_names[STAGE_MAX] = {
+  "encode", "send", "receive", "decode", "dispatch", "total",
+};
+
+/// state shared by the server and all clients of one benchmark run
+struct BenchRun {
+  uint64_t ops;   ///< ops per connection
+  uint64_t total; ///< tids below this are timed, above are warm up ops
+  std::unique_ptr<std::atomic<uint64_t>[]> start_ns; ///< before encode
+  std::unique_ptr<std::atomic<uint64_t>[]> sent_ns;  ///< after encode
+  std::vector<std::unique_ptr<LatencyHistogram>> hist;
+
+  BenchRun(uint64_t ops, int conns, int32_t max_us)
+    : ops(ops), total(ops * conns),
+      start_ns(new std::atomic<uint64_t>[total] {}),
+      sent_ns(new std::atomic<uint64_t>[total] {}) {
+    for (int i = 0; i < STAGE_MAX; ++i)
+      hist.emplace_back(new LatencyHistogram(max_us));
+  }
+  static utime_t to_utime(uint64_t ns) {
+    return utime_t(ns / 1000000000ull, ns % 1000000000ull);
+  }
+};
+
+class ServerDispatcher : public Dispatcher {
+  BenchRun *run;
+
+ public:
+  explicit ServerDispatcher(BenchRun *r): Dispatcher(g_ceph_context), run(r) {}
+  bool ms_can_fast_dispatch_any() const override { return true; }
+  bool ms_can_fast_dispatch(const Message *m) const override {
+    return m->get_type() == CEPH_MSG_OSD_OP;
+  }
+
+  void ms_handle_fast_connect(Connection *con) override {}
+  void ms_handle_fast_accept(Connection *con) override {}
+  bool ms_dispatch(Message *m) override { return true; }
+  bool ms_handle_reset(Connection *con) override { return true; }
+  void ms_handle_remote_reset(Connection *con) override {}
+  bool ms_handle_refused(Connection *con) override { return false; }
+  void ms_fast_dispatch(Message *m) override {
+    utime_t dispatched = ceph_clock_now();
+    MOSDOp *op = static_cast<MOSDOp*>(m);
+    op->finish_decode();
+    utime_t decoded = ceph_clock_now();
+    uint64_t tid = m->get_tid();
+    if (tid < run->total) {
+      run->hist[STAGE_SEND]->add(BenchRun::to_utime(run->sent_ns[tid]),
+				 m->get_recv_stamp());
+      run->hist[STAGE_RECEIVE]->add(m->get_recv_stamp(),
+				    m->get_recv_complete_stamp());
+      run->hist[STAGE_DECODE]->add(dispatched, decoded);
+      run->hist[STAGE_DISPATCH]->add(m->get_recv_complete_stamp(), dispatched);
+    }
+    MOSDOpReply *reply = new MOSDOpReply(op, 0, 0, 0, true);
+    m->get_connection()->send_message(reply);
+    m->put();
+  }
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+                            bufferlist& authorizer, bufferlist& authorizer_reply,
+                            bool& isvalid, CryptoKey& session_key) override {
+    isvalid = true;
+    return true;
+  }
+};
+
+class BenchClient : public Thread {
+  class ClientDispatcher : public Dispatcher {
+    BenchClient *client;
+
+   public:
+    explicit ClientDispatcher(BenchClient *c): Dispatcher(g_ceph_context), client(c) {}
+    bool ms_can_fast_dispatch_any() const override { return true; }
+    bool ms_can_fast_dispatch(const Message *m) const override {
+      return m->get_type() == CEPH_MSG_OSD_OPREPLY;
+    }
+
+    void ms_handle_fast_connect(Connection *con) override {}
+    void ms_handle_fast_accept(Connection *con) override {}
+    bool ms_dispatch(Message *m) override { return true; }
+    void ms_fast_dispatch(Message *m) override {
+      client->handle_reply(m->get_tid());
+      m->put();
+    }
+    bool ms_handle_reset(Connection *con) override { return true; }
+    void ms_handle_remote_reset(Connection *con) override {}
+    bool ms_handle_refused(Connection *con) override { return false; }
+    bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+                              bufferlist& authorizer, bufferlist& authorizer_reply,
+                              bool& isvalid, CryptoKey& session_key) override {
+      isvalid = true;
+      return true;
+    }
+  };
+
+  BenchRun *run;
+  Messenger *msgr;
+  ConnectionRef conn;
+  ClientDispatcher dispatcher;
+  uint64_t first_tid;
+  int concurrent;
+  bufferlist data;
+  object_t oid;
+  object_locator_t oloc;
+  pg_t pgid;
+
+  Mutex lock;
+  Cond cond;
+  uint64_t inflight = 0;
+
+  MOSDOp *new_op(uint64_t tid) {
+    hobject_t hobj(oid, oloc.key, CEPH_NOSNAP, pgid.ps(), pgid.pool(),
+		   oloc.nspace);
+    spg_t spgid(pgid);
+    MOSDOp *m = new MOSDOp(0, tid, hobj, spgid, 0, 0, 0);
+    bufferlist msg_data(data);
+    m->write(0, data.length(), msg_data);
+    return m;
+  }
+
+  void handle_reply(uint64_t tid) {
+    if (tid < run->total)
+      run->hist[STAGE_TOTAL]->add(BenchRun::to_utime(run->start_ns[tid]),
+				  ceph_clock_now());
+    Mutex::Locker l(lock);
+    inflight--;
+    cond.Signal();
+  }
+
+ public:
+  BenchClient(BenchRun *r, Messenger *m, int idx, int c, int len)
+    : run(r), msgr(m), dispatcher(this), first_tid(idx * r->ops),
+      concurrent(c), oid("object-name"), oloc(1, 1),
+      lock("BenchClient::lock") {
+    msgr->add_dispatcher_head(&dispatcher);
+    bufferptr ptr(len);
+    memset(ptr.c_str(), 0, len);
+    data.append(ptr);
+  }
+
+  /// connect and finish the handshake so that the timed ops are
+  /// encoded with the negotiated features
+  void connect(const entity_inst_t &server, int idx) {
+    conn = msgr->get_connection(server);
+    lock.Lock();
+    inflight++;
+    conn->send_message(new_op(run->total + idx));
+    while (inflight)
+      cond.Wait(lock);
+    lock.Unlock();
+  }
+
+  void *entry() override {
+    uint64_t features = conn->get_features();
+    for (uint64_t i = 0; i < run->ops; ++i) {
+      lock.Lock();
+      while (inflight >= uint64_t(concurrent))
+        cond.Wait(lock);
+      inflight++;
+      lock.Unlock();
+
+      uint64_t tid = first_tid + i;
+      MOSDOp *m = new_op(tid);
+      utime_t start = ceph_clock_now();
+      m->encode(features, msgr->crcflags);
+      utime_t sent = ceph_clock_now();
+      run->start_ns[tid] = start.to_nsec();
+      run->sent_ns[tid] = sent.to_nsec();
+      run->hist[STAGE_ENCODE]->add(start, sent);
+      conn->send_message(m);
+    }
+    lock.Lock();
+    while (inflight)
+      cond.Wait(lock);
+    lock.Unlock();
+    return 0;
+  }
+};
+
+static void run_bench(const string &type, int len, int concurrent, int conns,
+		      uint64_t ops, int32_t max_us)
+{
+  BenchRun run(ops, conns, max_us);
+  ServerDispatcher server_dispatcher(&run);
+
+  Messenger *server = Messenger::create(g_ceph_context, type, entity_name_t::OSD(0),
+					"server", getpid(), 0);
+  server->set_default_policy(Messenger::Policy::stateless_server(0));
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  server->bind(bind_addr);
+  server->add_dispatcher_head(&server_dispatcher);
+  server->start();
+
+  vector<Messenger*> msgrs;
+  vector<BenchClient*> clients;
+  for (int i = 0; i < conns; ++i) {
+    Messenger *msgr = Messenger::create(g_ceph_context, type, entity_name_t::CLIENT(i),
+					"client", getpid() + i + 1, 0);
+    msgr->set_default_policy(Messenger::Policy::lossless_client(0));
+    BenchClient *c = new BenchClient(&run, msgr, i, concurrent, len);
+    msgr->start();
+    c->connect(server->get_myinst(), i);
+    msgrs.push_back(msgr);
+    clients.push_back(c);
+  }
+
+  utime_t start = ceph_clock_now();
+  for (auto c : clients)
+    c->create("bench_client");
+  for (auto c : clients)
+    c->join();
+  double elapsed = (ceph_clock_now() - start);
+
+  for (auto msgr : msgrs) {
+    msgr->shutdown();
+    msgr->wait();
+  }
+  server->shutdown();
+  server->wait();
+  for (auto c : clients)
+    delete c;
+  for (auto msgr : msgrs)
+    delete msgr;
+  delete server;
+
+  uint64_t total = ops * conns;
+  cout << type << " size " << len << " concurrency " << concurrent
+       << " connections " << conns << ": " << total << " ops in "
+       << std::fixed << std::setprecision(3) << elapsed << "s, "
+       << std::setprecision(0) << total / elapsed << " ops/s, "
+       << std::setprecision(1) << total * len / elapsed / (1024 * 1024)
+       << " MB/s" << std::endl;
+  cout << "  " << std::left << std::setw(10) << "stage" << std::right
+       << std::setw(12) << "p50(us)" << std::setw(12) << "p99(us)"
+       << std::setw(12) << "p999(us)" << std::endl;
+  for (int i = 0; i < STAGE_MAX; ++i) {
+    cout << "  " << std::left << std::setw(10) << stage_names[i] << std::right;
+    for (double p : {50.0, 99.0, 99.9}) {
+      double v = run.hist[i]->percentile(p);
+      if (v < 0)
+	cout << std::setw(12) << (">" + std::to_string(max_us));
+      else
+	cout << std::setw(12) << std::setprecision(0) << v;
+    }
+    cout << std::endl;
+  }
+}
+
+static vector<int> parse_int_list(const string &s)
+{
+  vector<int> ret;
+  for (auto &i : get_str_vec(s, ","))
+    ret.push_back(atoi(i.c_str()));
+  return ret;
+}
+
+void usage(const string &name) {
+  cerr << "Usage: " << name << " [options]" << std::endl;
+  cerr << "       --ms-types <list>: messenger types to compare (default async+posix,direct)" << std::endl;
+  cerr << "       --sizes <list>: message data bytes (default 4096,65536)" << std::endl;
+  cerr << "       --concurrency <list>: max inflight messages per connection (default 1,16)" << std::endl;
+  cerr << "       --connections <list>: client connections (default 1,4)" << std::endl;
+  cerr << "       --ops <n>: messages sent on each connection (default 10000)" << std::endl;
+  cerr << "       --max-latency-us <n>: histogram range, larger values are clamped (default 100000)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf->set_val(
+    "enable_experimental_unrecoverable_data_corrupting_features",
+    "ms-type-direct");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  string types = "async+posix,direct";
+  string sizes = "4096,65536";
+  string concurrency = "1,16";
+  string connections = "1,4";
+  string val;
+  uint64_t ops = 10000;
+  int32_t max_us = 100000;
+  for (auto i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &types, "--ms-types", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &sizes, "--sizes", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &concurrency, "--concurrency", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &connections, "--connections", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)NULL)) {
+      ops = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--max-latency-us", (char*)NULL)) {
+      max_us = atoi(val.c_str());
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!ops || max_us <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (auto &type : get_str_vec(types, ",")) {
+    for (int len : parse_int_list(sizes)) {
+      for (int c : parse_int_list(concurrency)) {
+	for (int conns : parse_int_list(connections)) {
+	  if (len <= 0 || c <= 0 || conns <= 0)
+	    continue;
+	  run_bench(type, len, c, conns, ops, max_us);
+	}
+      }
+    }
+  }
+  return 0;
+}
@@ -23,6 +23,8 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
 #include "include/Context.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
@@ -274,6 +276,59 @@ TEST(EventCenterTest, FileEventExpansion) {
 }
 
 
+#ifdef HAVE_EPOLL
+class ErrQueueEvent : public EventCallback {
+ public:
+  int fired = 0;
+  void do_request(uint64_t fd) override {
+    fired++;
+    char control[128];
+    struct msghdr msg;
+    do {
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+    } while (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0);
+  }
+};
+
+TEST(EventCenterTest, ErrorEvent) {
+  EventCenter center(g_ceph_context);
+  center.init(100, 0, "posix");
+  center.set_owner();
+
+  // find a closed port: a datagram sent there comes back as an error
+  // queue entry, without the socket ever becoming readable
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int probe = ::socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(probe, 0);
+  ASSERT_EQ(0, ::bind(probe, (struct sockaddr*)&addr, sizeof(addr)));
+  socklen_t len = sizeof(addr);
+  ASSERT_EQ(0, ::getsockname(probe, (struct sockaddr*)&addr, &len));
+  ::close(probe);
+
+  int sd = ::socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(sd, 0);
+  int one = 1;
+  ASSERT_EQ(0, ::setsockopt(sd, SOL_IP, IP_RECVERR, &one, sizeof(one)));
+  ASSERT_EQ(0, ::connect(sd, (struct sockaddr*)&addr, sizeof(addr)));
+
+  ErrQueueEvent *e = new ErrQueueEvent();
+  center.create_file_event(sd, EVENT_ERROR, e);
+  ASSERT_EQ(1, ::send(sd, "x", 1, 0));
+  for (int i = 0; i < 100 && !e->fired; i++)
+    center.process_events(10000);
+  ASSERT_EQ(1, e->fired);
+
+  center.delete_file_event(sd, EVENT_ERROR);
+  ::close(sd);
+  delete e;
+}
+#endif
+
 class Worker : public Thread {
   CephContext *cct;
   bool done;
@@ -332,6 +387,35 @@ TEST(EventCenterTest, DispatchTest) {
   worker2.join();
 }
 
+TEST(EventCenterTest, BusyPollDispatchTest) {
+  // workers alternate between spinning and sleeping; an external event
+  // must wake them up either way
+  g_ceph_context->_conf->set_val("ms_async_busy_poll_us", "50");
+  Worker worker1(g_ceph_context, 1), worker2(g_ceph_context, 2);
+  g_ceph_context->_conf->set_val("ms_async_busy_poll_us", "0");
+  std::atomic<unsigned> count = { 0 };
+  Mutex lock("BusyPollDispatchTest::lock");
+  Cond cond;
+  worker1.create("worker_1");
+  worker2.create("worker_2");
+  for (int i = 0; i < 2000; ++i) {
+    count++;
+    worker1.center.dispatch_event_external(EventCallbackRef(new CountEvent(&count, &lock, &cond)));
+    count++;
+    worker2.center.dispatch_event_external(EventCallbackRef(new CountEvent(&count, &lock, &cond)));
+    {
+      Mutex::Locker l(lock);
+      while (count)
+        ASSERT_EQ(0, cond.WaitInterval(lock, utime_t(0, 500000000)));
+    }
+    usleep(rand() % 100);
+  }
+  worker1.stop();
+  worker2.stop();
+  worker1.join();
+  worker2.join();
+}
+
 INSTANTIATE_TEST_CASE_P(
   AsyncMessenger,
   EventDriverTest,
@@ -1063,6 +1063,39 @@ TEST(DummyTest, ValueParameterizedTestsAreNotSupportedOnThisPlatform) {}
 
 #endif
 
+TEST(RxBufferPool, Reuse) {
+  auto pool = std::make_shared<RxBufferPool>(g_ceph_context);
+  size_t min_size = g_ceph_context->_conf->get_val<uint64_t>(
+    "ms_async_rx_buffer_pool_min_size");
+
+  // small buffers bypass the pool
+  {
+    bufferptr bp = pool->get(4096);
+    ASSERT_EQ(4096u, bp.length());
+  }
+  ASSERT_EQ(0u, pool->get_cached_bytes());
+
+  const char *first;
+  {
+    bufferptr bp = pool->get(min_size * 4 + 100);
+    ASSERT_EQ(min_size * 4 + 100, bp.length());
+    ASSERT_EQ(0u, (uintptr_t)bp.c_str() % CEPH_PAGE_SIZE);
+    first = bp.c_str();
+    bufferlist bl;
+    bl.append(bp);
+  }
+  size_t cached = pool->get_cached_bytes();
+  ASSERT_GE(cached, min_size * 4 + 100);
+
+  // a request that rounds to the same size gets the same memory back
+  {
+    bufferptr bp = pool->get(min_size * 4 + 200);
+    ASSERT_EQ(first, bp.c_str());
+    ASSERT_EQ(0u, pool->get_cached_bytes());
+  }
+  ASSERT_EQ(cached, pool->get_cached_bytes());
+}
+
 
 /*
  * Local Variables:
@@ -15,6 +15,7 @@
  */
 
 #include <atomic>
+#include <thread>
 #include <iostream>
 #include <unistd.h>
 #include <stdlib.h>
@@ -704,6 +705,183 @@ TEST_P(MessengerTest, AuthTest) {
   client_msgr->wait();
 }
 
+class OrderedDispatcher : public Dispatcher {
+ public:
+  Mutex lock;
+  Cond cond;
+  map<Connection*, uint64_t> last_seq;
+  uint64_t received = 0;
+  bool out_of_order = false;
+  // ms_dispatch calls running at once, now and at most
+  unsigned in_flight = 0, max_in_flight = 0;
+
+  OrderedDispatcher(): Dispatcher(g_ceph_context),
+                       lock("OrderedDispatcher::lock") {}
+  bool ms_dispatch(Message *m) override {
+    {
+      Mutex::Locker l(lock);
+      uint64_t &last = last_seq[m->get_connection().get()];
+      if (m->get_seq() <= last)
+        out_of_order = true;
+      last = m->get_seq();
+      max_in_flight = std::max(max_in_flight, ++in_flight);
+    }
+    // do some work outside the lock, like a dispatcher would
+    usleep(100);
+    Mutex::Locker l(lock);
+    --in_flight;
+    ++received;
+    cond.Signal();
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) override { return true; }
+  void ms_handle_remote_reset(Connection *con) override {}
+  bool ms_handle_refused(Connection *con) override { return false; }
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+                            bufferlist& authorizer, bufferlist& authorizer_reply,
+                            bool& isvalid, CryptoKey& session_key) override {
+    isvalid = true;
+    return true;
+  }
+};
+
+TEST_P(MessengerTest, ShardedDispatchTest) {
+  g_ceph_context->_conf->set_val("ms_dispatch_shards", "4");
+  // the messengers from SetUp were built with a single dispatch shard
+  delete server_msgr;
+  server_msgr = Messenger::create(g_ceph_context, string(GetParam()), entity_name_t::OSD(0), "server", getpid(), 0);
+  server_msgr->set_default_policy(Messenger::Policy::stateless_server(0));
+  g_ceph_context->_conf->set_val("ms_dispatch_shards", "1");
+
+  OrderedDispatcher srv_dispatcher;
+  FakeDispatcher cli_dispatcher(false);
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  const int num_clients = 8, num_msgs = 200;
+  vector<Messenger*> clients;
+  vector<ConnectionRef> conns;
+  conns.push_back(client_msgr->get_connection(server_msgr->get_myinst()));
+  for (int i = 1; i < num_clients; ++i) {
+    Messenger *msgr = Messenger::create(g_ceph_context, string(GetParam()), entity_name_t::CLIENT(-1), "client", getpid(), 0);
+    msgr->set_default_policy(Messenger::Policy::lossy_client(0));
+    msgr->add_dispatcher_head(&cli_dispatcher);
+    msgr->start();
+    clients.push_back(msgr);
+    conns.push_back(msgr->get_connection(server_msgr->get_myinst()));
+  }
+  for (int i = 0; i < num_msgs; ++i)
+    for (auto& conn : conns)
+      ASSERT_EQ(conn->send_message(new MCommand()), 0);
+  {
+    Mutex::Locker l(srv_dispatcher.lock);
+    while (srv_dispatcher.received < (uint64_t)num_clients * num_msgs)
+      srv_dispatcher.cond.Wait(srv_dispatcher.lock);
+  }
+  ASSERT_FALSE(srv_dispatcher.out_of_order);
+  ASSERT_EQ(srv_dispatcher.last_seq.size(), (size_t)num_clients);
+  // connections hashed onto different shards were dispatched in parallel
+  ASSERT_GT(srv_dispatcher.max_in_flight, 1u);
+
+  for (auto msgr : clients) {
+    msgr->shutdown();
+    msgr->wait();
+    delete msgr;
+  }
+  client_msgr->shutdown();
+  client_msgr->wait();
+  server_msgr->shutdown();
+  server_msgr->wait();
+}
+
+class SenderOrderDispatcher : public Dispatcher {
+ public:
+  Mutex lock;
+  Cond cond;
+  map<int, int> last;
+  uint64_t received = 0;
+  bool out_of_order = false;
+
+  SenderOrderDispatcher(): Dispatcher(g_ceph_context),
+                           lock("SenderOrderDispatcher::lock") {}
+  bool ms_dispatch(Message *m) override {
+    MCommand *c = static_cast<MCommand*>(m);
+    Mutex::Locker l(lock);
+    int sender = atoi(c->cmd[0].c_str()), n = atoi(c->cmd[1].c_str());
+    auto p = last.find(sender);
+    if (p != last.end() && n != p->second + 1)
+      out_of_order = true;
+    last[sender] = n;
+    ++received;
+    cond.Signal();
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) override { return true; }
+  void ms_handle_remote_reset(Connection *con) override {}
+  bool ms_handle_refused(Connection *con) override { return false; }
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+                            bufferlist& authorizer, bufferlist& authorizer_reply,
+                            bool& isvalid, CryptoKey& session_key) override {
+    isvalid = true;
+    return true;
+  }
+};
+
+TEST_P(MessengerTest, ConcurrentSendTest) {
+  SenderOrderDispatcher srv_dispatcher;
+  FakeDispatcher cli_dispatcher(false);
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+
+  client_msgr->set_policy(entity_name_t::TYPE_OSD,
+                          Messenger::Policy::lossless_client(0));
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  // many threads share one connection, each one's messages must arrive
+  // complete and in the order it sent them
+  const int num_threads = 8, num_msgs = 500;
+  ConnectionRef conn = client_msgr->get_connection(server_msgr->get_myinst());
+  vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&conn, t] {
+      for (int i = 0; i < num_msgs; ++i) {
+        MCommand *m = new MCommand();
+        m->cmd.push_back(std::to_string(t));
+        m->cmd.push_back(std::to_string(i));
+        conn->send_message(m);
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  {
+    Mutex::Locker l(srv_dispatcher.lock);
+    while (srv_dispatcher.received < (uint64_t)num_threads * num_msgs)
+      srv_dispatcher.cond.Wait(srv_dispatcher.lock);
+  }
+  ASSERT_FALSE(srv_dispatcher.out_of_order);
+  ASSERT_EQ(srv_dispatcher.last.size(), (size_t)num_threads);
+  for (auto& p : srv_dispatcher.last)
+    ASSERT_EQ(p.second, num_msgs - 1);
+
+  client_msgr->shutdown();
+  client_msgr->wait();
+  server_msgr->shutdown();
+  server_msgr->wait();
+}
+
 TEST_P(MessengerTest, MessageTest) {
   FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
   entity_addr_t bind_addr;
@@ -767,6 +945,56 @@ TEST_P(MessengerTest, MessageTest) {
 }
 
 
+TEST_P(MessengerTest, CompressionTest) {
+  // compressed segments are checked against the crc of the original data
+  g_ceph_context->_conf->set_val("ms_compress_peer_types", "osd client");
+  g_ceph_context->_conf->set_val("ms_compress_min_size", "4096");
+  FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  ConnectionRef conn = client_msgr->get_connection(server_msgr->get_myinst());
+  for (int i = 0; i < 3; i++) {
+    bufferlist bl;
+    string s("abcdefghijklmnopqrstuvwxyz");
+    // compressible, incompressible, and below the threshold
+    if (i == 0) {
+      for (int j = 0; j < 1024*30; j++)
+	bl.append(s);
+    } else if (i == 1) {
+      bufferptr bp(1 << 20);
+      for (unsigned j = 0; j < bp.length(); j++)
+	bp.c_str()[j] = rand();
+      bl.append(bp);
+    } else {
+      bl.append(s);
+    }
+    MPing *m = new MPing();
+    m->set_data(bl);
+    conn->send_message(m);
+    utime_t t;
+    t += 1000*1000*500;
+    Mutex::Locker l(cli_dispatcher.lock);
+    while (!cli_dispatcher.got_new)
+      cli_dispatcher.cond.WaitInterval(cli_dispatcher.lock, t);
+    ASSERT_TRUE(cli_dispatcher.got_new);
+    cli_dispatcher.got_new = false;
+  }
+  ASSERT_TRUE(conn->is_connected());
+  server_msgr->shutdown();
+  client_msgr->shutdown();
+  server_msgr->wait();
+  client_msgr->wait();
+  g_ceph_context->_conf->set_val("ms_compress_peer_types", "");
+  g_ceph_context->_conf->set_val("ms_compress_min_size", "8192");
+}
+
+
 class SyntheticWorkload;
 
 struct Payload {
@@ -1494,6 +1722,29 @@ TEST_P(MessengerTest, MarkdownTest) {
   delete server_msgr2;
 }
 
+TEST(MessageTest, EncodeCache) {
+  MessageEncodeCacheRef cache = std::make_shared<MessageEncodeCache>();
+  vector<Message*> msgs;
+  for (int i = 0; i < 3; ++i) {
+    MCommand *m = new MCommand();
+    m->cmd.push_back("status");
+    m->set_encode_cache(cache);
+    msgs.push_back(m);
+  }
+  msgs[0]->encode(CEPH_FEATURES_ALL, MSG_CRC_ALL);
+  msgs[1]->encode(CEPH_FEATURES_ALL, MSG_CRC_ALL);
+  msgs[2]->encode(0, MSG_CRC_ALL);
+  ASSERT_EQ(2u, cache->entries.size());
+  ASSERT_TRUE(msgs[0]->get_payload().contents_equal(msgs[1]->get_payload()));
+  // the second copy reuses the first one's buffer
+  ASSERT_EQ(msgs[0]->get_payload().buffers().front().raw_c_str(),
+	    msgs[1]->get_payload().buffers().front().raw_c_str());
+  ASSERT_EQ(msgs[0]->get_header().version, msgs[1]->get_header().version);
+  ASSERT_EQ(msgs[0]->get_footer().front_crc, msgs[1]->get_footer().front_crc);
+  for (auto m : msgs)
+    m->put();
+}
+
 INSTANTIATE_TEST_CASE_P(
   Messenger,
   MessengerTest,
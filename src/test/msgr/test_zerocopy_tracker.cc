@@ -0,0 +1,108 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <limits>
+#include <gtest/gtest.h>
+
+#include "msg/async/ZeroCopyTracker.h"
+
+static bufferlist make_bl(unsigned len)
+{
+  bufferlist bl;
+  bl.append(buffer::create(len));
+  return bl;
+}
+
+TEST(ZeroCopyTracker, PinClaims)
+{
+  ZeroCopyTracker t;
+  bufferlist bl = make_bl(4096);
+  bufferptr p = bl.front();
+  t.pin(1, bl);
+  ASSERT_EQ(0u, bl.length());
+  ASSERT_EQ(1u, t.size());
+  // the tracker holds the other reference
+  ASSERT_EQ(2, p.raw_nref());
+  t.complete(0, 0, false);
+  ASSERT_TRUE(t.empty());
+  ASSERT_EQ(1, p.raw_nref());
+}
+
+TEST(ZeroCopyTracker, RangeCoversSeveralPins)
+{
+  ZeroCopyTracker t;
+  for (int i = 0; i < 3; ++i) {
+    bufferlist bl = make_bl(100);
+    t.pin(2, bl);    // ids 0-1, 2-3, 4-5
+  }
+  t.complete(0, 4, false);
+  ASSERT_EQ(1u, t.size());
+  t.complete(5, 5, false);
+  ASSERT_TRUE(t.empty());
+}
+
+TEST(ZeroCopyTracker, PartialOutOfOrder)
+{
+  ZeroCopyTracker t;
+  bufferlist a = make_bl(100), b = make_bl(100);
+  t.pin(3, a);       // ids 0-2
+  t.pin(1, b);       // id 3
+  t.complete(3, 3, false);
+  ASSERT_EQ(1u, t.size());
+  t.complete(2, 2, false);
+  t.complete(0, 0, false);
+  ASSERT_EQ(1u, t.size());
+  t.complete(1, 1, false);
+  ASSERT_TRUE(t.empty());
+}
+
+TEST(ZeroCopyTracker, IdWraparound)
+{
+  const uint32_t max = std::numeric_limits<uint32_t>::max();
+  ZeroCopyTracker t(max - 1);
+  bufferlist a = make_bl(100), b = make_bl(100);
+  t.pin(4, a);       // ids max-1, max, 0, 1
+  t.pin(1, b);       // id 2
+  // a range reported across the wrap
+  t.complete(max, 0, false);
+  ASSERT_EQ(2u, t.size());
+  t.complete(1, 2, false);
+  ASSERT_EQ(1u, t.size());
+  t.complete(max - 1, max - 1, false);
+  ASSERT_TRUE(t.empty());
+}
+
+TEST(ZeroCopyTracker, CopiedAccounting)
+{
+  ZeroCopyTracker t;
+  for (int i = 0; i < 4; ++i) {
+    bufferlist bl = make_bl(100);
+    t.pin(1, bl);
+  }
+  t.complete(0, 1, false);
+  ASSERT_EQ(0u, t.get_copied());
+  t.complete(2, 3, true);
+  ASSERT_EQ(2u, t.get_copied());
+  ASSERT_TRUE(t.empty());
+}
+
+TEST(ZeroCopyTracker, ReleaseAll)
+{
+  ZeroCopyTracker t;
+  bufferlist a = make_bl(100), b = make_bl(200);
+  t.pin(1, a);
+  t.pin(1, b);
+  bufferlist out;
+  t.release_all(&out);
+  ASSERT_TRUE(t.empty());
+  ASSERT_EQ(300u, out.length());
+}
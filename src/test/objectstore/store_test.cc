@@ -628,6 +628,77 @@ TEST_P(StoreTest, SimpleColPreHashTest) {
   }
 }
 
+TEST_P(StoreTest, FileStoreBackgroundSplit) {
+  if (string(GetParam()) != "filestore")
+    return;
+  // split at 16 objects per directory, in the background
+  SetVal(g_conf, "filestore_merge_threshold", "-1");
+  SetVal(g_conf, "filestore_split_multiple", "1");
+  SetVal(g_conf, "filestore_split_rand_factor", "0");
+  SetVal(g_conf, "filestore_split_async", "true");
+  g_conf->apply_changes(NULL);
+
+  coll_t cid(spg_t(pg_t(0, 1), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  auto make_oid = [](unsigned i) {
+    return ghobject_t(hobject_t(sobject_t("split_" + stringify(i), CEPH_NOSNAP),
+				"", i * 0x1234567u, 1, ""));
+  };
+  // under twice the threshold, so the write path only queues the split
+  const unsigned num = 30;
+  for (unsigned i = 0; i < num; ++i) {
+    ObjectStore::Transaction t;
+    t.touch(cid, make_oid(i));
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // the splitter creates the first level of subdirectories on its own
+  string pattern = string(GetParam()) + ".test_temp_dir/current/" +
+    cid.to_str() + "/DIR_*";
+  bool split = false;
+  for (int i = 0; i < 100 && !split; ++i) {
+    glob_t g;
+    split = ::glob(pattern.c_str(), 0, NULL, &g) == 0 && g.gl_pathc > 0;
+    globfree(&g);
+    if (!split)
+      usleep(100000);
+  }
+  ASSERT_TRUE(split);
+
+  // umount stops the splitter, whether or not it has finished
+  ch.reset();
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->mount());
+  ch = store->open_collection(cid);
+  {
+    vector<ghobject_t> ls;
+    r = store->collection_list(ch, ghobject_t(), ghobject_t::get_max(),
+			       INT_MAX, &ls, 0);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(num, ls.size());
+  }
+  for (unsigned i = 0; i < num; ++i) {
+    struct stat st;
+    ASSERT_EQ(0, store->stat(ch, make_oid(i), &st));
+  }
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < num; ++i)
+      t.remove(cid, make_oid(i));
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, SmallBlockWrites) {
   int r;
   coll_t cid;
@@ -2339,6 +2410,77 @@ TEST_P(StoreTest, ZeroLengthWrite) {
   ASSERT_EQ(0, r);
 }
 
+TEST_P(StoreTest, OverlappingWritesInOneTransaction) {
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("foo2", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist expected;
+  {
+    // several partial writes to the same region, then a clone that must
+    // see all of them
+    ObjectStore::Transaction t;
+    bufferlist a, b, c;
+    a.append(string(10000, 'a'));
+    b.append(string(3000, 'b'));
+    c.append(string(100, 'c'));
+    t.write(cid, hoid, 0, a.length(), a);
+    t.write(cid, hoid, 5000, b.length(), b);
+    t.write(cid, hoid, 5500, c.length(), c);
+    t.zero(cid, hoid, 100, 10);
+    t.clone(cid, hoid, hoid2);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+
+    expected.append(string(100, 'a'));
+    expected.append_zero(10);
+    expected.append(string(4890, 'a'));
+    expected.append(string(500, 'b'));
+    expected.append(string(100, 'c'));
+    expected.append(string(2400, 'b'));
+    expected.append(string(2000, 'a'));
+  }
+  for (auto& o : { hoid, hoid2 }) {
+    bufferlist in;
+    r = store->read(ch, o, 0, expected.length(), in);
+    ASSERT_EQ((int)expected.length(), r);
+    ASSERT_TRUE(bl_eq(expected, in));
+  }
+  {
+    // remove and recreate in one transaction; none of the old data may
+    // show through
+    ObjectStore::Transaction t;
+    bufferlist d;
+    d.append(string(100, 'd'));
+    t.remove(cid, hoid);
+    t.write(cid, hoid, 200, d.length(), d);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+
+    bufferlist exp, in;
+    exp.append_zero(200);
+    exp.append(d);
+    r = store->read(ch, hoid, 0, 1000, in);
+    ASSERT_EQ((int)exp.length(), r);
+    ASSERT_TRUE(bl_eq(exp, in));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, ZeroLengthZero) {
   int r;
   coll_t cid;
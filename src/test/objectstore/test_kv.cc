@@ -12,11 +12,14 @@
  *
  */
 
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
 #include <time.h>
 #include <sys/mount.h>
+#include <atomic>
+#include <thread>
 #include "kv/KeyValueDB.h"
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
@@ -119,6 +122,103 @@ TEST_P(KVTest, OpenWriteRead) {
   fini();
 }
 
+TEST_P(KVTest, MultiGet) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 100; i += 2) {
+      bufferlist value;
+      value.append(stringify(i));
+      t->set("prefix", stringify(i), value);
+    }
+    bufferlist value;
+    value.append("other");
+    t->set("prefiy", "1", value);
+    db->submit_transaction_sync(t);
+  }
+  {
+    std::set<string> keys;
+    for (unsigned i = 0; i < 100; ++i) {
+      keys.insert(stringify(i));
+    }
+    std::map<string, bufferlist> out;
+    ASSERT_EQ(0, db->get("prefix", keys, &out));
+    ASSERT_EQ(50u, out.size());
+    for (auto& p : out) {
+      ASSERT_EQ(0, atoi(p.first.c_str()) % 2);
+      ASSERT_EQ(p.first, _bl_to_str(p.second));
+    }
+  }
+  {
+    std::map<string, bufferlist> out;
+    ASSERT_EQ(0, db->get("prefix", std::set<string>(), &out));
+    ASSERT_TRUE(out.empty());
+  }
+  fini();
+}
+
+TEST_P(KVTest, ConcurrentSnapshotReads) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const unsigned num_keys = 100;
+  auto write_all = [&](unsigned gen) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < num_keys; ++i) {
+      bufferlist value;
+      value.append(stringify(gen));
+      t->set("prefix", stringify(i), value);
+    }
+    // churn some keys in and out so deleted entries get reclaimed too
+    bufferlist value;
+    value.append(stringify(gen));
+    t->set("churn", stringify(gen % 10), value);
+    t->rmkey("churn", stringify((gen + 5) % 10));
+    db->submit_transaction(t);
+  };
+  write_all(0);
+
+  std::atomic<bool> stop = { false };
+  std::atomic<unsigned> errors = { 0 };
+  std::thread writer([&] {
+    for (unsigned gen = 1; gen < 2000; ++gen) {
+      write_all(gen);
+    }
+    stop = true;
+  });
+  std::vector<std::thread> readers;
+  for (unsigned r = 0; r < 4; ++r) {
+    readers.emplace_back([&] {
+      while (!stop) {
+	// every transaction rewrites all keys, so an iterator must see
+	// exactly one generation
+	KeyValueDB::Iterator it = db->get_iterator("prefix");
+	string gen;
+	unsigned n = 0;
+	for (it->seek_to_first(); it->valid(); it->next(), ++n) {
+	  string v = _bl_to_str(it->value());
+	  if (gen.empty()) {
+	    gen = v;
+	  } else if (v != gen) {
+	    errors++;
+	  }
+	}
+	if (n != num_keys) {
+	  errors++;
+	}
+	bufferlist bl;
+	if (db->get("prefix", "0", &bl) != 0) {
+	  errors++;
+	}
+      }
+    });
+  }
+  writer.join();
+  for (auto& t : readers) {
+    t.join();
+  }
+  ASSERT_EQ(0u, errors.load());
+  fini();
+}
+
 TEST_P(KVTest, PutReopen) {
   ASSERT_EQ(0, db->create_and_open(cout));
   {
@@ -312,6 +412,92 @@ TEST_P(KVTest, RMRange) {
   fini();
 }
 
+TEST_P(KVTest, RmKeysByPrefix) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < 100; ++i) {
+      t->set("p", stringify(i), value);
+      t->set("p1", stringify(i), value);
+    }
+    t->set("o", "zzz", value);
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("p");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  db->compact_prefix("p");
+  {
+    KeyValueDB::Iterator it = db->get_iterator("p");
+    it->seek_to_first();
+    ASSERT_FALSE(it->valid());
+    bufferlist v;
+    ASSERT_EQ(-ENOENT, db->get("p", "50", &v));
+    ASSERT_EQ(0, db->get("p1", "50", &v));
+    ASSERT_EQ(0, db->get("o", "zzz", &v));
+  }
+  fini();
+}
+
+TEST_P(KVTest, RocksDBCFRmKeysByPrefix) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  // exercise the range tombstone path of rmkeys_by_prefix
+  g_ceph_context->_conf->set_val("rocksdb_enable_rmrange", "true");
+  fini();
+  init();
+  g_ceph_context->_conf->set_val("rocksdb_enable_rmrange", "false");
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("cf1", ""));
+  ASSERT_EQ(0, db->init(g_conf->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < 100; ++i) {
+      t->set("cf1", stringify(i), value);
+    }
+    t->set("cf1", string(8, '\xff'), value);
+    t->set("prefix", "key", value);
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("cf1", "10", "20");
+    t->rm_range_keys_bulk("cf1", "30", "40");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  db->compact_range("cf1", "10", "20");
+  {
+    bufferlist v;
+    ASSERT_EQ(-ENOENT, db->get("cf1", "15", &v));
+    ASSERT_EQ(0, db->get("cf1", "20", &v));
+    ASSERT_EQ(-ENOENT, db->get("cf1", "35", &v));
+    ASSERT_EQ(0, db->get("cf1", "40", &v));
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("cf1");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  db->compact_prefix("cf1");
+  {
+    KeyValueDB::Iterator it = db->get_iterator("cf1");
+    it->seek_to_first();
+    ASSERT_FALSE(it->valid());
+    bufferlist v;
+    ASSERT_EQ(0, db->get("prefix", "key", &v));
+  }
+  fini();
+}
+
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -417,6 +603,69 @@ TEST_P(KVTest, RocksDBIteratorTest) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBCFWholeSpaceIterator) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("B", ""));
+  cfs.push_back(KeyValueDB::ColumnFamily("D", ""));
+  ASSERT_EQ(0, db->init(g_conf->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist v;
+    v.append("v");
+    for (auto prefix : { "A", "B", "C", "D", "E" }) {
+      t->set(prefix, "k1", v);
+      t->set(prefix, "k2", v);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  vector<pair<string,string>> expected;
+  for (auto prefix : { "A", "B", "C", "D", "E" }) {
+    expected.push_back(make_pair(prefix, "k1"));
+    expected.push_back(make_pair(prefix, "k2"));
+  }
+  {
+    cout << "walking every column family forward" << std::endl;
+    KeyValueDB::WholeSpaceIterator iter = db->get_wholespace_iterator();
+    vector<pair<string,string>> seen;
+    for (iter->seek_to_first(); iter->valid(); iter->next()) {
+      seen.push_back(iter->raw_key());
+      ASSERT_EQ(seen.back().first.size() + 1 + seen.back().second.size(),
+		iter->key_size());
+    }
+    ASSERT_EQ(expected, seen);
+  }
+  {
+    cout << "walking every column family backward" << std::endl;
+    KeyValueDB::WholeSpaceIterator iter = db->get_wholespace_iterator();
+    vector<pair<string,string>> seen;
+    for (iter->seek_to_last(); iter->valid(); iter->prev())
+      seen.push_back(iter->raw_key());
+    std::reverse(seen.begin(), seen.end());
+    ASSERT_EQ(expected, seen);
+  }
+  {
+    cout << "changing direction across column families" << std::endl;
+    KeyValueDB::WholeSpaceIterator iter = db->get_wholespace_iterator();
+    iter->lower_bound("C", "k2");
+    ASSERT_TRUE(iter->valid());
+    ASSERT_EQ(make_pair(string("C"), string("k2")), iter->raw_key());
+    iter->next();
+    ASSERT_EQ(make_pair(string("D"), string("k1")), iter->raw_key());
+    iter->prev();
+    iter->prev();
+    ASSERT_EQ(make_pair(string("C"), string("k1")), iter->raw_key());
+    iter->prev();
+    ASSERT_EQ(make_pair(string("B"), string("k2")), iter->raw_key());
+    iter->next();
+    ASSERT_EQ(make_pair(string("C"), string("k1")), iter->raw_key());
+  }
+  fini();
+}
+
 TEST_P(KVTest, RocksDBCFMerge) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -467,6 +716,68 @@ TEST_P(KVTest, RocksDBCFMerge) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBCFMigrate) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  ASSERT_EQ(0, db->init(g_conf->bluestore_rocksdb_options));
+  cout << "creating db without column families" << std::endl;
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist value;
+    value.append("value");
+    for (unsigned i = 0; i < 10000; ++i) {
+      t->set("cf1", stringify(i), value);
+    }
+    t->set("other", "key", value);
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  fini();
+
+  cout << "reopen with cf_migrate and move prefix cf1 into its own CF"
+       << std::endl;
+  db.reset(KeyValueDB::create(g_ceph_context, string(GetParam()),
+			      "kv_test_temp_dir", {{"cf_migrate", "1"}}));
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily(
+    "cf1", "cache_ratio=0.1;bloom_bits_per_key=0;write_buffer_size=1048576"));
+  ASSERT_EQ(0, db->init(g_conf->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->open(cout, cfs));
+  ASSERT_TRUE(db->is_column_family("cf1"));
+  {
+    bufferlist v1, v2;
+    ASSERT_EQ(0, db->get("cf1", "9999", &v1));
+    ASSERT_EQ("value", _bl_to_str(v1));
+    ASSERT_EQ(0, db->get("other", "key", &v2));
+    ASSERT_EQ("value", _bl_to_str(v2));
+  }
+  {
+    unsigned n = 0;
+    KeyValueDB::Iterator iter = db->get_iterator("cf1");
+    for (iter->seek_to_first(); iter->valid(); iter->next()) {
+      ++n;
+    }
+    ASSERT_EQ(10000u, n);
+  }
+  {
+    cout << "nothing is left behind in the default CF" << std::endl;
+    KeyValueDB::WholeSpaceIterator iter = db->get_wholespace_iterator();
+    iter->seek_to_first("cf1");
+    ASSERT_TRUE(!iter->valid() || !iter->raw_key_is_prefixed("cf1"));
+  }
+  fini();
+
+  init();
+  ASSERT_EQ(0, db->open(cout, cfs));
+  {
+    bufferlist v;
+    ASSERT_EQ(0, db->get("cf1", "0", &v));
+    ASSERT_EQ("value", _bl_to_str(v));
+  }
+  fini();
+}
+
 INSTANTIATE_TEST_CASE_P(
   KeyValueDB,
   KVTest,
@@ -281,3 +281,69 @@ TEST(PageSet, FreeHoles)
   pages.get_range(0, 8, range);
   ASSERT_EQ(0u, range.size());
 }
+
+TEST(PageSet, SparseLeaves)
+{
+  // pages far enough apart to land in separate index leaves
+  PageSet pages(4096);
+  PageSet::page_vector range;
+  for (uint64_t i : {0ull, 1ull << 30, 1ull << 40})
+    pages.alloc_range(i, 8192, range);
+  range.clear();
+  ASSERT_EQ(6u, pages.size());
+
+  pages.get_range(0, 1ull << 41, range);
+  ASSERT_EQ(6u, range.size());
+  ASSERT_EQ(0u, range[0]->offset);
+  ASSERT_EQ(4096u, range[1]->offset);
+  ASSERT_EQ(1ull << 30, range[2]->offset);
+  ASSERT_EQ(1ull << 40, range[4]->offset);
+  range.clear();
+
+  // a range spanning a leaf boundary but no pages
+  pages.get_range(8192, (1ull << 30) - 8192, range);
+  ASSERT_EQ(0u, range.size());
+
+  pages.free_pages_after((1ull << 30) + 1);
+  ASSERT_EQ(3u, pages.size());
+  pages.get_range(0, 1ull << 41, range);
+  ASSERT_EQ(3u, range.size());
+  ASSERT_EQ(1ull << 30, range[2]->offset);
+}
+
+TEST(PageSet, Arena)
+{
+  auto arena = std::make_shared<PageArena>(4096, false);
+  PageSet::page_vector range;
+  {
+    PageSet pages(4096, arena);
+    pages.alloc_range(0, 4096 * 4, range);
+    ASSERT_EQ(4u, range.size());
+    for (auto &p : range) {
+      ASSERT_TRUE(is_aligned(p.get()));
+      std::fill(p->data, p->data + 4096, 1);
+    }
+    ASSERT_LT(0u, arena->get_mapped_bytes());
+    range.clear();
+
+    // freed pages are reused rather than mapping more memory
+    const auto mapped = arena->get_mapped_bytes();
+    pages.free_pages_after(0);
+    ASSERT_TRUE(pages.empty());
+    pages.alloc_range(0, 4096 * 4, range);
+    ASSERT_EQ(mapped, arena->get_mapped_bytes());
+
+    // the part of a page outside the written range is zeroed
+    range.clear();
+    pages.free_pages_after(0);
+    pages.alloc_range(10, 1, range);
+    ASSERT_EQ(0, range[0]->data[0]);
+    ASSERT_EQ(0, range[0]->data[4095]);
+    range.clear();
+  }
+
+  // a PageSet with a different page size doesn't use the arena
+  PageSet other(8192, arena);
+  other.alloc_range(0, 8192, range);
+  ASSERT_EQ(nullptr, range[0]->arena);
+}
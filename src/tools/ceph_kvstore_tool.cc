@@ -10,10 +10,15 @@
 * License version 2.1, as published by the Free Software
 * Foundation. See file COPYING.
 */
+#include <algorithm>
 #include <map>
+#include <numeric>
 #include <set>
+#include <sstream>
 #include <string>
 #include <fstream>
+#include <random>
+#include <dirent.h>
 
 #include <boost/scoped_ptr.hpp>
 
@@ -59,7 +64,9 @@ class StoreTool
   string store_path;
 
   public:
-  StoreTool(string type, const string &path, bool need_open_db=true) : store_path(path) {
+  StoreTool(string type, const string &path, bool need_open_db=true,
+	    bool create=false,
+	    const map<string,string> &kv_options = {}) : store_path(path) {
     if (type == "bluestore-kv") {
 #ifdef WITH_BLUESTORE
       auto bluestore = new BlueStore(g_ceph_context, path, need_open_db);
@@ -74,9 +81,11 @@ class StoreTool
       exit(1);
 #endif
     } else {
-      auto db_ptr = KeyValueDB::create(g_ceph_context, type, path);
+      auto db_ptr = KeyValueDB::create(g_ceph_context, type, path,
+				       kv_options);
       if (need_open_db) {
-        int r = db_ptr->open(std::cerr);
+        int r = create ? db_ptr->create_and_open(std::cerr) :
+	  db_ptr->open(std::cerr);
         if (r < 0) {
           cerr << "failed to open type " << type << " path " << path << ": "
                << cpp_strerror(r) << std::endl;
@@ -288,11 +297,287 @@ class StoreTool
   int repair() {
     return db->repair(std::cout);
   }
+
+  struct BenchResult {
+    uint64_t ops = 0;          ///< keys written, removed or read
+    uint64_t user_bytes = 0;   ///< key + value bytes handed to the store
+    std::vector<double> lat;   ///< per-transaction or per-read latency (usec)
+  };
+
+  static double since_usec(mono_time start) {
+    return std::chrono::duration<double, std::micro>(
+      mono_clock::now() - start).count();
+  }
+
+  // synthetic workloads never touch the prefixes a real store uses
+  static constexpr const char *BENCH_PREFIX = "_bench";
+
+  static string bench_key(uint64_t obj, uint64_t n) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%016llx.%08llx",
+	     (unsigned long long)obj, (unsigned long long)n);
+    return string(buf);
+  }
+
+  void bench_commit(KeyValueDB::Transaction &tx, BenchResult &r) {
+    auto start = mono_clock::now();
+    db->submit_transaction_sync(tx);
+    r.lat.push_back(since_usec(start));
+    tx = db->get_transaction();
+  }
+
+  // untimed fill of @p num keys under @p prefix, 1024 keys per object
+  void bench_populate(const string &prefix, uint64_t num, bufferlist &val,
+		      int ops_per_tx) {
+    KeyValueDB::Transaction tx = db->get_transaction();
+    for (uint64_t i = 0; i < num; ++i) {
+      tx->set(prefix, bench_key(i / 1024, i % 1024), val);
+      if ((i + 1) % ops_per_tx == 0) {
+	db->submit_transaction_sync(tx);
+	tx = db->get_transaction();
+      }
+    }
+    db->submit_transaction_sync(tx);
+  }
+
+  // onode-like updates: random overwrites of a hot set of keys
+  void bench_onode(uint64_t num_ops, bufferlist &val, int ops_per_tx,
+		   BenchResult &r) {
+    std::mt19937_64 rng(0);
+    uint64_t objects = std::max<uint64_t>(num_ops / 4, 1);
+    KeyValueDB::Transaction tx = db->get_transaction();
+    for (uint64_t i = 0; i < num_ops; ++i) {
+      string key = bench_key(rng() % objects, 0);
+      tx->set(BENCH_PREFIX, key, val);
+      r.user_bytes += key.length() + val.length();
+      ++r.ops;
+      if ((i + 1) % ops_per_tx == 0)
+	bench_commit(tx, r);
+    }
+    if (num_ops % ops_per_tx)
+      bench_commit(tx, r);
+  }
+
+  // omap-like bulk inserts: sequential keys, 1024 per object
+  void bench_omap(uint64_t num_ops, bufferlist &val, int ops_per_tx,
+		  BenchResult &r) {
+    KeyValueDB::Transaction tx = db->get_transaction();
+    for (uint64_t i = 0; i < num_ops; ++i) {
+      string key = bench_key(i / 1024, i % 1024);
+      tx->set(BENCH_PREFIX, key, val);
+      r.user_bytes += key.length() + val.length();
+      ++r.ops;
+      if ((i + 1) % ops_per_tx == 0)
+	bench_commit(tx, r);
+    }
+    if (num_ops % ops_per_tx)
+      bench_commit(tx, r);
+  }
+
+  // collection/object removal: one range delete per populated object
+  void bench_rmrange(uint64_t num_ops, bufferlist &val, int ops_per_tx,
+		     BenchResult &r) {
+    bench_populate(BENCH_PREFIX, num_ops, val, 1024);
+    uint64_t objects = (num_ops + 1023) / 1024;
+    KeyValueDB::Transaction tx = db->get_transaction();
+    for (uint64_t o = 0; o < objects; ++o) {
+      tx->rm_range_keys(BENCH_PREFIX, bench_key(o, 0), bench_key(o + 1, 0));
+      r.ops += std::min<uint64_t>(1024, num_ops - o * 1024);
+      if ((o + 1) % ops_per_tx == 0)
+	bench_commit(tx, r);
+    }
+    if (objects % ops_per_tx)
+      bench_commit(tx, r);
+  }
+
+  // iterator scans: walk the populated prefix, timing every ops_per_tx keys
+  void bench_scan(uint64_t num_ops, bufferlist &val, int ops_per_tx,
+		  BenchResult &r) {
+    bench_populate(BENCH_PREFIX, num_ops, val, 1024);
+    auto start = mono_clock::now();
+    KeyValueDB::Iterator it = db->get_iterator(BENCH_PREFIX);
+    it->seek_to_first();
+    int n = 0;
+    while (it->valid()) {
+      r.user_bytes += it->key().length() + it->value().length();
+      ++r.ops;
+      it->next();
+      if (++n == ops_per_tx) {
+	r.lat.push_back(since_usec(start));
+	start = mono_clock::now();
+	n = 0;
+      }
+    }
+    if (n)
+      r.lat.push_back(since_usec(start));
+  }
+
+  /*
+   * Replay a captured trace, one op per line with URL-escaped names:
+   *   set <prefix> <key> <value-len> | rm <prefix> <key>
+   *   rm-range <prefix> <start> <end> | get <prefix> <key>
+   *   scan <prefix> <start> <num-keys>
+   * Mutations are batched ops_per_tx at a time; reads are timed singly.
+   */
+  int bench_replay(const string &fn, int ops_per_tx, BenchResult &r) {
+    std::ifstream in(fn);
+    if (!in) {
+      std::cerr << "unable to open trace '" << fn << "'" << std::endl;
+      return -ENOENT;
+    }
+    KeyValueDB::Transaction tx = db->get_transaction();
+    int pending = 0;
+    string line;
+    while (std::getline(in, line)) {
+      std::istringstream ss(line);
+      string op, prefix, a, b;
+      ss >> op >> prefix >> a >> b;
+      if (op.empty() || op[0] == '#')
+	continue;
+      prefix = url_unescape(prefix);
+      a = url_unescape(a);
+      if (op == "set") {
+	bufferlist v;
+	v.append_zero(atoi(b.c_str()));
+	tx->set(prefix, a, v);
+	r.user_bytes += a.length() + v.length();
+      } else if (op == "rm") {
+	tx->rmkey(prefix, a);
+      } else if (op == "rm-range") {
+	tx->rm_range_keys(prefix, a, url_unescape(b));
+      } else if (op == "get") {
+	auto start = mono_clock::now();
+	bufferlist v;
+	db->get(prefix, a, &v);
+	r.lat.push_back(since_usec(start));
+	++r.ops;
+	continue;
+      } else if (op == "scan") {
+	auto start = mono_clock::now();
+	KeyValueDB::Iterator it = db->get_iterator(prefix);
+	it->lower_bound(a);
+	for (int n = atoi(b.c_str()); n > 0 && it->valid(); --n) {
+	  it->value();
+	  it->next();
+	}
+	r.lat.push_back(since_usec(start));
+	++r.ops;
+	continue;
+      } else {
+	std::cerr << "unrecognized trace op '" << op << "'" << std::endl;
+	return -EINVAL;
+      }
+      ++r.ops;
+      if (++pending == ops_per_tx) {
+	bench_commit(tx, r);
+	pending = 0;
+      }
+    }
+    if (pending)
+      bench_commit(tx, r);
+    return 0;
+  }
+
+  int bench(const string &workload, const string &trace, uint64_t num_ops,
+	    unsigned value_size, int ops_per_tx) {
+    if (ops_per_tx <= 0) {
+      std::cerr << "must specify a number of ops/tx > 0" << std::endl;
+      return -EINVAL;
+    }
+    bufferlist val;
+    val.append_zero(value_size);
+
+    // WAL + flush + compaction bytes against what we handed the store
+    const char *wa_props[] = { "rocksdb.wal.bytes",
+			       "rocksdb.flush.write.bytes",
+			       "rocksdb.compact.write.bytes" };
+    uint64_t wa_before[3] = {0, 0, 0}, wa_after[3] = {0, 0, 0};
+    bool have_wa = true;
+    for (int i = 0; i < 3; ++i)
+      have_wa = have_wa && db->get_property(wa_props[i], &wa_before[i]) == 0;
+
+    BenchResult r;
+    auto started_at = mono_clock::now();
+    if (workload == "onode") {
+      bench_onode(num_ops, val, ops_per_tx, r);
+    } else if (workload == "omap") {
+      bench_omap(num_ops, val, ops_per_tx, r);
+    } else if (workload == "rmrange") {
+      bench_rmrange(num_ops, val, ops_per_tx, r);
+    } else if (workload == "scan") {
+      bench_scan(num_ops, val, ops_per_tx, r);
+    } else if (workload == "replay") {
+      int ret = bench_replay(trace, ops_per_tx, r);
+      if (ret < 0)
+	return ret;
+    } else {
+      std::cerr << "unrecognized workload '" << workload << "'" << std::endl;
+      return -EINVAL;
+    }
+    double secs = std::chrono::duration<double>(
+      mono_clock::now() - started_at).count();
+    if (workload == "rmrange" || workload == "scan") {
+      // leave the untimed populate phase out of the throughput
+      secs = std::accumulate(r.lat.begin(), r.lat.end(), 0.0) / 1000000.0;
+    }
+
+    for (int i = 0; i < 3; ++i)
+      have_wa = have_wa && db->get_property(wa_props[i], &wa_after[i]) == 0;
+
+    std::sort(r.lat.begin(), r.lat.end());
+    auto pct = [&r](double p) {
+      if (r.lat.empty())
+	return 0.0;
+      return r.lat[std::min<size_t>(r.lat.size() - 1, p * r.lat.size())];
+    };
+    double avg = r.lat.empty() ? 0.0 :
+      std::accumulate(r.lat.begin(), r.lat.end(), 0.0) / r.lat.size();
+
+    std::cout << "bench " << workload << ":" << std::endl;
+    std::cout << "  " << r.ops << " ops in " << r.lat.size()
+	      << " timed units, " << secs << " seconds" << std::endl;
+    std::cout << "  throughput " << (secs > 0 ? r.ops / secs : 0)
+	      << " ops/s, " << byte_u_t(secs > 0 ? r.user_bytes / secs : 0)
+	      << "/s" << std::endl;
+    std::cout << "  latency usec: avg " << avg
+	      << " p50 " << pct(.5) << " p95 " << pct(.95)
+	      << " p99 " << pct(.99) << " p99.9 " << pct(.999)
+	      << " max " << (r.lat.empty() ? 0.0 : r.lat.back()) << std::endl;
+    if (have_wa && r.user_bytes) {
+      uint64_t wal = wa_after[0] - wa_before[0];
+      uint64_t flush = wa_after[1] - wa_before[1];
+      uint64_t compact = wa_after[2] - wa_before[2];
+      std::cout << "  write amplification "
+		<< (double)(wal + flush + compact) / r.user_bytes
+		<< " (wal " << byte_u_t(wal)
+		<< ", flush " << byte_u_t(flush)
+		<< ", compaction " << byte_u_t(compact) << ")" << std::endl;
+    }
+    return 0;
+  }
 };
 
+// true if @p path does not exist yet or is an empty directory
+static bool is_empty_dir(const string &path)
+{
+  DIR *dir = ::opendir(path.c_str());
+  if (!dir)
+    return errno == ENOENT;
+  bool empty = true;
+  struct dirent *de;
+  while ((de = ::readdir(dir)) != nullptr) {
+    if (strcmp(de->d_name, ".") && strcmp(de->d_name, "..")) {
+      empty = false;
+      break;
+    }
+  }
+  ::closedir(dir);
+  return empty;
+}
+
 void usage(const char *pname)
 {
-  std::cout << "Usage: " << pname << " <leveldb|rocksdb|bluestore-kv> <store path> command [args...]\n"
+  std::cout << "Usage: " << pname << " <leveldb|rocksdb|memdb|bluestore-kv> <store path> command [args...]\n"
     << "\n"
     << "Commands:\n"
     << "  list [prefix]\n"
@@ -310,6 +595,8 @@ void usage(const char *pname)
     << "  compact-prefix <prefix>\n"
     << "  compact-range <prefix> <start> <end>\n"
     << "  repair\n"
+    << "  bench <onode|omap|rmrange|scan> [num-ops] [value-size] [ops-per-tx]\n"
+    << "  bench replay <trace-file> [ops-per-tx]\n"
     << std::endl;
 }
 
@@ -348,6 +635,7 @@ int main(int argc, const char *argv[])
 
   if (type != "leveldb" &&
       type != "rocksdb" &&
+      type != "memdb" &&
       type != "bluestore-kv")  {
 
     std::cerr << "Unrecognized type: " << args[0] << std::endl;
@@ -356,7 +644,25 @@ int main(int argc, const char *argv[])
   }
 
   bool need_open_db = (cmd != "repair");
-  StoreTool st(type, path, need_open_db);
+  map<string,string> kv_options;
+  if (cmd == "bench") {
+    // bench writes and range-deletes freely, so only ever point it at a
+    // scratch store
+    if (type == "bluestore-kv") {
+      std::cerr << "bench refuses to run against a bluestore-kv store"
+		<< std::endl;
+      return 1;
+    }
+    if (!is_empty_dir(path)) {
+      std::cerr << "bench needs a new or empty store path; " << path
+		<< " is not empty" << std::endl;
+      return 1;
+    }
+    // byte tickers for the write amplification report, without the
+    // per-op perf context that rocksdb_perf would add to every latency
+    kv_options["statistics"] = "1";
+  }
+  StoreTool st(type, path, need_open_db, cmd == "bench", kv_options);
 
   if (cmd == "repair") {
     int ret = st.repair();
@@ -595,6 +901,53 @@ int main(int argc, const char *argv[])
     string start(url_unescape(argv[5]));
     string end(url_unescape(argv[6]));
     st.compact_range(prefix, start, end);
+  } else if (cmd == "bench") {
+    if (argc < 5) {
+      usage(argv[0]);
+      return 1;
+    }
+    string workload(argv[4]);
+    string trace;
+    uint64_t num_ops = 100000;
+    unsigned value_size = 4096;
+    int ops_per_tx = 32;
+    string err;
+    int a = 5;
+    if (workload == "replay") {
+      if (argc < 6) {
+	usage(argv[0]);
+	return 1;
+      }
+      trace = argv[a++];
+    } else {
+      if (argc > a) {
+	num_ops = strict_strtoll(argv[a++], 10, &err);
+	if (!err.empty()) {
+	  std::cerr << "invalid num-ops: " << err << std::endl;
+	  return 1;
+	}
+      }
+      if (argc > a) {
+	value_size = strict_strtol(argv[a++], 10, &err);
+	if (!err.empty()) {
+	  std::cerr << "invalid value-size: " << err << std::endl;
+	  return 1;
+	}
+      }
+    }
+    if (argc > a) {
+      ops_per_tx = strict_strtol(argv[a++], 10, &err);
+      if (!err.empty()) {
+	std::cerr << "invalid ops-per-tx: " << err << std::endl;
+	return 1;
+      }
+    }
+    int ret = st.bench(workload, trace, num_ops, value_size, ops_per_tx);
+    if (ret < 0) {
+      std::cerr << "bench " << workload << " failed: " << cpp_strerror(ret)
+		<< std::endl;
+      return 1;
+    }
   } else {
     std::cerr << "Unrecognized command: " << cmd << std::endl;
     return 1;